@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef ALIGNEDALLOCATOR_H
+#define ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Alignment of data the SIMD kernels stream through: one cache line, enough for AVX loads as well
+const size_t SIMD_ALIGNMENT = 64;
+
+// alignment has to be a power of two. Memory from alignedAlloc must go back through alignedFree.
+// Over-allocates with new (so the MemoryTracker sees it) and keeps the original pointer right in front of the block
+inline void* alignedAlloc(size_t size, size_t alignment)
+{
+	if (alignment < sizeof(void*))
+		alignment = sizeof(void*);
+	char* memory = static_cast<char*>(::operator new(size + alignment - 1 + sizeof(void*), std::nothrow));
+	if (memory == NULL)
+		return NULL;
+	size_t start = reinterpret_cast<size_t>(memory + sizeof(void*));
+	char* aligned = reinterpret_cast<char*>((start + alignment - 1) & ~(alignment - 1));
+	reinterpret_cast<void**>(aligned)[-1] = memory;
+	return aligned;
+}
+
+inline void alignedFree(void* memory)
+{
+	if (memory != NULL)
+		::operator delete(reinterpret_cast<void**>(memory)[-1]);
+}
+
+// std::vector etc. with aligned storage
+template <typename T, size_t Alignment = SIMD_ALIGNMENT>
+class AlignedAllocator
+{
+public:
+	typedef T value_type;
+	template <typename U> struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T* allocate(size_t count)
+	{
+		void* memory = alignedAlloc(count * sizeof(T), Alignment);
+		if (memory == NULL)
+			throw std::bad_alloc();
+		return static_cast<T*>(memory);
+	}
+
+	void deallocate(T* memory, size_t) { alignedFree(memory); }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return true; }
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment>&, const AlignedAllocator<U, Alignment>&) { return false; }
+
+// Input and output arrays of the SIMD kernels
+typedef std::vector<float, AlignedAllocator<float> > SimdFloatArray;
+
+#endif
@@ -0,0 +1,136 @@
+#include "AsyncReadback.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+AsyncReadback::AsyncReadback()
+	: oldest(0), inFlight(0)
+{}
+
+AsyncReadback::~AsyncReadback()
+{
+	// GL objects are left to destroy(), the context may be gone already
+}
+
+bool AsyncReadback::init(int ringSize)
+{
+	MEMORY_TAG(MEMORY_TAG_CAPTURE);
+	slots.resize(ringSize);
+	for (size_t i = 0; i < slots.size(); i++) {
+		Slot& slot = slots[i];
+		glGenBuffers(1, &slot.buffer);
+		slot.capacity = 0;
+		slot.fence = 0;
+		slot.width = slot.height = 0;
+	}
+	oldest = 0;
+	inFlight = 0;
+	return !slots.empty() && slots[0].buffer != 0;
+}
+
+void AsyncReadback::destroy()
+{
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].fence != 0) {
+			glDeleteSync(slots[i].fence);
+		}
+		glDeleteBuffers(1, &slots[i].buffer);
+	}
+	slots.clear();
+	spare.clear();
+	oldest = 0;
+	inFlight = 0;
+}
+
+bool AsyncReadback::request(GLuint framebuffer, GLsizei width, GLsizei height, ReadbackHandler handler)
+{
+	if (slots.empty() || inFlight == (int)slots.size()) {
+		return false;
+	}
+	PROFILE_ZONE("ReadbackRequest");
+
+	Slot& slot = slots[(oldest + inFlight) % slots.size()];
+	GLsizeiptr size = (GLsizeiptr)width * height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.capacity < size) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+		slot.capacity = size;
+	}
+
+	// With a pack buffer bound the last argument is an offset, the call returns right away
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(framebuffer == 0 ? GL_BACK : GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = width;
+	slot.height = height;
+	slot.handler = handler;
+	inFlight++;
+	return true;
+}
+
+void AsyncReadback::poll()
+{
+	while (inFlight > 0) {
+		Slot& slot = slots[oldest];
+		GLenum status = glClientWaitSync(slot.fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			return;
+		}
+		complete(slot);
+	}
+}
+
+void AsyncReadback::finish()
+{
+	while (inFlight > 0) {
+		Slot& slot = slots[oldest];
+		// Flush, otherwise the fence may never reach the GPU
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+		if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED) {
+			std::cout << "ERROR::READBACK::WAIT_FAILED" << std::endl;
+		}
+		complete(slot);
+	}
+}
+
+// Copies the mapped pixels out, the buffer is free for the next request right after
+void AsyncReadback::complete(Slot& slot)
+{
+	PROFILE_ZONE("ReadbackMap");
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	ReadbackImage image;
+	image.pixels.swap(spare);
+	image.width = slot.width;
+	image.height = slot.height;
+	GLsizeiptr size = (GLsizeiptr)slot.width * slot.height * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (data != NULL) {
+		image.pixels.resize((size_t)size);
+		memcpy(&image.pixels[0], data, (size_t)size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		std::cout << "ERROR::READBACK::MAP_FAILED" << std::endl;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	ReadbackHandler handler;
+	handler.swap(slot.handler);
+	oldest = (oldest + 1) % slots.size();
+	inFlight--;
+
+	if (data != NULL && handler) {
+		handler(image);
+	}
+	spare.swap(image.pixels);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#ifndef ASYNCREADBACK_H
+#define ASYNCREADBACK_H
+
+#include <vector>
+#include <functional>
+
+#include <GL/glew.h>
+
+// Readbacks in flight at the same time. The GPU is usually 1-2 frames behind, so 3 slots never wait for it
+const int READBACK_RING_SIZE = 3;
+
+// Pixels of a finished readback: RGBA rows, tightly packed, bottom row first (as GL returns them)
+struct ReadbackImage {
+	std::vector<unsigned char> pixels;
+	GLsizei width;
+	GLsizei height;
+};
+
+// Called on the GL thread once the pixels are there. It may take the pixels by swapping them with a buffer of its own,
+// whatever is left in image.pixels is reused for the next readback
+typedef std::function<void(ReadbackImage&)> ReadbackHandler;
+
+// Copies framebuffers back to the CPU without stalling: glReadPixels only starts a copy into a pixel buffer object,
+// a fence tells when it is done and the buffer is mapped some frames later. All calls need the GL context
+class AsyncReadback
+{
+public:
+	AsyncReadback();
+	~AsyncReadback();
+
+	bool init(int ringSize = READBACK_RING_SIZE);
+	void destroy();
+
+	// Starts reading the color buffer of framebuffer (0 = back buffer). Returns false without doing anything
+	// if all slots are still in flight, the caller then skips this frame
+	bool request(GLuint framebuffer, GLsizei width, GLsizei height, ReadbackHandler handler);
+	// Hands finished readbacks to their handlers in request order, never waits for the GPU. Call once per frame
+	void poll();
+	// Waits for all readbacks in flight, e.g. before shutting down
+	void finish();
+
+	int pending() const { return inFlight; }
+
+private:
+	struct Slot {
+		GLuint buffer;
+		GLsizeiptr capacity;
+		GLsync fence;
+		GLsizei width;
+		GLsizei height;
+		ReadbackHandler handler;
+	};
+
+	void complete(Slot& slot);
+
+	std::vector<Slot> slots;
+	std::vector<unsigned char> spare;	// buffer for the next completed readback
+	int oldest;			// slot of the oldest readback in flight
+	int inFlight;
+};
+
+#endif
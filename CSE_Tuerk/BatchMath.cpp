@@ -0,0 +1,350 @@
+#include "BatchMath.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "Profiler.h"
+#include "BenchmarkHarness.h"
+
+#ifdef BATCH_MATH_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+void PointsSoA::assign(const std::vector<glm::vec3>& points)
+{
+	resize(points.size());
+	for (size_t i = 0; i < points.size(); i++) {
+		x[i] = points[i].x;
+		y[i] = points[i].y;
+		z[i] = points[i].z;
+	}
+}
+
+void PointsSoA::resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+}
+
+// Scalar kernels, the reference for the benchmark and the tail of the SIMD ones.
+// The sums are grouped like in the SIMD kernels. SSE2 gives exactly the same results, AVX and AVX2/FMA only match
+// within rounding (a few 1e-8 relative, FMA skips a rounding step), which is what the benchmark's tolerance allows for
+
+void scalarMultiplyMatrices(const float* a, const float* b, float* out, size_t count)
+{
+	float result[16];
+	for (size_t i = 0; i < count; i++) {
+		const float* right = b + i * 16;
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				result[c * 4 + r] = (a[r] * right[c * 4] + a[4 + r] * right[c * 4 + 1]) + (a[8 + r] * right[c * 4 + 2] + a[12 + r] * right[c * 4 + 3]);
+			}
+		}
+		for (int j = 0; j < 16; j++)
+			out[i * 16 + j] = result[j];
+	}
+}
+
+void scalarTransformPoints(const float* m, const float* const in[3], float* const out[3], size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float x = in[0][i], y = in[1][i], z = in[2][i];
+		for (int r = 0; r < 3; r++)
+			out[r][i] = (m[r] * x + m[4 + r] * y) + (m[8 + r] * z + m[12 + r]);
+	}
+}
+
+void scalarTransformAABBs(const float* m, const float* const center[3], const float* const extent[3], float* const outCenter[3], float* const outExtent[3], size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float x = center[0][i], y = center[1][i], z = center[2][i];
+		float ex = extent[0][i], ey = extent[1][i], ez = extent[2][i];
+		for (int r = 0; r < 3; r++) {
+			outCenter[r][i] = (m[r] * x + m[4 + r] * y) + (m[8 + r] * z + m[12 + r]);
+			outExtent[r][i] = (std::abs(m[r]) * ex + std::abs(m[4 + r]) * ey) + std::abs(m[8 + r]) * ez;
+		}
+	}
+}
+
+void scalarDistanceSquared(const float* point, const float* const in[3], float* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float dx = in[0][i] - point[0];
+		float dy = in[1][i] - point[1];
+		float dz = in[2][i] - point[2];
+		out[i] = (dx * dx + dy * dy) + dz * dz;
+	}
+}
+
+// Slab test of the moving center against the boxes grown by the moving box's extent
+void scalarSweepAABBs(const float* center, const float* extent, const float* inverseMotion, const float* const boxCenter[3],
+	const float* const boxExtent[3], float* out, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float enter = -3.4e38f, exit = 3.4e38f;
+		for (int axis = 0; axis < 3; axis++) {
+			float offset = boxCenter[axis][i] - center[axis];
+			float reach = boxExtent[axis][i] + extent[axis];
+			float t0 = (offset - reach) * inverseMotion[axis];
+			float t1 = (offset + reach) * inverseMotion[axis];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		out[i] = (enter <= exit && exit >= 0.0f && enter <= 1.0f) ? enter : BATCH_SWEEP_MISS;
+	}
+}
+
+void scalarIntegrateParticles(const float* gravity, float damping, float dt, float* const position[3], float* const velocity[3],
+	float* life, size_t count)
+{
+	float pull[3] = { gravity[0] * dt, gravity[1] * dt, gravity[2] * dt };
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			float v = velocity[axis][i] * damping + pull[axis];
+			velocity[axis][i] = v;
+			position[axis][i] += v * dt;
+		}
+		life[i] -= dt;
+	}
+}
+
+const BatchMathKernels batchMathScalar = {
+	"Scalar",
+	scalarMultiplyMatrices,
+	scalarTransformPoints,
+	scalarTransformAABBs,
+	scalarDistanceSquared,
+	scalarSweepAABBs,
+	scalarIntegrateParticles
+};
+
+#ifdef BATCH_MATH_X86
+static void cpuid(int leaf, unsigned int info[4])
+{
+#ifdef _MSC_VER
+	int registers[4];
+	__cpuidex(registers, leaf, 0);
+	for (int i = 0; i < 4; i++)
+		info[i] = (unsigned int)registers[i];
+#else
+	__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// Which register states the OS saves on a context switch
+static unsigned long long enabledStates()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return ((unsigned long long)high << 32) | low;
+#endif
+}
+#endif
+
+BatchMathLevel BatchMath::detectLevel()
+{
+#ifdef BATCH_MATH_X86
+	unsigned int info[4];
+	cpuid(0, info);
+	unsigned int maxLeaf = info[0];
+	cpuid(1, info);
+	if (!(info[3] & (1u << 26)))
+		return BATCH_MATH_SCALAR;
+
+	// AVX needs the OS to save the ymm registers too (OSXSAVE + XCR0 bits 1 and 2)
+	bool osxsave = (info[2] & (1u << 27)) != 0;
+	bool avx = (info[2] & (1u << 28)) != 0;
+	bool fma = (info[2] & (1u << 12)) != 0;
+	if (!osxsave || !avx || (enabledStates() & 6) != 6)
+		return BATCH_MATH_SSE2;
+
+	if (maxLeaf >= 7) {
+		cpuid(7, info);
+		if ((info[1] & (1u << 5)) && fma)
+			return BATCH_MATH_AVX2;
+	}
+	return BATCH_MATH_AVX;
+#else
+	return BATCH_MATH_SCALAR;
+#endif
+}
+
+BatchMathLevel BatchMath::supportedLevel()
+{
+	static const BatchMathLevel level = detectLevel();
+	return level;
+}
+
+const BatchMathKernels* BatchMath::kernels(BatchMathLevel level)
+{
+	if (level > supportedLevel())
+		return NULL;
+	switch (level) {
+#ifdef BATCH_MATH_X86
+	case BATCH_MATH_SSE2: return &batchMathSSE2;
+	case BATCH_MATH_AVX: return &batchMathAVX;
+	case BATCH_MATH_AVX2: return &batchMathAVX2;
+#endif
+	case BATCH_MATH_SCALAR: return &batchMathScalar;
+	default: return NULL;
+	}
+}
+
+const BatchMathKernels& BatchMath::kernels()
+{
+	static const BatchMathKernels* best = kernels(supportedLevel());
+	return *best;
+}
+
+void BatchMath::multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t count, const BatchMathKernels* k)
+{
+	if (count == 0)
+		return;
+	(k != NULL ? *k : kernels()).multiplyMatrices(&a[0][0], &b[0][0][0], &out[0][0][0], count);
+}
+
+void BatchMath::transformPoints(const glm::mat4& m, const PointsSoA& in, PointsSoA& out, const BatchMathKernels* k)
+{
+	out.resize(in.size());
+	if (in.size() == 0)
+		return;
+	const float* source[3] = { &in.x[0], &in.y[0], &in.z[0] };
+	float* target[3] = { &out.x[0], &out.y[0], &out.z[0] };
+	(k != NULL ? *k : kernels()).transformPoints(&m[0][0], source, target, in.size());
+}
+
+void BatchMath::transformAABBs(const glm::mat4& m, const AABBsSoA& in, AABBsSoA& out, const BatchMathKernels* k)
+{
+	out.resize(in.size());
+	if (in.size() == 0)
+		return;
+	const float* center[3] = { &in.center.x[0], &in.center.y[0], &in.center.z[0] };
+	const float* extent[3] = { &in.extent.x[0], &in.extent.y[0], &in.extent.z[0] };
+	float* outCenter[3] = { &out.center.x[0], &out.center.y[0], &out.center.z[0] };
+	float* outExtent[3] = { &out.extent.x[0], &out.extent.y[0], &out.extent.z[0] };
+	(k != NULL ? *k : kernels()).transformAABBs(&m[0][0], center, extent, outCenter, outExtent, in.size());
+}
+
+void BatchMath::distanceSquared(const glm::vec3& point, const PointsSoA& in, SimdFloatArray& out, const BatchMathKernels* k)
+{
+	out.resize(in.size());
+	if (in.size() == 0)
+		return;
+	const float* source[3] = { &in.x[0], &in.y[0], &in.z[0] };
+	(k != NULL ? *k : kernels()).distanceSquared(&point[0], source, &out[0], in.size());
+}
+
+void BatchMath::sweepAABBs(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, const AABBsSoA& boxes, SimdFloatArray& out,
+	const BatchMathKernels* k)
+{
+	out.resize(boxes.size());
+	if (boxes.size() == 0)
+		return;
+	// No motion along an axis gets a tiny one instead of an infinite inverse, the slabs then come out huge instead of NaN
+	glm::vec3 inverseMotion;
+	for (int axis = 0; axis < 3; axis++) {
+		GLfloat component = motion[axis];
+		if (std::abs(component) < 1e-20f)
+			component = component < 0.0f ? -1e-20f : 1e-20f;
+		inverseMotion[axis] = 1.0f / component;
+	}
+	const float* boxCenter[3] = { &boxes.center.x[0], &boxes.center.y[0], &boxes.center.z[0] };
+	const float* boxExtent[3] = { &boxes.extent.x[0], &boxes.extent.y[0], &boxes.extent.z[0] };
+	(k != NULL ? *k : kernels()).sweepAABBs(&center[0], &extent[0], &inverseMotion[0], boxCenter, boxExtent, &out[0], boxes.size());
+}
+
+// Times the kernels of each instruction set the CPU supports against the scalar ones and checks that they compute the same
+int runMathBenchmark(const glm::mat4& projection)
+{
+	const size_t COUNT = 100000;
+	const int REPEATS = 20;
+
+	seedBenchmark();
+	std::vector<glm::mat4> matrices(COUNT);
+	AABBsSoA boxes;
+	boxes.resize(COUNT);
+	for (size_t i = 0; i < COUNT; i++) {
+		glm::vec3 position((GLfloat)(std::rand() % 2000) - 1000.0f, (GLfloat)(std::rand() % 200) - 100.0f, (GLfloat)(std::rand() % 2000) - 1000.0f);
+		matrices[i] = glm::rotate(glm::translate(glm::mat4(), position), (GLfloat)(std::rand() % 628) / 100.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+		boxes.center.x[i] = position.x;
+		boxes.center.y[i] = position.y;
+		boxes.center.z[i] = position.z;
+		boxes.extent.x[i] = boxes.extent.y[i] = boxes.extent.z[i] = 0.5f + (GLfloat)(std::rand() % 100) / 100.0f;
+	}
+	glm::mat4 viewProjection = projection * glm::lookAt(glm::vec3(0.0f, 10.0f, 20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 eye(3.0f, 2.0f, 1.0f);
+
+	// Results of the scalar kernels are the reference for the others
+	std::vector<glm::mat4> referenceMatrices(COUNT), outMatrices(COUNT);
+	PointsSoA referencePoints, outPoints;
+	AABBsSoA referenceBoxes, outBoxes;
+	SimdFloatArray referenceDistances, outDistances;
+	double scalarMs[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+	std::cout << "Batch math, " << COUNT << " elements, supported: " << BatchMath::kernels().name << std::endl;
+	for (int level = BATCH_MATH_SCALAR; level < BATCH_MATH_LEVEL_COUNT; level++) {
+		const BatchMathKernels* k = BatchMath::kernels((BatchMathLevel)level);
+		if (k == NULL)
+			continue;
+
+		double ms[4] = { 0.0, 0.0, 0.0, 0.0 };
+		for (int repeat = 0; repeat < REPEATS; repeat++) {
+			long long start = Profiler::now();
+			BatchMath::multiply(viewProjection, &matrices[0], &outMatrices[0], COUNT, k);
+			long long multiplied = Profiler::now();
+			BatchMath::transformPoints(viewProjection, boxes.center, outPoints, k);
+			long long transformed = Profiler::now();
+			BatchMath::transformAABBs(viewProjection, boxes, outBoxes, k);
+			long long boxed = Profiler::now();
+			BatchMath::distanceSquared(eye, boxes.center, outDistances, k);
+			ms[0] += elapsedMs(start, multiplied);
+			ms[1] += elapsedMs(multiplied, transformed);
+			ms[2] += elapsedMs(transformed, boxed);
+			ms[3] += elapsedMs(boxed);
+		}
+
+		GLfloat maxError = 0.0f;
+		if (level == BATCH_MATH_SCALAR) {
+			referenceMatrices = outMatrices;
+			referencePoints = outPoints;
+			referenceBoxes = outBoxes;
+			referenceDistances = outDistances;
+			for (int i = 0; i < 4; i++)
+				scalarMs[i] = ms[i];
+		}
+		else {
+			// Relative, FMA rounds differently
+			for (size_t i = 0; i < COUNT; i++) {
+				for (int j = 0; j < 16; j++) {
+					maxError = std::max(maxError, relativeError(outMatrices[i][j / 4][j % 4], referenceMatrices[i][j / 4][j % 4]));
+				}
+				maxError = std::max(maxError, relativeError(outPoints[i], referencePoints[i]));
+				maxError = std::max(maxError, relativeError(outBoxes.center[i], referenceBoxes.center[i]));
+				maxError = std::max(maxError, relativeError(outBoxes.extent[i], referenceBoxes.extent[i]));
+				maxError = std::max(maxError, relativeError(outDistances[i], referenceDistances[i]));
+			}
+		}
+
+		std::cout << "  " << k->name << ": mat4 x mat4 " << ms[0] / REPEATS << "ms (" << scalarMs[0] / ms[0] << "x), points "
+			<< ms[1] / REPEATS << "ms (" << scalarMs[1] / ms[1] << "x), AABBs " << ms[2] / REPEATS << "ms (" << scalarMs[2] / ms[2]
+			<< "x), distance^2 " << ms[3] / REPEATS << "ms (" << scalarMs[3] / ms[3] << "x), max relative error " << maxError << std::endl;
+		if (maxError > 1e-5f) {
+			std::cout << "ERROR::BATCHMATH::" << k->name << " results differ from the scalar kernels" << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
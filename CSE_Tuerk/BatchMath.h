@@ -0,0 +1,77 @@
+#pragma once
+
+#ifndef BATCHMATH_H
+#define BATCHMATH_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "BatchMathKernels.h"
+#include "AlignedAllocator.h"
+
+// Instruction sets BatchMath can run with, in increasing order
+enum BatchMathLevel {
+	BATCH_MATH_SCALAR,
+	BATCH_MATH_SSE2,
+	BATCH_MATH_AVX,
+	BATCH_MATH_AVX2,		// AVX2 + FMA3
+	BATCH_MATH_LEVEL_COUNT
+};
+
+// Points as structure of arrays, so the SIMD kernels can load 4/8 x (y, z) values at once
+struct PointsSoA {
+	SimdFloatArray x;
+	SimdFloatArray y;
+	SimdFloatArray z;
+
+	void assign(const std::vector<glm::vec3>& points);
+	void resize(size_t count);
+	void reserve(size_t count) { x.reserve(count); y.reserve(count); z.reserve(count); }
+	size_t size() const { return x.size(); }
+	glm::vec3 operator[](size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+};
+
+// Axis aligned boxes as center and half size
+struct AABBsSoA {
+	PointsSoA center;
+	PointsSoA extent;
+
+	void resize(size_t count) { center.resize(count); extent.resize(count); }
+	void reserve(size_t count) { center.reserve(count); extent.reserve(count); }
+	size_t size() const { return center.size(); }
+};
+
+// Math over many objects at once. The best kernels for the CPU are picked once at runtime (CPUID), so one build
+// runs everywhere. All functions take an optional kernel table to force a level, e.g. for the benchmark
+class BatchMath
+{
+public:
+	// Highest level the CPU and OS support
+	static BatchMathLevel supportedLevel();
+	// NULL if the level isn't supported (or not compiled in on this architecture)
+	static const BatchMathKernels* kernels(BatchMathLevel level);
+	// Kernels of the supported level
+	static const BatchMathKernels& kernels();
+
+	// out[i] = a * b[i], out may be b
+	static void multiply(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, size_t count, const BatchMathKernels* k = NULL);
+	// Affine transform of all points, out is resized
+	static void transformPoints(const glm::mat4& m, const PointsSoA& in, PointsSoA& out, const BatchMathKernels* k = NULL);
+	// Boxes around the transformed boxes, out is resized
+	static void transformAABBs(const glm::mat4& m, const AABBsSoA& in, AABBsSoA& out, const BatchMathKernels* k = NULL);
+	// Squared distances of all points to point, out is resized
+	static void distanceSquared(const glm::vec3& point, const PointsSoA& in, SimdFloatArray& out, const BatchMathKernels* k = NULL);
+	// Fraction of motion the box (center, extent) moves before touching each box, see BatchMathKernels::sweepAABBs. out is resized
+	static void sweepAABBs(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, const AABBsSoA& boxes, SimdFloatArray& out,
+		const BatchMathKernels* k = NULL);
+
+private:
+	static BatchMathLevel detectLevel();
+};
+
+// --bench-math: times the kernels of every supported instruction set with matrices seen through projection, returns the exit code
+int runMathBenchmark(const glm::mat4& projection);
+
+#endif
@@ -0,0 +1,215 @@
+// Compiled with /arch:AVX2, only called after BatchMath checked the CPU supports AVX2 and FMA3
+#if defined(__GNUC__) && !defined(__clang__) && !defined(__AVX2__)
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "BatchMathKernels.h"
+
+#ifdef BATCH_MATH_X86
+
+#include <immintrin.h>
+
+// clang skips the GCC pragma above and needs the target on the functions themselves, every one from here on gets it
+#if defined(__clang__) && !defined(__AVX2__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#endif
+
+// Same as the AVX kernels, but with fused multiply-adds. Results can differ from the other levels in the last bit
+
+static void avx2MultiplyMatrices(const float* a, const float* b, float* out, size_t count)
+{
+	__m256 left[4];
+	for (int k = 0; k < 4; k++)
+		left[k] = _mm256_broadcast_ps((const __m128*)(a + k * 4));
+
+	for (size_t i = 0; i < count; i++) {
+		const float* source = b + i * 16;
+		float* target = out + i * 16;
+		__m256 right01 = _mm256_loadu_ps(source);
+		__m256 right23 = _mm256_loadu_ps(source + 8);
+		__m256 result01 = _mm256_mul_ps(left[0], _mm256_permute_ps(right01, 0x00));
+		__m256 result23 = _mm256_mul_ps(left[0], _mm256_permute_ps(right23, 0x00));
+		result01 = _mm256_fmadd_ps(left[1], _mm256_permute_ps(right01, 0x55), result01);
+		result23 = _mm256_fmadd_ps(left[1], _mm256_permute_ps(right23, 0x55), result23);
+		result01 = _mm256_fmadd_ps(left[2], _mm256_permute_ps(right01, 0xaa), result01);
+		result23 = _mm256_fmadd_ps(left[2], _mm256_permute_ps(right23, 0xaa), result23);
+		result01 = _mm256_fmadd_ps(left[3], _mm256_permute_ps(right01, 0xff), result01);
+		result23 = _mm256_fmadd_ps(left[3], _mm256_permute_ps(right23, 0xff), result23);
+		_mm256_storeu_ps(target, result01);
+		_mm256_storeu_ps(target + 8, result23);
+	}
+	_mm256_zeroupper();
+}
+
+static void avx2TransformPoints(const float* m, const float* const in[3], float* const out[3], size_t count)
+{
+	__m256 column[16];
+	for (int i = 0; i < 16; i++)
+		column[i] = _mm256_set1_ps(m[i]);
+
+	size_t simdCount = count & ~(size_t)7;
+	for (size_t i = 0; i < simdCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(in[0] + i);
+		__m256 y = _mm256_loadu_ps(in[1] + i);
+		__m256 z = _mm256_loadu_ps(in[2] + i);
+		for (int r = 0; r < 3; r++) {
+			__m256 sum = _mm256_fmadd_ps(column[8 + r], z, column[12 + r]);
+			sum = _mm256_fmadd_ps(column[4 + r], y, sum);
+			sum = _mm256_fmadd_ps(column[r], x, sum);
+			_mm256_storeu_ps(out[r] + i, sum);
+		}
+	}
+	_mm256_zeroupper();
+
+	const float* restIn[3];
+	float* restOut[3];
+	offsetArrays(in, simdCount, restIn);
+	offsetArrays(out, simdCount, restOut);
+	scalarTransformPoints(m, restIn, restOut, count - simdCount);
+}
+
+static void avx2TransformAABBs(const float* m, const float* const center[3], const float* const extent[3], float* const outCenter[3], float* const outExtent[3], size_t count)
+{
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 column[16], absolute[12];
+	for (int i = 0; i < 16; i++)
+		column[i] = _mm256_set1_ps(m[i]);
+	for (int i = 0; i < 12; i++)
+		absolute[i] = _mm256_and_ps(column[i], signMask);
+
+	size_t simdCount = count & ~(size_t)7;
+	for (size_t i = 0; i < simdCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(center[0] + i);
+		__m256 y = _mm256_loadu_ps(center[1] + i);
+		__m256 z = _mm256_loadu_ps(center[2] + i);
+		__m256 ex = _mm256_loadu_ps(extent[0] + i);
+		__m256 ey = _mm256_loadu_ps(extent[1] + i);
+		__m256 ez = _mm256_loadu_ps(extent[2] + i);
+		for (int r = 0; r < 3; r++) {
+			__m256 sum = _mm256_fmadd_ps(column[8 + r], z, column[12 + r]);
+			sum = _mm256_fmadd_ps(column[4 + r], y, sum);
+			sum = _mm256_fmadd_ps(column[r], x, sum);
+			_mm256_storeu_ps(outCenter[r] + i, sum);
+
+			__m256 size = _mm256_mul_ps(absolute[8 + r], ez);
+			size = _mm256_fmadd_ps(absolute[4 + r], ey, size);
+			size = _mm256_fmadd_ps(absolute[r], ex, size);
+			_mm256_storeu_ps(outExtent[r] + i, size);
+		}
+	}
+	_mm256_zeroupper();
+
+	const float* restCenter[3];
+	const float* restExtent[3];
+	float* restOutCenter[3];
+	float* restOutExtent[3];
+	offsetArrays(center, simdCount, restCenter);
+	offsetArrays(extent, simdCount, restExtent);
+	offsetArrays(outCenter, simdCount, restOutCenter);
+	offsetArrays(outExtent, simdCount, restOutExtent);
+	scalarTransformAABBs(m, restCenter, restExtent, restOutCenter, restOutExtent, count - simdCount);
+}
+
+static void avx2DistanceSquared(const float* point, const float* const in[3], float* out, size_t count)
+{
+	__m256 px = _mm256_set1_ps(point[0]);
+	__m256 py = _mm256_set1_ps(point[1]);
+	__m256 pz = _mm256_set1_ps(point[2]);
+
+	size_t simdCount = count & ~(size_t)7;
+	for (size_t i = 0; i < simdCount; i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(in[0] + i), px);
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(in[1] + i), py);
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(in[2] + i), pz);
+		__m256 sum = _mm256_mul_ps(dz, dz);
+		sum = _mm256_fmadd_ps(dy, dy, sum);
+		sum = _mm256_fmadd_ps(dx, dx, sum);
+		_mm256_storeu_ps(out + i, sum);
+	}
+	_mm256_zeroupper();
+
+	const float* rest[3];
+	offsetArrays(in, simdCount, rest);
+	scalarDistanceSquared(point, rest, out + simdCount, count - simdCount);
+}
+
+// Nothing to fuse, the same as the AVX kernel
+static void avx2SweepAABBs(const float* center, const float* extent, const float* inverseMotion, const float* const boxCenter[3],
+	const float* const boxExtent[3], float* out, size_t count)
+{
+	__m256 c[3], e[3], inverse[3];
+	for (int axis = 0; axis < 3; axis++) {
+		c[axis] = _mm256_set1_ps(center[axis]);
+		e[axis] = _mm256_set1_ps(extent[axis]);
+		inverse[axis] = _mm256_set1_ps(inverseMotion[axis]);
+	}
+	__m256 zero = _mm256_setzero_ps();
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 miss = _mm256_set1_ps(BATCH_SWEEP_MISS);
+
+	size_t simdCount = count & ~(size_t)7;
+	for (size_t i = 0; i < simdCount; i += 8) {
+		__m256 enter = _mm256_set1_ps(-3.4e38f);
+		__m256 exit = _mm256_set1_ps(3.4e38f);
+		for (int axis = 0; axis < 3; axis++) {
+			__m256 offset = _mm256_sub_ps(_mm256_loadu_ps(boxCenter[axis] + i), c[axis]);
+			__m256 reach = _mm256_add_ps(_mm256_loadu_ps(boxExtent[axis] + i), e[axis]);
+			__m256 t0 = _mm256_mul_ps(_mm256_sub_ps(offset, reach), inverse[axis]);
+			__m256 t1 = _mm256_mul_ps(_mm256_add_ps(offset, reach), inverse[axis]);
+			enter = _mm256_max_ps(enter, _mm256_min_ps(t0, t1));
+			exit = _mm256_min_ps(exit, _mm256_max_ps(t0, t1));
+		}
+		__m256 hit = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(enter, exit, _CMP_LE_OQ), _mm256_cmp_ps(exit, zero, _CMP_GE_OQ)), _mm256_cmp_ps(enter, one, _CMP_LE_OQ));
+		_mm256_storeu_ps(out + i, _mm256_blendv_ps(miss, enter, hit));
+	}
+	_mm256_zeroupper();
+
+	const float* restCenter[3];
+	const float* restExtent[3];
+	offsetArrays(boxCenter, simdCount, restCenter);
+	offsetArrays(boxExtent, simdCount, restExtent);
+	scalarSweepAABBs(center, extent, inverseMotion, restCenter, restExtent, out + simdCount, count - simdCount);
+}
+
+static void avx2IntegrateParticles(const float* gravity, float damping, float dt, float* const position[3], float* const velocity[3],
+	float* life, size_t count)
+{
+	__m256 pull[3];
+	for (int axis = 0; axis < 3; axis++)
+		pull[axis] = _mm256_set1_ps(gravity[axis] * dt);
+	__m256 drag = _mm256_set1_ps(damping);
+	__m256 step = _mm256_set1_ps(dt);
+
+	size_t simdCount = count & ~(size_t)7;
+	for (size_t i = 0; i < simdCount; i += 8) {
+		for (int axis = 0; axis < 3; axis++) {
+			__m256 v = _mm256_fmadd_ps(_mm256_loadu_ps(velocity[axis] + i), drag, pull[axis]);
+			_mm256_storeu_ps(velocity[axis] + i, v);
+			_mm256_storeu_ps(position[axis] + i, _mm256_fmadd_ps(v, step, _mm256_loadu_ps(position[axis] + i)));
+		}
+		_mm256_storeu_ps(life + i, _mm256_sub_ps(_mm256_loadu_ps(life + i), step));
+	}
+	_mm256_zeroupper();
+
+	float* restPosition[3];
+	float* restVelocity[3];
+	offsetArrays(position, simdCount, restPosition);
+	offsetArrays(velocity, simdCount, restVelocity);
+	scalarIntegrateParticles(gravity, damping, dt, restPosition, restVelocity, life + simdCount, count - simdCount);
+}
+
+const BatchMathKernels batchMathAVX2 = {
+	"AVX2",
+	avx2MultiplyMatrices,
+	avx2TransformPoints,
+	avx2TransformAABBs,
+	avx2DistanceSquared,
+	avx2SweepAABBs,
+	avx2IntegrateParticles
+};
+
+#if defined(__clang__) && !defined(__AVX2__)
+#pragma clang attribute pop
+#endif
+
+#endif
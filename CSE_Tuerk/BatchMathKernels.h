@@ -0,0 +1,69 @@
+#pragma once
+
+#ifndef BATCHMATHKERNELS_H
+#define BATCHMATHKERNELS_H
+
+#include <cstddef>
+
+// Kernels behind BatchMath, one table per instruction set. The SIMD tables live in their own translation units
+// which are compiled with /arch:AVX or /arch:AVX2 (see the vcxproj). Those files must not use glm or the STL:
+// inline functions compiled there could be picked by the linker for every other file and crash on older CPUs.
+// Matrices are column-major float[16], points and boxes structure of arrays (x[], y[], z[])
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BATCH_MATH_X86
+#endif
+
+struct BatchMathKernels {
+	const char* name;
+	// out[i] = a * b[i], out may be b
+	void (*multiplyMatrices)(const float* a, const float* b, float* out, size_t count);
+	// out = m * (in, 1), affine: the projective row is ignored
+	void (*transformPoints)(const float* m, const float* const in[3], float* const out[3], size_t count);
+	// Center / half size boxes, the result is the box around the transformed box
+	void (*transformAABBs)(const float* m, const float* const center[3], const float* const extent[3], float* const outCenter[3], float* const outExtent[3], size_t count);
+	// out[i] = |in[i] - point|^2
+	void (*distanceSquared)(const float* point, const float* const in[3], float* out, size_t count);
+	// A box (center, extent) moving by 1 / inverseMotion against center / half size boxes. out[i] is the fraction of the motion
+	// before it touches box i, negative if they overlap at the start and BATCH_SWEEP_MISS if it doesn't get there
+	void (*sweepAABBs)(const float* center, const float* extent, const float* inverseMotion, const float* const boxCenter[3],
+		const float* const boxExtent[3], float* out, size_t count);
+	// One step of the particles: velocity = velocity * damping + gravity * dt, position += velocity * dt, life -= dt
+	void (*integrateParticles)(const float* gravity, float damping, float dt, float* const position[3], float* const velocity[3],
+		float* life, size_t count);
+};
+
+// Result of sweepAABBs for boxes the motion doesn't reach, anything above 1 would do
+const float BATCH_SWEEP_MISS = 2.0f;
+
+extern const BatchMathKernels batchMathScalar;
+#ifdef BATCH_MATH_X86
+extern const BatchMathKernels batchMathSSE2;
+extern const BatchMathKernels batchMathAVX;
+extern const BatchMathKernels batchMathAVX2;
+#endif
+
+// Scalar versions, the SIMD kernels use them for the elements left over at the end
+void scalarMultiplyMatrices(const float* a, const float* b, float* out, size_t count);
+void scalarTransformPoints(const float* m, const float* const in[3], float* const out[3], size_t count);
+void scalarTransformAABBs(const float* m, const float* const center[3], const float* const extent[3], float* const outCenter[3], float* const outExtent[3], size_t count);
+void scalarDistanceSquared(const float* point, const float* const in[3], float* out, size_t count);
+void scalarSweepAABBs(const float* center, const float* extent, const float* inverseMotion, const float* const boxCenter[3],
+	const float* const boxExtent[3], float* out, size_t count);
+void scalarIntegrateParticles(const float* gravity, float damping, float dt, float* const position[3], float* const velocity[3],
+	float* life, size_t count);
+
+// Moves SoA arrays to the first element the scalar tail has to do
+static inline void offsetArrays(const float* const in[3], size_t first, const float* result[3])
+{
+	for (int i = 0; i < 3; i++)
+		result[i] = in[i] + first;
+}
+
+static inline void offsetArrays(float* const in[3], size_t first, float* result[3])
+{
+	for (int i = 0; i < 3; i++)
+		result[i] = in[i] + first;
+}
+
+#endif
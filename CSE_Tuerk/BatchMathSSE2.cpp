@@ -0,0 +1,186 @@
+#include "BatchMathKernels.h"
+
+#ifdef BATCH_MATH_X86
+
+// glm's own SSE2 matrix product, only the raw __m128 part of glm (no glm types)
+#include <detail/setup.hpp>
+#include <simd/matrix.h>
+
+// 4 elements per step, the rest goes through the scalar kernels
+
+static void sse2MultiplyMatrices(const float* a, const float* b, float* out, size_t count)
+{
+	glm_vec4 left[4];
+	for (int c = 0; c < 4; c++)
+		left[c] = _mm_loadu_ps(a + c * 4);
+
+	glm_vec4 right[4], result[4];
+	for (size_t i = 0; i < count; i++) {
+		const float* source = b + i * 16;
+		for (int c = 0; c < 4; c++)
+			right[c] = _mm_loadu_ps(source + c * 4);
+		glm_mat4_mul(left, right, result);
+		float* target = out + i * 16;
+		for (int c = 0; c < 4; c++)
+			_mm_storeu_ps(target + c * 4, result[c]);
+	}
+}
+
+static void sse2TransformPoints(const float* m, const float* const in[3], float* const out[3], size_t count)
+{
+	__m128 column[16];
+	for (int i = 0; i < 16; i++)
+		column[i] = _mm_set1_ps(m[i]);
+
+	size_t simdCount = count & ~(size_t)3;
+	for (size_t i = 0; i < simdCount; i += 4) {
+		__m128 x = _mm_loadu_ps(in[0] + i);
+		__m128 y = _mm_loadu_ps(in[1] + i);
+		__m128 z = _mm_loadu_ps(in[2] + i);
+		for (int r = 0; r < 3; r++) {
+			__m128 sum = _mm_add_ps(_mm_mul_ps(column[r], x), _mm_mul_ps(column[4 + r], y));
+			sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(column[8 + r], z), column[12 + r]));
+			_mm_storeu_ps(out[r] + i, sum);
+		}
+	}
+
+	const float* restIn[3];
+	float* restOut[3];
+	offsetArrays(in, simdCount, restIn);
+	offsetArrays(out, simdCount, restOut);
+	scalarTransformPoints(m, restIn, restOut, count - simdCount);
+}
+
+static void sse2TransformAABBs(const float* m, const float* const center[3], const float* const extent[3], float* const outCenter[3], float* const outExtent[3], size_t count)
+{
+	// Arvo: the new half size is |M| * half size, the center is transformed as a point
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 column[16], absolute[12];
+	for (int i = 0; i < 16; i++)
+		column[i] = _mm_set1_ps(m[i]);
+	for (int i = 0; i < 12; i++)
+		absolute[i] = _mm_and_ps(column[i], signMask);
+
+	size_t simdCount = count & ~(size_t)3;
+	for (size_t i = 0; i < simdCount; i += 4) {
+		__m128 x = _mm_loadu_ps(center[0] + i);
+		__m128 y = _mm_loadu_ps(center[1] + i);
+		__m128 z = _mm_loadu_ps(center[2] + i);
+		__m128 ex = _mm_loadu_ps(extent[0] + i);
+		__m128 ey = _mm_loadu_ps(extent[1] + i);
+		__m128 ez = _mm_loadu_ps(extent[2] + i);
+		for (int r = 0; r < 3; r++) {
+			__m128 sum = _mm_add_ps(_mm_mul_ps(column[r], x), _mm_mul_ps(column[4 + r], y));
+			sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(column[8 + r], z), column[12 + r]));
+			_mm_storeu_ps(outCenter[r] + i, sum);
+
+			__m128 size = _mm_add_ps(_mm_mul_ps(absolute[r], ex), _mm_mul_ps(absolute[4 + r], ey));
+			size = _mm_add_ps(size, _mm_mul_ps(absolute[8 + r], ez));
+			_mm_storeu_ps(outExtent[r] + i, size);
+		}
+	}
+
+	const float* restCenter[3];
+	const float* restExtent[3];
+	float* restOutCenter[3];
+	float* restOutExtent[3];
+	offsetArrays(center, simdCount, restCenter);
+	offsetArrays(extent, simdCount, restExtent);
+	offsetArrays(outCenter, simdCount, restOutCenter);
+	offsetArrays(outExtent, simdCount, restOutExtent);
+	scalarTransformAABBs(m, restCenter, restExtent, restOutCenter, restOutExtent, count - simdCount);
+}
+
+static void sse2DistanceSquared(const float* point, const float* const in[3], float* out, size_t count)
+{
+	__m128 px = _mm_set1_ps(point[0]);
+	__m128 py = _mm_set1_ps(point[1]);
+	__m128 pz = _mm_set1_ps(point[2]);
+
+	size_t simdCount = count & ~(size_t)3;
+	for (size_t i = 0; i < simdCount; i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(in[0] + i), px);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(in[1] + i), py);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(in[2] + i), pz);
+		__m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		_mm_storeu_ps(out + i, sum);
+	}
+
+	const float* rest[3];
+	offsetArrays(in, simdCount, rest);
+	scalarDistanceSquared(point, rest, out + simdCount, count - simdCount);
+}
+
+static void sse2SweepAABBs(const float* center, const float* extent, const float* inverseMotion, const float* const boxCenter[3],
+	const float* const boxExtent[3], float* out, size_t count)
+{
+	__m128 c[3], e[3], inverse[3];
+	for (int axis = 0; axis < 3; axis++) {
+		c[axis] = _mm_set1_ps(center[axis]);
+		e[axis] = _mm_set1_ps(extent[axis]);
+		inverse[axis] = _mm_set1_ps(inverseMotion[axis]);
+	}
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 miss = _mm_set1_ps(BATCH_SWEEP_MISS);
+
+	size_t simdCount = count & ~(size_t)3;
+	for (size_t i = 0; i < simdCount; i += 4) {
+		__m128 enter = _mm_set1_ps(-3.4e38f);
+		__m128 exit = _mm_set1_ps(3.4e38f);
+		for (int axis = 0; axis < 3; axis++) {
+			__m128 offset = _mm_sub_ps(_mm_loadu_ps(boxCenter[axis] + i), c[axis]);
+			__m128 reach = _mm_add_ps(_mm_loadu_ps(boxExtent[axis] + i), e[axis]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(offset, reach), inverse[axis]);
+			__m128 t1 = _mm_mul_ps(_mm_add_ps(offset, reach), inverse[axis]);
+			enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+			exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+		}
+		__m128 hit = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(enter, exit), _mm_cmpge_ps(exit, zero)), _mm_cmple_ps(enter, one));
+		_mm_storeu_ps(out + i, _mm_or_ps(_mm_and_ps(hit, enter), _mm_andnot_ps(hit, miss)));
+	}
+
+	const float* restCenter[3];
+	const float* restExtent[3];
+	offsetArrays(boxCenter, simdCount, restCenter);
+	offsetArrays(boxExtent, simdCount, restExtent);
+	scalarSweepAABBs(center, extent, inverseMotion, restCenter, restExtent, out + simdCount, count - simdCount);
+}
+
+static void sse2IntegrateParticles(const float* gravity, float damping, float dt, float* const position[3], float* const velocity[3],
+	float* life, size_t count)
+{
+	__m128 pull[3];
+	for (int axis = 0; axis < 3; axis++)
+		pull[axis] = _mm_set1_ps(gravity[axis] * dt);
+	__m128 drag = _mm_set1_ps(damping);
+	__m128 step = _mm_set1_ps(dt);
+
+	size_t simdCount = count & ~(size_t)3;
+	for (size_t i = 0; i < simdCount; i += 4) {
+		for (int axis = 0; axis < 3; axis++) {
+			__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(velocity[axis] + i), drag), pull[axis]);
+			_mm_storeu_ps(velocity[axis] + i, v);
+			_mm_storeu_ps(position[axis] + i, _mm_add_ps(_mm_loadu_ps(position[axis] + i), _mm_mul_ps(v, step)));
+		}
+		_mm_storeu_ps(life + i, _mm_sub_ps(_mm_loadu_ps(life + i), step));
+	}
+
+	float* restPosition[3];
+	float* restVelocity[3];
+	offsetArrays(position, simdCount, restPosition);
+	offsetArrays(velocity, simdCount, restVelocity);
+	scalarIntegrateParticles(gravity, damping, dt, restPosition, restVelocity, life + simdCount, count - simdCount);
+}
+
+const BatchMathKernels batchMathSSE2 = {
+	"SSE2",
+	sse2MultiplyMatrices,
+	sse2TransformPoints,
+	sse2TransformAABBs,
+	sse2DistanceSquared,
+	sse2SweepAABBs,
+	sse2IntegrateParticles
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+#include <gtc/constants.hpp>
+
+#include "Profiler.h"
+
+// Radius and height of the camera orbit around the cube grids
+const GLfloat PATH_RADIUS = 90.0f;
+const GLfloat PATH_HEIGHT = 5.0f;
+
+Benchmark::Benchmark(int _frames, int _warmupFrames)
+	: frames(_frames), warmupFrames(_warmupFrames)
+{
+	frameTimes.reserve(frames);
+}
+
+void Benchmark::moveCamera(int frame, Camera& camera) const
+{
+	// One orbit over the whole run, bobbing between the layers and looking slightly past the center
+	GLfloat angle = glm::two_pi<GLfloat>() * frame / totalFrames();
+	camera.Position = glm::vec3(cos(angle) * PATH_RADIUS, sin(2.0f * angle) * PATH_HEIGHT, sin(angle) * PATH_RADIUS);
+	camera.SetOrientation(glm::degrees(angle) + 180.0f - 20.0f, 15.0f * sin(3.0f * angle));
+}
+
+void Benchmark::recordFrame(int frame, double milliseconds, const std::map<const char*, double>& stages)
+{
+	if (frame < warmupFrames)
+		return;
+
+	frameTimes.push_back(milliseconds);
+	// Zones which only ran during loading/warmup are left out of the report
+	for (std::map<const char*, double>::const_iterator it = stages.begin(); it != stages.end(); ++it) {
+		if (it->second > 0.0)
+			stageSamples(it->first).push_back(it->second);
+	}
+}
+
+// The report is keyed by name. The profiler interns the zone names, so each name comes with one pointer
+// and frames look the zones up by it, only a new zone allocates
+std::vector<double>& Benchmark::stageSamples(const char* name)
+{
+	std::map<const char*, std::vector<double>*>::iterator it = stageLookup.find(name);
+	if (it != stageLookup.end())
+		return *it->second;
+
+	std::vector<double>& samples = stageTimes[name];
+	samples.reserve(frames);
+	stageLookup[name] = &samples;
+	return samples;
+}
+
+bool Benchmark::writeReport(const std::string& path, GLsizei width, GLsizei height) const
+{
+	if (frameTimes.empty()) {
+		std::cout << "ERROR::BENCHMARK::NO_FRAMES_RECORDED" << std::endl;
+		return false;
+	}
+
+	std::ofstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cout << "ERROR::BENCHMARK::REPORT_NOT_WRITTEN " << path << std::endl;
+		return false;
+	}
+
+	Summary frame = summarize(frameTimes);
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+
+	file << std::fixed << std::setprecision(4);
+	file << "{\n";
+	file << "  \"renderer\": \"" << (renderer ? (const char*)renderer : "unknown") << "\",\n";
+	file << "  \"width\": " << width << ",\n";
+	file << "  \"height\": " << height << ",\n";
+	file << "  \"frames\": " << frameTimes.size() << ",\n";
+	file << "  \"warmupFrames\": " << warmupFrames << ",\n";
+	file << "  \"fps\": " << 1000.0 / frame.mean << ",\n";
+	file << "  \"droppedProfilerEvents\": " << Profiler::droppedEvents() << ",\n";
+	file << "  \"frameTimeMs\": ";
+	writeSummary(file, frame);
+	file << ",\n  \"stagesMs\": {";
+	for (std::map<std::string, std::vector<double> >::const_iterator it = stageTimes.begin(); it != stageTimes.end(); ++it) {
+		// Zones which didn't run in every frame count as 0 in the others
+		std::vector<double> samples = it->second;
+		samples.resize(frameTimes.size(), 0.0);
+		file << (it == stageTimes.begin() ? "\n" : ",\n") << "    \"" << it->first << "\": ";
+		writeSummary(file, summarize(samples));
+	}
+	file << "\n  }\n}\n";
+
+	std::cout << "Benchmark: " << frameTimes.size() << " frames, p50 " << frame.p50 << "ms, p95 " << frame.p95
+		<< "ms, p99 " << frame.p99 << "ms, " << Profiler::droppedEvents() << " profiler events dropped -> " << path << std::endl;
+	return true;
+}
+
+Benchmark::Summary Benchmark::summarize(std::vector<double> samples)
+{
+	std::sort(samples.begin(), samples.end());
+	size_t count = samples.size();
+
+	// Nearest-rank percentiles
+	Summary summary;
+	double sum = 0.0;
+	for (size_t i = 0; i < count; i++)
+		sum += samples[i];
+	summary.mean = sum / count;
+	summary.min = samples.front();
+	summary.max = samples.back();
+	summary.p50 = samples[std::min(count - 1, (size_t)(0.50 * count))];
+	summary.p95 = samples[std::min(count - 1, (size_t)(0.95 * count))];
+	summary.p99 = samples[std::min(count - 1, (size_t)(0.99 * count))];
+	return summary;
+}
+
+void Benchmark::writeSummary(std::ostream& out, const Summary& summary)
+{
+	out << "{ \"mean\": " << summary.mean << ", \"min\": " << summary.min << ", \"p50\": " << summary.p50
+		<< ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "Camera.h"
+
+// Collects frame times of a scripted, non-interactive run and writes them as a JSON report
+// (frame time percentiles + CPU time of every profiler zone)
+class Benchmark
+{
+public:
+	Benchmark(int _frames, int _warmupFrames);
+
+	// Total number of frames to render including the warmup
+	int totalFrames() const { return frames + warmupFrames; }
+
+	// Puts the camera on a fixed path over the cube grids, the same frame index always gives the same view
+	void moveCamera(int frame, Camera& camera) const;
+
+	// Frames before the warmup is over are not recorded (shader compilation, texture uploads, driver warmup)
+	void recordFrame(int frame, double milliseconds, const std::map<const char*, double>& stageTimes);
+
+	bool writeReport(const std::string& path, GLsizei width, GLsizei height) const;
+
+private:
+	struct Summary {
+		double mean;
+		double min;
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	std::vector<double>& stageSamples(const char* name);
+	static Summary summarize(std::vector<double> samples);
+	static void writeSummary(std::ostream& out, const Summary& summary);
+
+	int frames;
+	int warmupFrames;
+	std::vector<double> frameTimes;
+	std::map<std::string, std::vector<double> > stageTimes;
+	std::map<const char*, std::vector<double>*> stageLookup;	// into stageTimes
+};
+
+#endif
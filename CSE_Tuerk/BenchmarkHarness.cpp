@@ -0,0 +1,46 @@
+#include "BenchmarkHarness.h"
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+void seedBenchmark()
+{
+	std::srand(1);
+}
+
+glm::vec3 randomPosition(const glm::vec3& min, const glm::vec3& max)
+{
+	// One after the other, the order of constructor arguments isn't defined
+	GLfloat x = min.x + (GLfloat)(std::rand() % std::max(1, (int)((max.x - min.x) * 10.0f))) / 10.0f;
+	GLfloat y = min.y + (GLfloat)(std::rand() % std::max(1, (int)((max.y - min.y) * 10.0f))) / 10.0f;
+	GLfloat z = min.z + (GLfloat)(std::rand() % std::max(1, (int)((max.z - min.z) * 10.0f))) / 10.0f;
+	return glm::vec3(x, y, z);
+}
+
+void randomPositions(std::vector<glm::vec3>& positions, const glm::vec3& min, const glm::vec3& max)
+{
+	for (size_t i = 0; i < positions.size(); i++) {
+		positions[i] = randomPosition(min, max);
+	}
+}
+
+GLfloat relativeError(GLfloat actual, GLfloat expected)
+{
+	return std::abs(actual - expected) / std::max(1.0f, std::abs(expected));
+}
+
+GLfloat relativeError(const glm::vec3& actual, const glm::vec3& expected)
+{
+	return std::max(relativeError(actual.x, expected.x), std::max(relativeError(actual.y, expected.y), relativeError(actual.z, expected.z)));
+}
+
+void QueryTimes::print()
+{
+	std::sort(times.begin(), times.end());
+	double total = 0.0;
+	for (size_t i = 0; i < times.size(); i++) {
+		total += times[i];
+	}
+	std::cout << "average " << total / times.size() << "us, p99 " << times[times.size() * 99 / 100] << "us, max " << times.back() << "us";
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef BENCHMARKHARNESS_H
+#define BENCHMARKHARNESS_H
+
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "Profiler.h"
+
+// Shared by the --bench-* runs, which live next to the module they time: seeded random input, timing single queries
+// and checking the results against a reference implementation (usually testing every object)
+
+// Restarts the random sequence, every run gets the same input
+void seedBenchmark();
+// Random point in [min, max) on a 0.1 grid
+glm::vec3 randomPosition(const glm::vec3& min, const glm::vec3& max);
+void randomPositions(std::vector<glm::vec3>& positions, const glm::vec3& min, const glm::vec3& max);
+
+inline double elapsedMs(long long start, long long end = Profiler::now())
+{
+	return (end - start) / 1000000.0;
+}
+
+// Relative to the expected value, or absolute below 1. Per component for vectors, the largest is returned
+GLfloat relativeError(GLfloat actual, GLfloat expected);
+GLfloat relativeError(const glm::vec3& actual, const glm::vec3& expected);
+
+// Microseconds each of a number of queries took
+class QueryTimes
+{
+public:
+	explicit QueryTimes(int count) : times(count) {}
+
+	// Runs query(i) for each query, timed one by one. Returns how many returned true, e.g. hits
+	template<typename Query> int run(Query query)
+	{
+		int found = 0;
+		for (size_t i = 0; i < times.size(); i++) {
+			long long start = Profiler::now();
+			found += query((int)i) ? 1 : 0;
+			times[i] = (Profiler::now() - start) / 1000.0;
+		}
+		return found;
+	}
+
+	// "average ..us, p99 ..us, max ..us", without the line end
+	void print();
+
+private:
+	std::vector<double> times;
+};
+
+// Compares the first count queries with the reference, query(i, result) and reference(i, result) return whether they
+// found something and same(result, expected) compares what they found. Prints error and the index of the first mismatch
+// and returns false then. referenceMs is the mean time of the reference
+template<typename Result, typename Query, typename Reference, typename Same>
+bool checkAgainstReference(const char* error, int count, Query query, Reference reference, Same same, double& referenceMs)
+{
+	referenceMs = 0.0;
+	for (int i = 0; i < count; i++) {
+		Result result, expected;
+		bool found = query(i, result);
+		long long start = Profiler::now();
+		bool expectedFound = reference(i, expected);
+		referenceMs += elapsedMs(start);
+		if (found != expectedFound || (found && !same(result, expected))) {
+			std::cout << error << " " << i << std::endl;
+			return false;
+		}
+	}
+	referenceMs /= count;
+	return true;
+}
+
+#endif
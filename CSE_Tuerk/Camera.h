@@ -108,6 +108,14 @@ public:
 		this->updateCameraVectors();
 	}
 
+	// Sets the Eular Angles directly (scripted camera paths, replays) and updates the vectors accordingly
+	void SetOrientation(GLfloat yaw, GLfloat pitch)
+	{
+		this->Yaw = yaw;
+		this->Pitch = pitch;
+		this->updateCameraVectors();
+	}
+
 	// Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
 	void ProcessMouseScroll(GLfloat yoffset)
 	{
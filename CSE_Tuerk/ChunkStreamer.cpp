@@ -0,0 +1,305 @@
+#include "ChunkStreamer.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+// Every chunk inside the evict radius can be resident, plus the evicted ones the loaders are still busy with
+const int CHUNK_SLOTS = (2 * CHUNK_EVICT_RADIUS + 1) * (2 * CHUNK_EVICT_RADIUS + 1) + CHUNK_LOADER_THREADS;
+
+ChunkStreamer::ChunkStreamer(GpuResources* _resources, const ChunkSource& _source, size_t _uploadBudget)
+	: resources(_resources), source(_source), uploadBudget(_uploadBudget), hasCenter(false), drawListDirty(false), stopping(false),
+	requested(0), loaded(0), evictions(0), uploadedBytes(0), throttledFrames(0)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	slots.resize(CHUNK_SLOTS);
+	for (size_t i = 0; i < slots.size(); i++) {
+		slots[i].state = CHUNK_FREE;
+		slots[i].evicted = false;
+		slots[i].priority = 0.0f;
+		slots[i].instances.reserve(MAX_CHUNK_INSTANCES);
+	}
+	drawList.reserve(slots.size());
+	uploads.reserve(slots.size());
+	center.x = center.z = 0;
+
+	buffer = resources->createBuffer(slots.size() * MAX_CHUNK_INSTANCES * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+	stop();
+	resources->release(buffer);
+}
+
+void ChunkStreamer::start()
+{
+	if (!loaders.empty())
+		return;
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	stopping = false;
+	for (int i = 0; i < CHUNK_LOADER_THREADS; i++) {
+		loaders.push_back(std::thread(&ChunkStreamer::run, this));
+	}
+}
+
+void ChunkStreamer::stop()
+{
+	if (loaders.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (size_t i = 0; i < loaders.size(); i++) {
+		loaders[i].join();
+	}
+	loaders.clear();
+}
+
+ChunkCoord ChunkStreamer::chunkAt(const glm::vec3& position)
+{
+	ChunkCoord coord;
+	coord.x = (int)std::floor(position.x / CHUNK_SIZE);
+	coord.z = (int)std::floor(position.z / CHUNK_SIZE);
+	return coord;
+}
+
+void ChunkStreamer::update(const glm::vec3& eye, const glm::vec3& front)
+{
+	PROFILE_ZONE("Streaming");
+	ChunkCoord now = chunkAt(eye);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		// The set of chunks only changes when the camera crosses into another chunk
+		if (!hasCenter || now != center) {
+			center = now;
+			hasCenter = true;
+			updateResidency(center);
+		}
+		updatePriorities(eye, front);
+	}
+	wakeUp.notify_all();
+
+	upload();
+	if (drawListDirty) {
+		buildDrawList();
+	}
+}
+
+size_t ChunkStreamer::residentCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t count = 0;
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].state == CHUNK_RESIDENT)
+			count++;
+	}
+	return count;
+}
+
+void ChunkStreamer::printStatistics() const
+{
+	size_t resident = residentCount();
+	std::lock_guard<std::mutex> lock(mutex);
+	std::cout << "ChunkStreamer: " << resident << " of " << slots.size() << " chunk slots resident, " << requested << " requested, "
+		<< loaded << " loaded, " << evictions << " evicted, " << uploadedBytes / 1024 << " KB uploaded, "
+		<< throttledFrames << " frames over the upload budget" << std::endl;
+}
+
+// Loader thread: takes the most urgent request, fills its slot from the source without holding the lock
+void ChunkStreamer::run()
+{
+	Profiler::setThreadName("Streaming");
+	MemoryTracker::setThreadTag(MEMORY_TAG_SCENE);
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		int next = -1;
+		wakeUp.wait(lock, [this, &next] { return stopping || (next = nextRequest()) >= 0; });
+		if (stopping)
+			return;
+
+		ChunkSlot& slot = slots[next];
+		slot.state = CHUNK_LOADING;
+		ChunkCoord coord = slot.coord;
+		lock.unlock();
+		{
+			PROFILE_ZONE("LoadChunk");
+			slot.instances.clear();
+			source(coord, slot.instances);
+			if (slot.instances.size() > (size_t)MAX_CHUNK_INSTANCES) {
+				std::cout << "ERROR::CHUNKSTREAMER::CHUNK_TOO_FULL " << slot.instances.size() << " instances in chunk "
+					<< coord.x << "," << coord.z << std::endl;
+				slot.instances.resize(MAX_CHUNK_INSTANCES);
+			}
+		}
+		lock.lock();
+
+		if (slot.evicted) {
+			slot.evicted = false;
+			slot.state = CHUNK_FREE;
+			evictions++;
+		}
+		else {
+			slot.state = CHUNK_LOADED;
+		}
+		loaded++;
+	}
+}
+
+int ChunkStreamer::findSlot(ChunkCoord coord) const
+{
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].state != CHUNK_FREE && slots[i].coord == coord)
+			return (int)i;
+	}
+	return -1;
+}
+
+int ChunkStreamer::nextRequest() const
+{
+	int best = -1;
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (slots[i].state == CHUNK_QUEUED && (best < 0 || slots[i].priority < slots[best].priority))
+			best = (int)i;
+	}
+	return best;
+}
+
+// Drops what is past the evict radius and requests everything missing in the load radius. Called with the lock held
+void ChunkStreamer::updateResidency(ChunkCoord around)
+{
+	for (size_t i = 0; i < slots.size(); i++) {
+		ChunkSlot& slot = slots[i];
+		if (slot.state == CHUNK_FREE || slot.evicted || ringDistance(slot.coord, around) <= CHUNK_EVICT_RADIUS)
+			continue;
+		if (slot.state == CHUNK_LOADING) {
+			slot.evicted = true;
+			continue;
+		}
+		if (slot.state == CHUNK_RESIDENT) {
+			drawListDirty = true;
+		}
+		slot.state = CHUNK_FREE;
+		evictions++;
+	}
+
+	size_t freeSlot = 0;
+	for (int z = -CHUNK_LOAD_RADIUS; z <= CHUNK_LOAD_RADIUS; z++) {
+		for (int x = -CHUNK_LOAD_RADIUS; x <= CHUNK_LOAD_RADIUS; x++) {
+			ChunkCoord coord = { around.x + x, around.z + z };
+			int existing = findSlot(coord);
+			if (existing >= 0) {
+				// Came back into range before its loader was done
+				slots[existing].evicted = false;
+				continue;
+			}
+			while (freeSlot < slots.size() && slots[freeSlot].state != CHUNK_FREE) {
+				freeSlot++;
+			}
+			if (freeSlot == slots.size()) {
+				std::cout << "ERROR::CHUNKSTREAMER::OUT_OF_SLOTS" << std::endl;
+				return;
+			}
+			slots[freeSlot].coord = coord;
+			slots[freeSlot].state = CHUNK_QUEUED;
+			requested++;
+		}
+	}
+}
+
+// Distance on the ground to the chunk center, halved straight ahead and half again as far behind the camera,
+// so what comes into view is there first. Called with the lock held
+void ChunkStreamer::updatePriorities(const glm::vec3& eye, const glm::vec3& front)
+{
+	glm::vec2 view(front.x, front.z);
+	GLfloat viewLength = glm::length(view);
+	if (viewLength > 0.0f)
+		view /= viewLength;
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		ChunkSlot& slot = slots[i];
+		if (slot.state != CHUNK_QUEUED && slot.state != CHUNK_LOADED)
+			continue;
+		glm::vec2 toChunk((slot.coord.x + 0.5f) * CHUNK_SIZE - eye.x, (slot.coord.z + 0.5f) * CHUNK_SIZE - eye.z);
+		GLfloat distance = glm::length(toChunk);
+		GLfloat facing = distance > 0.0f ? glm::dot(toChunk / distance, view) : 1.0f;
+		slot.priority = distance * (1.0f - 0.5f * facing);
+	}
+}
+
+// Moves loaded chunks into their buffer regions, most urgent first, until the budget is spent.
+// At least one chunk per frame goes up, whatever the budget
+void ChunkStreamer::upload()
+{
+	uploads.clear();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t bytes = 0;
+		for (;;) {
+			int best = -1;
+			for (size_t i = 0; i < slots.size(); i++) {
+				if (slots[i].state == CHUNK_LOADED && (best < 0 || slots[i].priority < slots[best].priority))
+					best = (int)i;
+			}
+			if (best < 0)
+				break;
+			size_t size = slots[best].instances.size() * sizeof(glm::vec3);
+			if (!uploads.empty() && bytes + size > uploadBudget) {
+				throttledFrames++;
+				break;
+			}
+			bytes += size;
+			// Only the rendering thread changes loaded chunks, so their instances can be read without the lock
+			slots[best].state = CHUNK_RESIDENT;
+			uploads.push_back(best);
+		}
+	}
+	if (uploads.empty())
+		return;
+
+	PROFILE_ZONE("UploadChunks");
+	glBindBuffer(GL_COPY_WRITE_BUFFER, resources->name(buffer));
+	for (size_t i = 0; i < uploads.size(); i++) {
+		const ChunkSlot& slot = slots[uploads[i]];
+		if (slot.instances.empty())
+			continue;
+		size_t size = slot.instances.size() * sizeof(glm::vec3);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, uploads[i] * MAX_CHUNK_INSTANCES * sizeof(glm::vec3), size, &slot.instances[0]);
+		uploadedBytes += size;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	drawListDirty = true;
+}
+
+// One batch per non-empty resident chunk, centered at the middle of its cubes
+void ChunkStreamer::buildDrawList()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	drawList.clear();
+	for (size_t i = 0; i < slots.size(); i++) {
+		const ChunkSlot& slot = slots[i];
+		if (slot.state != CHUNK_RESIDENT || slot.instances.empty())
+			continue;
+		InstanceBatch batch;
+		batch.first = (GLint)(i * MAX_CHUNK_INSTANCES);
+		batch.count = (GLsizei)slot.instances.size();
+		batch.center = glm::vec3(0.0f);
+		for (size_t j = 0; j < slot.instances.size(); j++) {
+			batch.center += slot.instances[j];
+		}
+		batch.center /= (GLfloat)batch.count;
+		drawList.push_back(batch);
+	}
+	drawListDirty = false;
+}
+
+int ChunkStreamer::ringDistance(ChunkCoord a, ChunkCoord b)
+{
+	return std::max(std::abs(a.x - b.x), std::abs(a.z - b.z));
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#ifndef CHUNKSTREAMER_H
+#define CHUNKSTREAMER_H
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "GpuResources.h"
+#include "InstanceBatch.h"
+
+// Edge of a chunk on the x/z plane in world units, a chunk covers all heights
+const GLfloat CHUNK_SIZE = 80.0f;
+// Most cubes a chunk can hold, the rest of what a source delivers is dropped
+const int MAX_CHUNK_INSTANCES = 256;
+// Chunks up to this many chunks away from the camera's (in x and z) are loaded, past the evict radius they are dropped.
+// The gap keeps chunks on the border from being loaded and evicted over and over
+const int CHUNK_LOAD_RADIUS = 4;
+const int CHUNK_EVICT_RADIUS = 5;
+const int CHUNK_LOADER_THREADS = 2;
+// Instance data uploaded per frame, about five full chunks
+const size_t DEFAULT_CHUNK_UPLOAD_BUDGET = 16 * 1024;
+
+struct ChunkCoord {
+	int x;
+	int z;
+
+	bool operator==(const ChunkCoord& other) const { return x == other.x && z == other.z; }
+	bool operator!=(const ChunkCoord& other) const { return !(*this == other); }
+};
+
+// Fills instances with the cube positions of a chunk, generated or loaded from somewhere. Called on the loader
+// threads, several chunks at once, so it must not touch shared state. instances comes in empty with room for MAX_CHUNK_INSTANCES
+typedef std::function<void(ChunkCoord chunk, std::vector<glm::vec3>& instances)> ChunkSource;
+
+// Keeps the chunks around the camera resident, so the world has no edge while memory stays the same.
+// update() asks for the missing chunks and drops the ones left behind, the loader threads fill them from the source,
+// nearest and in view first. Their instances go into a fixed region of one instance buffer, with at most the upload
+// budget per frame. All memory (chunk slots, buffer, draw list) is allocated up front.
+// update() and the draw list belong to the rendering thread, which needs the GL context
+class ChunkStreamer
+{
+public:
+	ChunkStreamer(GpuResources* _resources, const ChunkSource& _source, size_t _uploadBudget = DEFAULT_CHUNK_UPLOAD_BUDGET);
+	~ChunkStreamer();
+
+	void start();
+	// Waits for the chunks being loaded, the queued ones are dropped
+	void stop();
+
+	// Once per frame before drawing: requests and evicts chunks around eye, uploads loaded ones within the budget
+	void update(const glm::vec3& eye, const glm::vec3& front);
+
+	// Offsets of all resident chunks (attribute 2), and one batch per chunk in it
+	GpuHandle instanceBuffer() const { return buffer; }
+	const std::vector<InstanceBatch>& batches() const { return drawList; }
+
+	static ChunkCoord chunkAt(const glm::vec3& position);
+	size_t residentCount() const;
+	void printStatistics() const;
+
+private:
+	ChunkStreamer(const ChunkStreamer&);
+	ChunkStreamer& operator=(const ChunkStreamer&);
+
+	enum ChunkState {
+		CHUNK_FREE,
+		CHUNK_QUEUED,		// waits for a loader
+		CHUNK_LOADING,		// instances belong to a loader thread
+		CHUNK_LOADED,		// waits for its upload
+		CHUNK_RESIDENT		// in the instance buffer
+	};
+
+	struct ChunkSlot {
+		ChunkCoord coord;
+		ChunkState state;
+		bool evicted;		// left behind while loading, the loader frees it when done
+		GLfloat priority;	// lower is loaded and uploaded first
+		std::vector<glm::vec3> instances;
+	};
+
+	void run();
+	int findSlot(ChunkCoord coord) const;
+	int nextRequest() const;
+	void updateResidency(ChunkCoord around);
+	void updatePriorities(const glm::vec3& eye, const glm::vec3& front);
+	void upload();
+	void buildDrawList();
+	static int ringDistance(ChunkCoord a, ChunkCoord b);
+
+	GpuResources* resources;
+	ChunkSource source;
+	size_t uploadBudget;
+	GpuHandle buffer;
+	std::vector<ChunkSlot> slots;			// fixed count, slot i owns instances [i * MAX_CHUNK_INSTANCES, ...) of buffer
+	std::vector<InstanceBatch> drawList;
+	std::vector<int> uploads;				// slots going up this frame
+	ChunkCoord center;
+	bool hasCenter;
+	bool drawListDirty;
+
+	std::vector<std::thread> loaders;
+	mutable std::mutex mutex;				// guards the slot states, coords and priorities
+	std::condition_variable wakeUp;
+	bool stopping;
+
+	// Totals for printStatistics
+	unsigned long long requested;
+	unsigned long long loaded;
+	unsigned long long evictions;
+	unsigned long long uploadedBytes;
+	unsigned long long throttledFrames;		// frames which left loaded chunks for later
+};
+
+#endif
@@ -0,0 +1,346 @@
+#include "ClusteredLighting.h"
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include <gtc/matrix_transform.hpp>
+#include <gtc/type_ptr.hpp>
+
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "BenchmarkHarness.h"
+
+// Same detection as PixelConversion.h, SSE is always there where SSE2 is
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define CLUSTERED_LIGHTING_SSE
+#include <xmmintrin.h>
+#endif
+
+const int CLUSTER_TILES = CLUSTER_TILES_X * CLUSTER_TILES_Y;
+static_assert(CLUSTER_TILES_X % 4 == 0, "the SIMD tests handle 4 tiles of a row at a time");
+// Lights per cluster list reserved up front, otherwise the lists keep growing as the camera finds new crowded spots
+const size_t CLUSTER_LIST_RESERVE = 64;
+
+ClusteredLighting::ClusteredLighting(ThreadPool* _pool)
+	: ambient(0.15f), pool(_pool), clusterNear(0.0f), clusterFar(0.0f), sliceScale(0.0f), sliceBias(0.0f), maxIndices((size_t)-1)
+{
+	for (int i = 0; i < 3; i++) {
+		buffers[i] = 0;
+		textures[i] = 0;
+	}
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+	destroy();
+}
+
+bool ClusteredLighting::init()
+{
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	glGenBuffers(3, buffers);
+	glGenTextures(3, textures);
+	for (int i = 0; i < 3; i++) {
+		// The buffer needs a data store before it can back a texture
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GLint maxTexels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	maxIndices = (size_t)maxTexels;
+	return textures[0] != 0 && maxTexels > 0;
+}
+
+void ClusteredLighting::destroy()
+{
+	if (buffers[0] != 0) {
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+	}
+	for (int i = 0; i < 3; i++) {
+		buffers[i] = 0;
+		textures[i] = 0;
+	}
+}
+
+void ClusteredLighting::addRandomLights(int count, const glm::vec3& boxMin, const glm::vec3& boxMax, unsigned int seed)
+{
+	// Own LCG, std::uniform_real_distribution doesn't give the same numbers with every standard library
+	unsigned int state = seed;
+	auto random = [&state]() {
+		state = state * 1664525u + 1013904223u;
+		return (GLfloat)(state >> 8) / 16777216.0f;
+	};
+
+	for (int i = 0; i < count; i++) {
+		PointLight light;
+		light.position = boxMin + (boxMax - boxMin) * glm::vec3(random(), random(), random());
+		light.radius = 6.0f + 10.0f * random();
+		// Saturated colors: one channel full, the others random
+		glm::vec3 color(random(), random(), random());
+		color[i % 3] = 1.0f;
+		light.color = color;
+		light.intensity = 1.0f;
+		lights.push_back(light);
+	}
+}
+
+int ClusteredLighting::sliceOf(GLfloat depth) const
+{
+	if (depth <= CLUSTER_FIRST_SLICE_DEPTH)
+		return 0;
+	int slice = (int)std::floor(std::log(depth) * sliceScale + sliceBias);
+	return std::max(0, std::min(CLUSTER_SLICES - 1, slice));
+}
+
+// Bounds of every froxel in view space: the corner rays of each tile, cut at the depths of each slice
+void ClusteredLighting::buildClusters(const glm::mat4& projection, GLfloat zNear, GLfloat zFar)
+{
+	clusterProjection = projection;
+	clusterNear = zNear;
+	clusterFar = zFar;
+
+	GLfloat firstDepth = std::min(CLUSTER_FIRST_SLICE_DEPTH, zFar * 0.5f);
+	sliceScale = (CLUSTER_SLICES - 1) / std::log(zFar / firstDepth);
+	sliceBias = 1.0f - std::log(firstDepth) * sliceScale;
+	for (int s = 0; s < CLUSTER_SLICES; s++) {
+		sliceNear[s] = s == 0 ? zNear : firstDepth * std::pow(zFar / firstDepth, (GLfloat)(s - 1) / (CLUSTER_SLICES - 1));
+		sliceFar[s] = firstDepth * std::pow(zFar / firstDepth, (GLfloat)s / (CLUSTER_SLICES - 1));
+	}
+
+	glm::mat4 inverse = glm::inverse(projection);
+	for (int ty = 0; ty < CLUSTER_TILES_Y; ty++) {
+		for (int tx = 0; tx < CLUSTER_TILES_X; tx++) {
+			// Directions through the tile corners, scaled to depth 1
+			glm::vec2 corners[4];
+			for (int c = 0; c < 4; c++) {
+				GLfloat x = -1.0f + 2.0f * (tx + (c & 1)) / CLUSTER_TILES_X;
+				GLfloat y = -1.0f + 2.0f * (ty + (c >> 1)) / CLUSTER_TILES_Y;
+				glm::vec4 p = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+				glm::vec3 point = glm::vec3(p) / p.w;
+				corners[c] = glm::vec2(point) / -point.z;
+			}
+
+			int tile = ty * CLUSTER_TILES_X + tx;
+			for (int s = 0; s < CLUSTER_SLICES; s++) {
+				glm::vec2 lo(1e30f), hi(-1e30f);
+				for (int c = 0; c < 4; c++) {
+					lo = glm::min(lo, glm::min(corners[c] * sliceNear[s], corners[c] * sliceFar[s]));
+					hi = glm::max(hi, glm::max(corners[c] * sliceNear[s], corners[c] * sliceFar[s]));
+				}
+				tileMinX[s][tile] = lo.x;
+				tileMinY[s][tile] = lo.y;
+				tileMaxX[s][tile] = hi.x;
+				tileMaxY[s][tile] = hi.y;
+			}
+		}
+	}
+
+	for (int s = 0; s < CLUSTER_SLICES; s++) {
+		for (int ty = 0; ty < CLUSTER_TILES_Y; ty++) {
+			const GLfloat* minY = &tileMinY[s][ty * CLUSTER_TILES_X];
+			const GLfloat* maxY = &tileMaxY[s][ty * CLUSTER_TILES_X];
+			rowMinY[s][ty] = *std::min_element(minY, minY + CLUSTER_TILES_X);
+			rowMaxY[s][ty] = *std::max_element(maxY, maxY + CLUSTER_TILES_X);
+		}
+	}
+}
+
+void ClusteredLighting::bin(const glm::mat4& view, const glm::mat4& projection, GLfloat zNear, GLfloat zFar)
+{
+	PROFILE_ZONE("LightBinning");
+	if (projection != clusterProjection || zNear != clusterNear || zFar != clusterFar) {
+		buildClusters(projection, zNear, zFar);
+	}
+
+	// View space positions and the slices each sphere reaches
+	size_t count = lights.size();
+	viewLights.resize(count);
+	firstSlice.resize(count);
+	lastSlice.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		PointLight& light = viewLights[i];
+		light = lights[i];
+		light.position = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		GLfloat depth = -light.position.z;
+		if (depth + light.radius < zNear || depth - light.radius > zFar) {
+			firstSlice[i] = 1;
+			lastSlice[i] = 0;
+		}
+		else {
+			firstSlice[i] = sliceOf(std::max(depth - light.radius, zNear));
+			lastSlice[i] = sliceOf(std::min(depth + light.radius, zFar));
+		}
+	}
+
+	// Every slice owns its clusters, so the slices can be binned in parallel without locking
+	if (clusterLights.size() != CLUSTER_COUNT) {
+		clusterLights.resize(CLUSTER_COUNT);
+		for (int c = 0; c < CLUSTER_COUNT; c++) {
+			clusterLights[c].reserve(CLUSTER_LIST_RESERVE);
+		}
+	}
+	if (pool != NULL) {
+		pool->parallelFor(CLUSTER_SLICES, [this](int slice) { binSlice(slice); });
+	}
+	else {
+		for (int s = 0; s < CLUSTER_SLICES; s++) {
+			binSlice(s);
+		}
+	}
+
+	// One index list for all clusters, cut off if the texture buffer can't hold it
+	clusterRanges.resize(CLUSTER_COUNT * 2);
+	lightIndices.clear();
+	for (int c = 0; c < CLUSTER_COUNT; c++) {
+		size_t offset = lightIndices.size();
+		size_t n = std::min(clusterLights[c].size(), maxIndices - offset);
+		lightIndices.insert(lightIndices.end(), clusterLights[c].begin(), clusterLights[c].begin() + n);
+		clusterRanges[c * 2] = (GLuint)offset;
+		clusterRanges[c * 2 + 1] = (GLuint)n;
+	}
+}
+
+// Sphere vs. box: the squared distance from the center to the box has to be below radius^2.
+// The depth part is the same for the whole slice, rows out of reach are skipped, the rest is tested 4 tiles at once
+void ClusteredLighting::binSlice(int slice)
+{
+	std::vector<GLuint>* lists = &clusterLights[slice * CLUSTER_TILES];
+	for (int t = 0; t < CLUSTER_TILES; t++) {
+		lists[t].clear();
+	}
+
+	for (size_t i = 0; i < viewLights.size(); i++) {
+		if (slice < firstSlice[i] || slice > lastSlice[i])
+			continue;
+		const PointLight& light = viewLights[i];
+		GLfloat depth = -light.position.z;
+		GLfloat dz = std::max(std::max(sliceNear[slice] - depth, depth - sliceFar[slice]), 0.0f);
+		GLfloat remaining = light.radius * light.radius - dz * dz;
+		if (remaining < 0.0f)
+			continue;
+		GLfloat reach = std::sqrt(remaining);
+
+		for (int ty = 0; ty < CLUSTER_TILES_Y; ty++) {
+			if (rowMinY[slice][ty] > light.position.y + reach || rowMaxY[slice][ty] < light.position.y - reach)
+				continue;
+			int rowStart = ty * CLUSTER_TILES_X;
+#ifdef CLUSTERED_LIGHTING_SSE
+			const __m128 x = _mm_set1_ps(light.position.x);
+			const __m128 y = _mm_set1_ps(light.position.y);
+			const __m128 limit = _mm_set1_ps(remaining);
+			const __m128 zero = _mm_setzero_ps();
+			for (int t = rowStart; t < rowStart + CLUSTER_TILES_X; t += 4) {
+				__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&tileMinX[slice][t]), x), _mm_sub_ps(x, _mm_loadu_ps(&tileMaxX[slice][t]))), zero);
+				__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&tileMinY[slice][t]), y), _mm_sub_ps(y, _mm_loadu_ps(&tileMaxY[slice][t]))), zero);
+				int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), limit));
+				for (; mask != 0; mask &= mask - 1) {
+					int bit = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+					lists[t + bit].push_back((GLuint)i);
+				}
+			}
+#else
+			for (int t = rowStart; t < rowStart + CLUSTER_TILES_X; t++) {
+				GLfloat dx = std::max(std::max(tileMinX[slice][t] - light.position.x, light.position.x - tileMaxX[slice][t]), 0.0f);
+				GLfloat dy = std::max(std::max(tileMinY[slice][t] - light.position.y, light.position.y - tileMaxY[slice][t]), 0.0f);
+				if (dx * dx + dy * dy <= remaining) {
+					lists[t].push_back((GLuint)i);
+				}
+			}
+#endif
+		}
+	}
+}
+
+GLuint ClusteredLighting::maxLightsPerCluster() const
+{
+	GLuint result = 0;
+	for (size_t c = 1; c < clusterRanges.size(); c += 2) {
+		result = std::max(result, clusterRanges[c]);
+	}
+	return result;
+}
+
+// Orphans the buffers, so the driver doesn't wait for the last frame still reading them
+static void uploadBuffer(GLuint buffer, const void* data, size_t size)
+{
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+	if (size > 0) {
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	}
+}
+
+void ClusteredLighting::upload()
+{
+	PROFILE_ZONE("LightUpload");
+	uploadBuffer(buffers[0], viewLights.empty() ? NULL : &viewLights[0], viewLights.size() * sizeof(PointLight));
+	uploadBuffer(buffers[1], &clusterRanges[0], clusterRanges.size() * sizeof(GLuint));
+	uploadBuffer(buffers[2], lightIndices.empty() ? NULL : &lightIndices[0], lightIndices.size() * sizeof(GLuint));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLighting::bind(Shader* shader, GLsizei viewportWidth, GLsizei viewportHeight, GLuint firstUnit)
+{
+	const char* samplers[3] = { "lightData", "clusterGrid", "lightIndices" };
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		glUniform1i(glGetUniformLocation(shader->Program, samplers[i]), firstUnit + i);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	glUniform3i(glGetUniformLocation(shader->Program, "clusterCount"), CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES);
+	glUniform2f(glGetUniformLocation(shader->Program, "clusterTileSize"), (GLfloat)viewportWidth / CLUSTER_TILES_X, (GLfloat)viewportHeight / CLUSTER_TILES_Y);
+	glUniform2f(glGetUniformLocation(shader->Program, "clusterSliceParams"), sliceScale, sliceBias);
+	glUniform3fv(glGetUniformLocation(shader->Program, "ambientLight"), 1, glm::value_ptr(ambient));
+}
+
+void ClusteredLighting::unbind(GLuint firstUnit)
+{
+	for (int i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+// Bins the lights along the benchmark's camera path, on one thread and then on the pool. CPU only
+int runClusterBenchmark(int lightCount, const glm::vec3& lightsMin, const glm::vec3& lightsMax, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane)
+{
+	const int FRAMES = 200;
+	ThreadPool pool;
+	Benchmark path(FRAMES, 0);
+	Camera view;
+	glm::mat4 projection = glm::perspective(view.Zoom, aspect, nearPlane, farPlane);
+
+	for (int threaded = 0; threaded < 2; threaded++) {
+		ClusteredLighting lighting(threaded ? &pool : NULL);
+		lighting.addRandomLights(lightCount, lightsMin, lightsMax, 1);
+
+		double totalMs = 0.0, worstMs = 0.0;
+		size_t indices = 0;
+		GLuint maxPerCluster = 0;
+		for (int frame = 0; frame < FRAMES; frame++) {
+			path.moveCamera(frame, view);
+			long long start = Profiler::now();
+			lighting.bin(view.GetViewMatrix(), projection, nearPlane, farPlane);
+			double ms = elapsedMs(start);
+			totalMs += ms;
+			worstMs = std::max(worstMs, ms);
+			indices += lighting.indexCount();
+			maxPerCluster = std::max(maxPerCluster, lighting.maxLightsPerCluster());
+		}
+
+		std::cout << "Cluster binning, " << lightCount << " lights, " << CLUSTER_TILES_X << "x" << CLUSTER_TILES_Y << "x" << CLUSTER_SLICES
+			<< " clusters, " << (threaded ? pool.threadCount() : 1) << " thread(s): mean " << totalMs / FRAMES << "ms, max " << worstMs
+			<< "ms, " << indices / FRAMES << " light indices per frame, up to " << maxPerCluster << " lights per cluster" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef CLUSTEREDLIGHTING_H
+#define CLUSTEREDLIGHTING_H
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "shader.h"
+#include "ThreadPool.h"
+
+// Froxel grid: screen tiles x depth slices. Slices are spaced logarithmically, so near and far clusters have similar proportions
+const int CLUSTER_TILES_X = 16;
+const int CLUSTER_TILES_Y = 9;
+const int CLUSTER_SLICES = 24;
+const int CLUSTER_COUNT = CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES;
+const GLfloat CLUSTER_FIRST_SLICE_DEPTH = 1.0f;	// slice 0 covers everything from the near plane up to here
+
+// Same layout as the light data texels in object.frag
+struct PointLight {
+	glm::vec3 position;
+	GLfloat radius;		// no light at all beyond it
+	glm::vec3 color;
+	GLfloat intensity;
+};
+
+// Clustered forward lighting. Every frame the lights are sorted into the clusters their sphere touches (bin()),
+// the fragment shader (SHADER_CLUSTERED_LIGHTING) then only loops over the lights of its own cluster.
+// Light data, per cluster ranges and light indices are passed as texture buffers (GL 3.3 has no SSBOs)
+class ClusteredLighting
+{
+public:
+	// Without a pool the binning runs on the calling thread
+	explicit ClusteredLighting(ThreadPool* _pool = NULL);
+	~ClusteredLighting();
+
+	bool init();
+	void destroy();
+
+	// Lights in world space
+	std::vector<PointLight> lights;
+	// Adds lights with random colors and radii inside a box, the same seed always gives the same lights
+	void addRandomLights(int count, const glm::vec3& boxMin, const glm::vec3& boxMax, unsigned int seed);
+
+	// CPU only: moves the lights into view space and fills the light list of every cluster
+	void bin(const glm::mat4& view, const glm::mat4& projection, GLfloat zNear, GLfloat zFar);
+	// Copies the result of the last bin() into the texture buffers
+	void upload();
+	// Binds the texture buffers to the units firstUnit...firstUnit + 2 and sets the uniforms of the program in use
+	void bind(Shader* shader, GLsizei viewportWidth, GLsizei viewportHeight, GLuint firstUnit);
+	void unbind(GLuint firstUnit);
+
+	// Statistics of the last bin()
+	size_t indexCount() const { return lightIndices.size(); }
+	GLuint maxLightsPerCluster() const;
+
+	glm::vec3 ambient;
+
+private:
+	void buildClusters(const glm::mat4& projection, GLfloat zNear, GLfloat zFar);
+	void binSlice(int slice);
+	int sliceOf(GLfloat depth) const;
+
+	ThreadPool* pool;
+
+	// Cluster bounds in view space (looking down -z), rebuilt when the projection changes.
+	// x/y bounds per tile as SoA for the SIMD tests, depth bounds (positive) per slice
+	glm::mat4 clusterProjection;
+	GLfloat clusterNear;
+	GLfloat clusterFar;
+	GLfloat tileMinX[CLUSTER_SLICES][CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	GLfloat tileMaxX[CLUSTER_SLICES][CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	GLfloat tileMinY[CLUSTER_SLICES][CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	GLfloat tileMaxY[CLUSTER_SLICES][CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	GLfloat rowMinY[CLUSTER_SLICES][CLUSTER_TILES_Y];	// y bounds of a whole tile row, to skip rows quickly
+	GLfloat rowMaxY[CLUSTER_SLICES][CLUSTER_TILES_Y];
+	GLfloat sliceNear[CLUSTER_SLICES];
+	GLfloat sliceFar[CLUSTER_SLICES];
+	GLfloat sliceScale;		// slice = log(depth) * sliceScale + sliceBias
+	GLfloat sliceBias;
+
+	// Per frame
+	std::vector<PointLight> viewLights;				// as uploaded, position in view space
+	std::vector<int> firstSlice;					// slice range each light touches, empty if firstSlice > lastSlice
+	std::vector<int> lastSlice;
+	std::vector<std::vector<GLuint> > clusterLights;	// light indices per cluster, filled by the slices in parallel
+	std::vector<GLuint> clusterRanges;				// offset, count per cluster
+	std::vector<GLuint> lightIndices;
+	size_t maxIndices;								// texture buffer size limit
+
+	GLuint buffers[3];		// light data, cluster ranges, light indices
+	GLuint textures[3];
+};
+
+// --bench-cluster: times binning lightCount random lights within [lightsMin, lightsMax] on the CPU, returns the exit code
+int runClusterBenchmark(int lightCount, const glm::vec3& lightsMin, const glm::vec3& lightsMax, GLfloat aspect, GLfloat nearPlane, GLfloat farPlane);
+
+#endif
@@ -0,0 +1,421 @@
+#include "CollisionWorld.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include <utility>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "BenchmarkHarness.h"
+
+bool CollisionWorld::CellRange::operator==(const CellRange& other) const
+{
+	for (int axis = 0; axis < 3; axis++) {
+		if (min[axis] != other.min[axis] || max[axis] != other.max[axis])
+			return false;
+	}
+	return true;
+}
+
+long long CollisionWorld::CellRange::cells() const
+{
+	return (long long)(max[0] - min[0] + 1) * (max[1] - min[1] + 1) * (max[2] - min[2] + 1);
+}
+
+CollisionWorld::CollisionWorld(GLfloat _cellSize)
+	: cellSize(_cellSize), query(0)
+{}
+
+int CollisionWorld::addStatic(const std::vector<glm::vec3>& positions, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	int first = (int)boxes.size();
+	boxes.resize(first + positions.size());
+	glm::vec3 offset = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+	for (size_t i = 0; i < positions.size(); i++) {
+		glm::vec3 center = positions[i] + offset;
+		boxes.center.x[first + i] = center.x;
+		boxes.center.y[first + i] = center.y;
+		boxes.center.z[first + i] = center.z;
+		boxes.extent.x[first + i] = extent.x;
+		boxes.extent.y[first + i] = extent.y;
+		boxes.extent.z[first + i] = extent.z;
+	}
+	dynamicIndex.resize(boxes.size(), -1);
+	stamps.resize(boxes.size(), 0);
+	return first;
+}
+
+// Every static collider is listed in each cell it touches: (cell, collider) pairs sorted by cell become one run of staticIds per cell
+void CollisionWorld::build()
+{
+	PROFILE_ZONE("BuildCollisions");
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	oversized.clear();
+	staticIds.clear();
+	staticCells.clear();
+
+	std::vector<std::pair<unsigned long long, int> > entries;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		if (dynamicIndex[i] >= 0)
+			continue;
+		glm::vec3 center = boxes.center[i];
+		glm::vec3 extent = boxes.extent[i];
+		CellRange range = cellsOf(center - extent, center + extent);
+		if (range.cells() > MAX_COLLIDER_CELLS) {
+			oversized.push_back((int)i);
+			continue;
+		}
+		for (int z = range.min[2]; z <= range.max[2]; z++) {
+			for (int y = range.min[1]; y <= range.max[1]; y++) {
+				for (int x = range.min[0]; x <= range.max[0]; x++) {
+					entries.push_back(std::make_pair(cellKey(x, y, z), (int)i));
+				}
+			}
+		}
+	}
+	std::sort(entries.begin(), entries.end());
+
+	staticIds.resize(entries.size());
+	staticCells.reserve(entries.size() / 2);
+	for (size_t i = 0; i < entries.size(); i++) {
+		staticIds[i] = entries[i].second;
+		if (i == 0 || entries[i].first != entries[i - 1].first) {
+			StaticCell cell = { (int)i, 0 };
+			staticCells[entries[i].first] = cell;
+		}
+		staticCells[entries[i].first].count++;
+	}
+
+	// Queries run inside frames, where nothing should allocate
+	candidates.reserve(COLLISION_QUERY_RESERVE);
+	candidateBoxes.reserve(COLLISION_QUERY_RESERVE);
+	times.reserve(COLLISION_QUERY_RESERVE);
+}
+
+int CollisionWorld::addDynamic(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& reach)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	int collider = (int)boxes.size();
+	boxes.resize(collider + 1);
+	boxes.center.x[collider] = center.x;
+	boxes.center.y[collider] = center.y;
+	boxes.center.z[collider] = center.z;
+	boxes.extent.x[collider] = extent.x;
+	boxes.extent.y[collider] = extent.y;
+	boxes.extent.z[collider] = extent.z;
+	dynamicIndex.push_back((int)dynamics.size());
+	stamps.push_back(0);
+
+	Dynamic dynamic;
+	dynamic.collider = collider;
+	dynamic.cells = cellsOf(center - extent, center + extent);
+	dynamics.push_back(dynamic);
+	CellRange reachable = cellsOf(center - extent - reach, center + extent + reach);
+	for (int z = reachable.min[2]; z <= reachable.max[2]; z++) {
+		for (int y = reachable.min[1]; y <= reachable.max[1]; y++) {
+			for (int x = reachable.min[0]; x <= reachable.max[0]; x++) {
+				std::vector<int>& ids = dynamicCells[cellKey(x, y, z)];
+				ids.reserve(ids.capacity() + 1);
+			}
+		}
+	}
+	insertDynamic(collider, dynamic.cells);
+	return collider;
+}
+
+// Most moves stay inside the same cells, then only the box changes
+void CollisionWorld::moveDynamic(int collider, const glm::vec3& center)
+{
+	if (collider < 0 || collider >= (int)boxes.size() || dynamicIndex[collider] < 0) {
+		std::cout << "ERROR::COLLISIONWORLD::NOT_DYNAMIC collider " << collider << std::endl;
+		return;
+	}
+	boxes.center.x[collider] = center.x;
+	boxes.center.y[collider] = center.y;
+	boxes.center.z[collider] = center.z;
+	glm::vec3 extent = boxes.extent[collider];
+
+	Dynamic& dynamic = dynamics[dynamicIndex[collider]];
+	CellRange cells = cellsOf(center - extent, center + extent);
+	if (cells == dynamic.cells)
+		return;
+	removeDynamic(collider, dynamic.cells);
+	insertDynamic(collider, cells);
+	dynamic.cells = cells;
+}
+
+void CollisionWorld::clear()
+{
+	boxes.resize(0);
+	dynamicIndex.clear();
+	oversized.clear();
+	staticIds.clear();
+	staticCells.clear();
+	dynamicCells.clear();
+	dynamics.clear();
+	stamps.clear();
+	query = 0;
+}
+
+void CollisionWorld::overlapping(const glm::vec3& min, const glm::vec3& max, std::vector<int>& result)
+{
+	result.clear();
+	gatherCandidates(min, max);
+	// Not moving, the sweep kernel then only tells overlapping (negative time) from not
+	BatchMath::sweepAABBs((min + max) * 0.5f, (max - min) * 0.5f, glm::vec3(0.0f), candidateBoxes, times);
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (times[i] < 0.0f)
+			result.push_back(candidates[i]);
+	}
+}
+
+bool CollisionWorld::sweep(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, SweepHit& hit)
+{
+	glm::vec3 end = center + motion;
+	gatherCandidates(glm::min(center, end) - extent, glm::max(center, end) + extent);
+	return nearestHit(center, extent, motion, candidateBoxes, &candidates, hit);
+}
+
+bool CollisionWorld::sweepBruteForce(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, SweepHit& hit)
+{
+	return nearestHit(center, extent, motion, boxes, NULL, hit);
+}
+
+glm::vec3 CollisionWorld::move(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion)
+{
+	PROFILE_ZONE("Collide");
+	glm::vec3 position = center;
+	glm::vec3 remaining = motion;
+	for (int step = 0; step < COLLISION_SLIDE_STEPS; step++) {
+		if (remaining == glm::vec3(0.0f))
+			break;
+		SweepHit hit;
+		if (!sweep(position, extent, remaining, hit))
+			return position + remaining;
+		// Up to the surface and a skin away from it, then whatever is left without the part into the surface
+		position += remaining * hit.time + hit.normal * COLLISION_SKIN;
+		remaining *= 1.0f - hit.time;
+		remaining -= hit.normal * glm::dot(remaining, hit.normal);
+	}
+	return position;
+}
+
+// 21 bits per axis, enough for cells a few million units out
+unsigned long long CollisionWorld::cellKey(int x, int y, int z)
+{
+	return ((unsigned long long)(x & 0x1fffff) << 42) | ((unsigned long long)(y & 0x1fffff) << 21) | (unsigned long long)(z & 0x1fffff);
+}
+
+CollisionWorld::CellRange CollisionWorld::cellsOf(const glm::vec3& min, const glm::vec3& max) const
+{
+	CellRange range;
+	for (int axis = 0; axis < 3; axis++) {
+		range.min[axis] = (int)std::floor(min[axis] / cellSize);
+		range.max[axis] = (int)std::floor(max[axis] / cellSize);
+	}
+	return range;
+}
+
+void CollisionWorld::insertDynamic(int collider, const CellRange& cells)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	for (int z = cells.min[2]; z <= cells.max[2]; z++) {
+		for (int y = cells.min[1]; y <= cells.max[1]; y++) {
+			for (int x = cells.min[0]; x <= cells.max[0]; x++) {
+				dynamicCells[cellKey(x, y, z)].push_back(collider);
+			}
+		}
+	}
+}
+
+void CollisionWorld::removeDynamic(int collider, const CellRange& cells)
+{
+	for (int z = cells.min[2]; z <= cells.max[2]; z++) {
+		for (int y = cells.min[1]; y <= cells.max[1]; y++) {
+			for (int x = cells.min[0]; x <= cells.max[0]; x++) {
+				std::vector<int>& ids = dynamicCells[cellKey(x, y, z)];
+				std::vector<int>::iterator found = std::find(ids.begin(), ids.end(), collider);
+				if (found != ids.end()) {
+					*found = ids.back();
+					ids.pop_back();
+				}
+			}
+		}
+	}
+}
+
+void CollisionWorld::gatherCandidates(const glm::vec3& min, const glm::vec3& max)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	candidates.clear();
+	if (++query == 0) {
+		std::fill(stamps.begin(), stamps.end(), 0);
+		query = 1;
+	}
+
+	CellRange range = cellsOf(min, max);
+	if (range.cells() > MAX_QUERY_CELLS) {
+		for (size_t i = 0; i < boxes.size(); i++) {
+			candidates.push_back((int)i);
+		}
+	}
+	else {
+		for (size_t i = 0; i < oversized.size(); i++) {
+			addCandidate(oversized[i]);
+		}
+		for (int z = range.min[2]; z <= range.max[2]; z++) {
+			for (int y = range.min[1]; y <= range.max[1]; y++) {
+				for (int x = range.min[0]; x <= range.max[0]; x++) {
+					unsigned long long key = cellKey(x, y, z);
+					std::unordered_map<unsigned long long, StaticCell>::const_iterator found = staticCells.find(key);
+					if (found != staticCells.end()) {
+						for (int i = found->second.first; i < found->second.first + found->second.count; i++) {
+							addCandidate(staticIds[i]);
+						}
+					}
+					if (dynamicCells.empty())
+						continue;
+					std::unordered_map<unsigned long long, std::vector<int> >::const_iterator moving = dynamicCells.find(key);
+					if (moving != dynamicCells.end()) {
+						for (size_t i = 0; i < moving->second.size(); i++) {
+							addCandidate(moving->second[i]);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// Into one batch for the kernel
+	candidateBoxes.resize(candidates.size());
+	for (size_t i = 0; i < candidates.size(); i++) {
+		int collider = candidates[i];
+		candidateBoxes.center.x[i] = boxes.center.x[collider];
+		candidateBoxes.center.y[i] = boxes.center.y[collider];
+		candidateBoxes.center.z[i] = boxes.center.z[collider];
+		candidateBoxes.extent.x[i] = boxes.extent.x[collider];
+		candidateBoxes.extent.y[i] = boxes.extent.y[collider];
+		candidateBoxes.extent.z[i] = boxes.extent.z[collider];
+	}
+}
+
+// Colliders in several cells are found more than once
+void CollisionWorld::addCandidate(int collider)
+{
+	if (stamps[collider] == query)
+		return;
+	stamps[collider] = query;
+	candidates.push_back(collider);
+}
+
+// Earliest entry of all tested boxes, ids maps them to colliders (NULL: they are the colliders)
+bool CollisionWorld::nearestHit(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, const AABBsSoA& tested,
+	const std::vector<int>* ids, SweepHit& hit)
+{
+	BatchMath::sweepAABBs(center, extent, motion, tested, times);
+	int found = -1;
+	GLfloat nearest = BATCH_SWEEP_MISS;
+	for (size_t i = 0; i < tested.size(); i++) {
+		if (times[i] >= 0.0f && times[i] < nearest) {
+			nearest = times[i];
+			found = (int)i;
+		}
+	}
+	if (found < 0)
+		return false;
+
+	// The face hit is on the axis which was entered last
+	glm::vec3 offset = tested.center[found] - center;
+	glm::vec3 reach = tested.extent[found] + extent;
+	int axis = 0;
+	GLfloat latest = -FLT_MAX;
+	for (int i = 0; i < 3; i++) {
+		if (motion[i] == 0.0f)
+			continue;
+		GLfloat entry = (motion[i] > 0.0f ? offset[i] - reach[i] : offset[i] + reach[i]) / motion[i];
+		if (entry > latest) {
+			latest = entry;
+			axis = i;
+		}
+	}
+
+	hit.collider = ids != NULL ? (*ids)[found] : found;
+	hit.time = nearest;
+	hit.normal = glm::vec3(0.0f);
+	hit.normal[axis] = motion[axis] > 0.0f ? -1.0f : 1.0f;
+	return true;
+}
+
+// 200000 unit cubes spread at random and 1000 boxes wandering between them. A box of the given extent is swept through
+// the field in random directions, the first sweeps are checked against testing every collider
+int runCollisionBenchmark(const glm::vec3& extent)
+{
+	const int COUNT = 200000;
+	const int MOVING = 1000;
+	const int MOVING_STEPS = 100;
+	const int SWEEPS = 10000;
+	const int CHECKED_SWEEPS = 200;
+	const glm::vec3 FIELD_MIN(-300.0f, -20.0f, -300.0f);
+	const glm::vec3 FIELD_MAX(300.0f, 20.0f, 300.0f);
+
+	seedBenchmark();
+	std::vector<glm::vec3> positions(COUNT);
+	randomPositions(positions, FIELD_MIN, FIELD_MAX);
+	CollisionWorld world;
+	world.addStatic(positions, glm::vec3(-0.5f), glm::vec3(0.5f));
+	long long start = Profiler::now();
+	world.build();
+	double buildMs = elapsedMs(start);
+
+	// Up to a unit per step, so some of them cross into other cells every step
+	std::vector<int> moving(MOVING);
+	std::vector<glm::vec3> movingPositions(MOVING);
+	for (int i = 0; i < MOVING; i++) {
+		movingPositions[i] = positions[std::rand() % COUNT] + glm::vec3(0.0f, 1.0f, 0.0f);
+		moving[i] = world.addDynamic(movingPositions[i], glm::vec3(0.5f));
+	}
+	start = Profiler::now();
+	for (int step = 0; step < MOVING_STEPS; step++) {
+		for (int i = 0; i < MOVING; i++) {
+			movingPositions[i] += glm::vec3((GLfloat)(std::rand() % 200 - 100) / 100.0f, 0.0f, (GLfloat)(std::rand() % 200 - 100) / 100.0f);
+			world.moveDynamic(moving[i], movingPositions[i]);
+		}
+	}
+	double moveUs = elapsedMs(start) * 1000.0 / MOVING_STEPS;
+
+	std::vector<glm::vec3> origins(SWEEPS), motions(SWEEPS);
+	for (int i = 0; i < SWEEPS; i++) {
+		origins[i] = randomPosition(FIELD_MIN, FIELD_MAX);
+		glm::vec3 direction((GLfloat)(std::rand() % 200) - 100.0f, (GLfloat)(std::rand() % 200) - 100.0f, (GLfloat)(std::rand() % 200) - 100.0f);
+		motions[i] = glm::normalize(direction + glm::vec3(0.01f)) * ((GLfloat)(std::rand() % 200) / 100.0f);
+	}
+
+	QueryTimes times(SWEEPS);
+	int hits = times.run([&](int i) { SweepHit hit; return world.sweep(origins[i], extent, motions[i], hit); });
+
+	start = Profiler::now();
+	for (int i = 0; i < SWEEPS; i++) {
+		world.move(origins[i], extent, motions[i]);
+	}
+	double slideUs = elapsedMs(start) * 1000.0 / SWEEPS;
+
+	double bruteMs;
+	if (!checkAgainstReference<SweepHit>("ERROR::COLLISION::RESULT_DIFFERS sweep", CHECKED_SWEEPS,
+		[&](int i, SweepHit& hit) { return world.sweep(origins[i], extent, motions[i], hit); },
+		[&](int i, SweepHit& hit) { return world.sweepBruteForce(origins[i], extent, motions[i], hit); },
+		[](const SweepHit& hit, const SweepHit& expected) { return hit.time == expected.time && hit.normal == expected.normal; }, bruteMs)) {
+		return 1;
+	}
+
+	std::cout << "Collision, " << COUNT << " static colliders in " << world.staticCellCount() << " cells, built in " << buildMs << "ms, "
+		<< MOVING << " moving: " << moveUs << "us per step (" << BatchMath::kernels().name << ")" << std::endl;
+	std::cout << "  " << SWEEPS << " sweeps, " << hits << " hits: ";
+	times.print();
+	std::cout << ", with sliding " << slideUs << "us (testing every collider: " << bruteMs << "ms)" << std::endl;
+	return 0;
+}
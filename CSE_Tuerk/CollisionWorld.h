@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef COLLISIONWORLD_H
+#define COLLISIONWORLD_H
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "BatchMath.h"
+
+// Edge length of the spatial hash cells. About the size of the colliders, so each one lands in a few cells
+const GLfloat DEFAULT_COLLISION_CELL_SIZE = 4.0f;
+// Colliders covering more cells than this aren't hashed, every query tests them
+const int MAX_COLLIDER_CELLS = 64;
+// Queries covering more cells than this test every collider instead, that's cheaper than looking up all the cells
+const int MAX_QUERY_CELLS = 4096;
+// Colliders a query has room for without allocating, more grow the scratch memory
+const int COLLISION_QUERY_RESERVE = 1024;
+// Gap left between a moved box and what it ran into, so the next sweep starts outside
+const GLfloat COLLISION_SKIN = 0.001f;
+// Hits resolved per move, the rest of the motion slides along each surface hit
+const int COLLISION_SLIDE_STEPS = 3;
+
+struct SweepHit {
+	int collider;		// as returned by addStatic / addDynamic
+	GLfloat time;		// fraction of the motion before touching
+	glm::vec3 normal;	// of the face hit, points back against the motion
+};
+
+// Axis aligned boxes the camera (or anything else moved as a box) can't pass through. Static colliders go into a
+// spatial hash once when build() runs, moving ones are re-hashed only when they cross into other cells.
+// A query looks up the cells it covers and tests the colliders found there all at once with the batch math sweep
+// kernel. Queries use scratch memory of the world, so one thread at a time
+class CollisionWorld
+{
+public:
+	explicit CollisionWorld(GLfloat _cellSize = DEFAULT_COLLISION_CELL_SIZE);
+
+	// Colliders are the local bounds moved to each position, like InstancePicker::addObject. Returns the first collider,
+	// the others follow in the order of positions. build() has to run again after adding static colliders
+	int addStatic(const std::vector<glm::vec3>& positions, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void build();
+	// Moving colliders are hashed right away. The cells within reach of center get room for it already, so moving it
+	// there later doesn't allocate
+	int addDynamic(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& reach = glm::vec3(0.0f));
+	void moveDynamic(int collider, const glm::vec3& center);
+	void clear();
+
+	// Colliders overlapping the box (touching doesn't count), result is cleared first
+	void overlapping(const glm::vec3& min, const glm::vec3& max, std::vector<int>& result);
+	// First collider the box (center, half size extent) runs into on its way along motion. Colliders it overlaps
+	// at the start are ignored, so whatever got stuck can move out again
+	bool sweep(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, SweepHit& hit);
+	// Same result by testing every collider, the reference for the benchmark
+	bool sweepBruteForce(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, SweepHit& hit);
+	// Where the box ends up: up to the first hit, then sliding along it with what's left of the motion
+	glm::vec3 move(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion);
+
+	size_t colliderCount() const { return boxes.size(); }
+	size_t staticCellCount() const { return staticCells.size(); }
+
+private:
+	CollisionWorld(const CollisionWorld&);
+	CollisionWorld& operator=(const CollisionWorld&);
+
+	// Cells [min, max] on each axis
+	struct CellRange {
+		int min[3];
+		int max[3];
+
+		bool operator==(const CellRange& other) const;
+		long long cells() const;
+	};
+
+	// staticIds [first, first + count)
+	struct StaticCell {
+		int first;
+		int count;
+	};
+
+	struct Dynamic {
+		int collider;
+		CellRange cells;
+	};
+
+	static unsigned long long cellKey(int x, int y, int z);
+	CellRange cellsOf(const glm::vec3& min, const glm::vec3& max) const;
+	void insertDynamic(int collider, const CellRange& cells);
+	void removeDynamic(int collider, const CellRange& cells);
+	// Fills candidates (and candidateBoxes) with each collider which may touch the box from min to max once
+	void gatherCandidates(const glm::vec3& min, const glm::vec3& max);
+	void addCandidate(int collider);
+	bool nearestHit(const glm::vec3& center, const glm::vec3& extent, const glm::vec3& motion, const AABBsSoA& tested,
+		const std::vector<int>* ids, SweepHit& hit);
+
+	GLfloat cellSize;
+	AABBsSoA boxes;						// every collider
+	std::vector<int> dynamicIndex;		// per collider, into dynamics, -1 for static ones
+	std::vector<int> oversized;			// static colliders in too many cells to hash
+	std::vector<int> staticIds;
+	std::unordered_map<unsigned long long, StaticCell> staticCells;
+	std::unordered_map<unsigned long long, std::vector<int> > dynamicCells;	// emptied cells are kept, with their memory
+	std::vector<Dynamic> dynamics;
+
+	// Query scratch, kept to avoid allocations
+	std::vector<unsigned int> stamps;	// per collider, the query which added it last
+	unsigned int query;
+	std::vector<int> candidates;
+	AABBsSoA candidateBoxes;
+	SimdFloatArray times;
+};
+
+// --bench-collision: times sweeps of a box of extent through 200000 static and 1000 moving boxes, returns the exit code
+int runCollisionBenchmark(const glm::vec3& extent);
+
+#endif
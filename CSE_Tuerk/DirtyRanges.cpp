@@ -0,0 +1,206 @@
+#include "DirtyRanges.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include <glm.hpp>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "GpuResources.h"
+#include "BenchmarkHarness.h"
+
+DirtyRanges::DirtyRanges(size_t _stride, size_t _budget, RangeUploadMethod _method)
+	: stride(_stride), budget(_budget), method(_method), coalescedCount(0), cursor(0), uploaded(0), calls(0), throttled(0)
+{
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	ranges.reserve(DIRTY_RANGE_RESERVE);
+}
+
+void DirtyRanges::mark(size_t first, size_t count)
+{
+	if (count == 0)
+		return;
+	// Edits running through the buffer in order only grow the last range
+	if (!ranges.empty()) {
+		DirtyRange& last = ranges.back();
+		if (first >= last.first && first <= last.first + last.count) {
+			last.count = std::max(last.count, first + count - last.first);
+			return;
+		}
+	}
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	DirtyRange range = { first, count };
+	ranges.push_back(range);
+	// Scattered edits would otherwise pile up until the next flush
+	if (ranges.size() >= 2 * coalescedCount + DIRTY_RANGE_RESERVE) {
+		coalesce();
+	}
+}
+
+void DirtyRanges::clear()
+{
+	ranges.clear();
+	coalescedCount = 0;
+	cursor = 0;
+}
+
+size_t DirtyRanges::flush(GLuint buffer, const void* source)
+{
+	if (ranges.empty())
+		return 0;
+	PROFILE_ZONE("FlushDirtyRanges");
+	coalesce();
+
+	// Starting at the cursor and wrapping around, a range over the budget is split and its rest waits
+	size_t start = 0;
+	while (start < ranges.size() && ranges[start].first < cursor) {
+		start++;
+	}
+	size_t elements = std::max((size_t)1, budget / stride);
+	size_t bytes = 0;
+	const unsigned char* data = (const unsigned char*)source;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	for (size_t n = 0; n < ranges.size() && elements > 0; n++) {
+		DirtyRange& range = ranges[(start + n) % ranges.size()];
+		size_t count = std::min(range.count, elements);
+		upload(range.first * stride, count * stride, data);
+		bytes += count * stride;
+		elements -= count;
+		range.first += count;
+		range.count -= count;
+		cursor = range.first;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Uploaded ranges are empty now
+	size_t kept = 0;
+	for (size_t i = 0; i < ranges.size(); i++) {
+		if (ranges[i].count > 0)
+			ranges[kept++] = ranges[i];
+	}
+	ranges.resize(kept);
+	coalescedCount = kept;
+	if (kept > 0)
+		throttled++;
+	uploaded += bytes;
+	return bytes;
+}
+
+void DirtyRanges::coalesce()
+{
+	std::sort(ranges.begin(), ranges.end(), [](const DirtyRange& a, const DirtyRange& b) { return a.first < b.first; });
+	size_t merged = 0;
+	for (size_t i = 1; i < ranges.size(); i++) {
+		DirtyRange& last = ranges[merged];
+		if (ranges[i].first <= last.first + last.count + DIRTY_RANGE_MERGE_GAP) {
+			last.count = std::max(last.count, ranges[i].first + ranges[i].count - last.first);
+		}
+		else {
+			ranges[++merged] = ranges[i];
+		}
+	}
+	if (!ranges.empty())
+		ranges.resize(merged + 1);
+	coalescedCount = ranges.size();
+}
+
+// Into the buffer bound to GL_COPY_WRITE_BUFFER
+void DirtyRanges::upload(size_t offset, size_t size, const unsigned char* data)
+{
+	calls++;
+	if (method == RANGE_UPLOAD_MAP_RANGE) {
+		void* target = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (target != NULL) {
+			memcpy(target, data + offset, size);
+			if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE)
+				return;
+		}
+		// Lost or never mapped, the range goes up the other way
+		std::cout << "ERROR::DIRTY_RANGES::MAP_FAILED" << std::endl;
+	}
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data + offset);
+}
+
+// Edits to a million instances, uploaded as the whole buffer each frame or as dirty ranges within the budget. Single instances
+// all over the buffer plus one block of neighbours per frame, then a burst of edits larger than the budget. Reads the buffer back at the end
+int runInstanceUpdateBenchmark()
+{
+	const size_t COUNT = 1000000;
+	const int FRAMES = 60;
+	const int SCATTERED_EDITS = 1000;
+	const int BLOCK_EDITS = 1000;
+	const int BURST_EDITS = 200000;
+	const char* NAMES[] = { "whole buffer", "dirty ranges, glBufferSubData", "dirty ranges, mapped" };
+
+	std::vector<glm::vec3> instances(COUNT);
+	seedBenchmark();
+	randomPositions(instances, glm::vec3(-1000.0f, -20.0f, -1000.0f), glm::vec3(1000.0f, 20.0f, 1000.0f));
+	std::vector<glm::vec3> uploaded(COUNT);
+	GpuResources resources;
+	unsigned int random = 1;
+
+	std::cout << "Instance updates, " << COUNT << " instances, " << SCATTERED_EDITS << " scattered and " << BLOCK_EDITS
+		<< " neighbouring edits per frame, budget " << DEFAULT_RANGE_UPLOAD_BUDGET / 1024 << " KB" << std::endl;
+	for (int run = 0; run < 3; run++) {
+		GpuHandle buffer = resources.createBuffer(COUNT * sizeof(glm::vec3), &instances[0], GL_DYNAMIC_DRAW);
+		GLuint name = resources.name(buffer);
+		DirtyRanges dirty(sizeof(glm::vec3), DEFAULT_RANGE_UPLOAD_BUDGET, run == 2 ? RANGE_UPLOAD_MAP_RANGE : RANGE_UPLOAD_SUB_DATA);
+		unsigned long long bytes = 0;
+		double ms = 0.0;
+		for (int frame = 0; frame < FRAMES; frame++) {
+			for (int n = 0; n < SCATTERED_EDITS + BLOCK_EDITS; n++) {
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				size_t i = n < SCATTERED_EDITS ? random % COUNT : (size_t)frame * 9973 % (COUNT - BLOCK_EDITS) + n - SCATTERED_EDITS;
+				instances[i].y += 1.0f;
+				dirty.mark(i);
+			}
+
+			glFinish();
+			long long start = Profiler::now();
+			if (run == 0) {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, 0, COUNT * sizeof(glm::vec3), &instances[0]);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				bytes += COUNT * sizeof(glm::vec3);
+			}
+			else {
+				bytes += dirty.flush(name, &instances[0]);
+			}
+			glFinish();
+			ms += elapsedMs(start);
+		}
+
+		std::cout << "  " << NAMES[run] << ": " << bytes / FRAMES / 1024 << " KB, " << ms / FRAMES << "ms per frame";
+		if (run > 0) {
+			for (int n = 0; n < BURST_EDITS; n++) {
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				size_t i = random % COUNT;
+				instances[i].y += 1.0f;
+				dirty.mark(i);
+			}
+			int frames = 0;
+			while (!dirty.empty()) {
+				dirty.flush(name, &instances[0]);
+				frames++;
+			}
+			std::cout << ", a burst of " << BURST_EDITS << " edits went up in " << frames << " frames";
+		}
+		std::cout << std::endl;
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+		glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, COUNT * sizeof(glm::vec3), &uploaded[0]);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		resources.release(buffer);
+		if (memcmp(&uploaded[0], &instances[0], COUNT * sizeof(glm::vec3)) != 0) {
+			std::cout << "ERROR::INSTANCE_UPDATES::" << NAMES[run] << " left the buffer different from the instances" << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
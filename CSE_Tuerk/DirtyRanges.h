@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef DIRTYRANGES_H
+#define DIRTYRANGES_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Bytes uploaded per flush at most, what doesn't fit goes up in the next ones
+const size_t DEFAULT_RANGE_UPLOAD_BUDGET = 256 * 1024;
+// Ranges up to this many elements apart are uploaded as one, re-sending a few unchanged elements is cheaper than another call
+const size_t DIRTY_RANGE_MERGE_GAP = 8;
+// Ranges there is room for without allocating
+const size_t DIRTY_RANGE_RESERVE = 1024;
+
+enum RangeUploadMethod {
+	RANGE_UPLOAD_SUB_DATA,		// glBufferSubData per range
+	RANGE_UPLOAD_MAP_RANGE		// glMapBufferRange per range, the old contents of the range invalidated
+};
+
+// Elements [first, first + count)
+struct DirtyRange {
+	size_t first;
+	size_t count;
+};
+
+// Remembers which elements of a buffer changed since they were uploaded last and uploads only those. Marked ranges
+// are merged with their neighbours, a flush uploads them in buffer order within a byte budget. A flush over the budget
+// continues where the last one stopped the next time, so every range gets its turn even under constant edits.
+// Until everything is flushed the buffer holds old and new elements side by side. Needs the GL context for flush()
+class DirtyRanges
+{
+public:
+	explicit DirtyRanges(size_t _stride, size_t _budget = DEFAULT_RANGE_UPLOAD_BUDGET, RangeUploadMethod _method = RANGE_UPLOAD_SUB_DATA);
+
+	void mark(size_t first, size_t count = 1);
+	// Forgets all ranges, e.g. after uploading the whole buffer
+	void clear();
+	// Uploads the marked elements of source (all elements of the buffer, stride bytes each) into buffer. Returns the bytes uploaded
+	size_t flush(GLuint buffer, const void* source);
+
+	bool empty() const { return ranges.empty(); }
+	void setBudget(size_t bytes) { budget = bytes; }
+	void setMethod(RangeUploadMethod _method) { method = _method; }
+
+	unsigned long long uploadedBytes() const { return uploaded; }
+	unsigned long long uploadCalls() const { return calls; }
+	unsigned long long throttledFlushes() const { return throttled; }
+
+private:
+	// Sorts the ranges and merges the overlapping, adjacent and nearly adjacent ones
+	void coalesce();
+	void upload(size_t offset, size_t size, const unsigned char* data);
+
+	size_t stride;
+	size_t budget;
+	RangeUploadMethod method;
+	std::vector<DirtyRange> ranges;
+	size_t coalescedCount;		// ranges after the last coalesce, marking coalesces again once there are twice as many
+	size_t cursor;				// element after the last one uploaded, the next flush starts there
+	unsigned long long uploaded;
+	unsigned long long calls;
+	unsigned long long throttled;
+};
+
+// --bench-instance-updates: times uploading edits to a million instances, whole vs. dirty ranges. Needs the GL context,
+// returns the exit code
+int runInstanceUpdateBenchmark();
+
+#endif
@@ -0,0 +1,120 @@
+#include "DynamicResolution.h"
+
+#include <cmath>
+#include <algorithm>
+
+// Hysteresis: scale down fast when over the target, scale up slowly and only with clear headroom
+const double DOWNSCALE_THRESHOLD = 1.0;		// fraction of the target
+const double UPSCALE_THRESHOLD = 0.8;
+const int DOWNSCALE_FRAMES = 3;
+const int UPSCALE_FRAMES = 30;
+const GLfloat UPSCALE_STEP = 0.05f;
+const double SMOOTHING = 0.2;
+
+DynamicResolution::DynamicResolution()
+	: frameIndex(0), windowWidth(0), windowHeight(0), width(0), height(0), targetMs(0.0),
+	minScale(1.0f), maxScale(1.0f), currentScale(1.0f), smoothedMs(0.0), framesOver(0), framesUnder(0), cooldown(0)
+{
+	for (int i = 0; i < GPU_FRAME_LATENCY; i++) {
+		queries[i] = 0;
+		queryPending[i] = false;
+	}
+}
+
+bool DynamicResolution::init(GLsizei _windowWidth, GLsizei _windowHeight, double _targetMs, GLfloat _minScale, GLfloat _maxScale)
+{
+	windowWidth = _windowWidth;
+	windowHeight = _windowHeight;
+	targetMs = _targetMs;
+	minScale = std::max(0.1f, std::min(_minScale, _maxScale));
+	maxScale = std::max(minScale, _maxScale);
+
+	glGenQueries(GPU_FRAME_LATENCY, queries);
+	setScale(std::min(1.0f, maxScale));
+	return queries[0] != 0;
+}
+
+void DynamicResolution::destroy()
+{
+	if (queries[0] != 0) {
+		glDeleteQueries(GPU_FRAME_LATENCY, queries);
+	}
+	for (int i = 0; i < GPU_FRAME_LATENCY; i++) {
+		queries[i] = 0;
+		queryPending[i] = false;
+	}
+}
+
+void DynamicResolution::begin()
+{
+	readQueries();
+
+	int slot = frameIndex % GPU_FRAME_LATENCY;
+	glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+}
+
+void DynamicResolution::end()
+{
+	int slot = frameIndex % GPU_FRAME_LATENCY;
+	glEndQuery(GL_TIME_ELAPSED);
+	queryPending[slot] = true;
+	frameIndex++;
+}
+
+// Only results which are already there are read, waiting for the GPU would cost more than the scaling saves
+void DynamicResolution::readQueries()
+{
+	int slot = frameIndex % GPU_FRAME_LATENCY;
+	if (!queryPending[slot])
+		return;
+	queryPending[slot] = false;
+
+	GLuint available = 0;
+	glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+	adjust(elapsed / 1000000.0);
+}
+
+void DynamicResolution::adjust(double milliseconds)
+{
+	if (cooldown > 0) {
+		cooldown--;
+		return;
+	}
+	smoothedMs = smoothedMs == 0.0 ? milliseconds : smoothedMs + (milliseconds - smoothedMs) * SMOOTHING;
+
+	if (smoothedMs > targetMs * DOWNSCALE_THRESHOLD) {
+		framesOver++;
+		framesUnder = 0;
+	}
+	else if (smoothedMs < targetMs * UPSCALE_THRESHOLD) {
+		framesUnder++;
+		framesOver = 0;
+	}
+	else {
+		framesOver = framesUnder = 0;
+	}
+
+	if (framesOver >= DOWNSCALE_FRAMES && currentScale > minScale) {
+		// Fill-bound work grows with the pixel count, i.e. with scale^2
+		setScale(currentScale * (GLfloat)std::sqrt(targetMs * UPSCALE_THRESHOLD / smoothedMs));
+	}
+	else if (framesUnder >= UPSCALE_FRAMES && currentScale < maxScale) {
+		setScale(currentScale + UPSCALE_STEP);
+	}
+}
+
+void DynamicResolution::setScale(GLfloat _scale)
+{
+	currentScale = std::max(minScale, std::min(maxScale, _scale));
+	width = std::max((GLsizei)1, (GLsizei)(windowWidth * currentScale + 0.5f));
+	height = std::max((GLsizei)1, (GLsizei)(windowHeight * currentScale + 0.5f));
+
+	// Results still in flight belong to the old resolution
+	framesOver = framesUnder = 0;
+	smoothedMs = 0.0;
+	cooldown = GPU_FRAME_LATENCY;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <GL/glew.h>
+
+#include "Profiler.h"
+
+// Defaults for the command line options
+const double DEFAULT_TARGET_FPS = 60.0;
+const GLfloat DEFAULT_MIN_RESOLUTION_SCALE = 0.5f;
+const GLfloat DEFAULT_MAX_RESOLUTION_SCALE = 1.0f;
+
+// Picks the resolution the scene is rendered with, so that its GPU time stays at a target. The render graph upscales
+// the result to the window. The target is sized for the maximum scale, a lower scale only uses a smaller part of it.
+class DynamicResolution
+{
+public:
+	DynamicResolution();
+
+	// Needs a current GL context. targetMs is the GPU time per frame the scale is adjusted to
+	bool init(GLsizei _windowWidth, GLsizei _windowHeight, double targetMs, GLfloat _minScale, GLfloat _maxScale);
+	void destroy();
+
+	// Adjusts the scale from older measurements and starts timing the scene. The scale stays the same until the next begin()
+	void begin();
+	void end();
+
+	GLfloat scale() const { return currentScale; }
+	GLsizei maxWidth() const { return (GLsizei)(windowWidth * maxScale + 0.5f); }
+	GLsizei maxHeight() const { return (GLsizei)(windowHeight * maxScale + 0.5f); }
+	GLsizei renderWidth() const { return width; }
+	GLsizei renderHeight() const { return height; }
+	double gpuTime() const { return smoothedMs; }
+
+private:
+	void readQueries();
+	void adjust(double milliseconds);
+	void setScale(GLfloat _scale);
+
+	GLuint queries[GPU_FRAME_LATENCY];
+	bool queryPending[GPU_FRAME_LATENCY];
+	int frameIndex;
+
+	GLsizei windowWidth;
+	GLsizei windowHeight;
+	GLsizei width;
+	GLsizei height;
+
+	double targetMs;
+	GLfloat minScale;
+	GLfloat maxScale;
+	GLfloat currentScale;
+
+	double smoothedMs;
+	int framesOver;			// consecutive measurements above the target
+	int framesUnder;		// consecutive measurements clearly below the target
+	int cooldown;			// measurements to ignore after a change, they were taken with the old scale
+};
+
+#endif
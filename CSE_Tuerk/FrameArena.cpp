@@ -0,0 +1,69 @@
+#include "FrameArena.h"
+
+#include <new>
+#include <iostream>
+
+#include "AlignedAllocator.h"
+
+FrameArena::FrameArena(size_t capacity)
+	: block(NULL), size(capacity), offset(0), frameBytes(0), peakBytes(0)
+{
+	block = static_cast<char*>(alignedAlloc(size, SIMD_ALIGNMENT));
+	if (block == NULL) {
+		std::cout << "ERROR::FRAMEARENA::OUT_OF_MEMORY " << size << " bytes" << std::endl;
+		size = 0;
+	}
+}
+
+FrameArena::~FrameArena()
+{
+	reset();
+	alignedFree(block);
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment)
+{
+	frameBytes += bytes;
+
+	size_t base = reinterpret_cast<size_t>(block);
+	size_t start = (base + offset + alignment - 1) & ~(alignment - 1);
+	if (block != NULL && start + bytes <= base + size) {
+		offset = start + bytes - base;
+		return block + (start - base);
+	}
+
+	void* memory = alignedAlloc(bytes > 0 ? bytes : 1, alignment);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	overflow.push_back(memory);
+	return memory;
+}
+
+void FrameArena::reset()
+{
+	if (frameBytes > peakBytes)
+		peakBytes = frameBytes;
+
+	if (!overflow.empty()) {
+		for (size_t i = 0; i < overflow.size(); i++)
+			alignedFree(overflow[i]);
+		overflow.clear();
+
+		// Room for the largest frame so far plus some, alignment padding included
+		size_t grown = peakBytes + peakBytes / 2;
+		char* larger = static_cast<char*>(alignedAlloc(grown, SIMD_ALIGNMENT));
+		if (larger != NULL) {
+			alignedFree(block);
+			block = larger;
+			size = grown;
+		}
+	}
+	offset = 0;
+	frameBytes = 0;
+}
+
+FrameArena& FrameArena::thread()
+{
+	static thread_local FrameArena arena;
+	return arena;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Initial size of each thread's arena, it grows if a frame needs more
+const size_t DEFAULT_FRAME_ARENA_SIZE = 256 * 1024;
+
+// Bump allocator for scratch data which only lives until the end of the frame: allocating moves a pointer, reset()
+// drops everything at once. Every thread has its own arena (FrameArena::thread()), so nothing is locked.
+// A frame which needs more than the capacity gets extra heap blocks, the next reset() then grows the arena,
+// so frames in the steady state never touch the heap
+class FrameArena
+{
+public:
+	explicit FrameArena(size_t capacity = DEFAULT_FRAME_ARENA_SIZE);
+	~FrameArena();
+
+	// alignment has to be a power of two. The memory is uninitialized and only valid until the next reset()
+	void* allocate(size_t size, size_t alignment = 16);
+
+	// Uninitialized array, only for plain data (no constructors or destructors are called)
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T) > 16 ? alignof(T) : 16));
+	}
+
+	// End of the frame, everything allocated so far is invalid afterwards
+	void reset();
+
+	size_t capacity() const { return size; }
+	size_t used() const { return frameBytes; }
+	// Most bytes a single frame used so far
+	size_t peak() const { return peakBytes; }
+
+	// Arena of the calling thread, created on first use
+	static FrameArena& thread();
+
+private:
+	FrameArena(const FrameArena&);
+	FrameArena& operator=(const FrameArena&);
+
+	char* block;
+	size_t size;
+	size_t offset;						// first free byte in block
+	size_t frameBytes;					// requested this frame, including the overflow
+	size_t peakBytes;
+	std::vector<void*> overflow;		// heap blocks of a frame which didn't fit
+};
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <iostream>
+
+#include <GL/glew.h>
+
+// Offscreen render target: color texture + depth/stencil renderbuffer
+class Framebuffer
+{
+public:
+	GLuint FBO;
+	GLuint colorTexture;
+	GLuint depthRenderbuffer;
+	GLsizei width;
+	GLsizei height;
+
+	Framebuffer()
+		: FBO(0), colorTexture(0), depthRenderbuffer(0), width(0), height(0)
+	{}
+
+	~Framebuffer()
+	{
+		destroy();
+	}
+
+	bool create(GLsizei _width, GLsizei _height, GLenum colorFormat = GL_RGBA8)
+	{
+		destroy();
+		width = _width;
+		height = _height;
+
+		glGenTextures(1, &colorTexture);
+		glBindTexture(GL_TEXTURE_2D, colorTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, colorFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &depthRenderbuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			std::cout << "ERROR::FRAMEBUFFER::NOT_COMPLETE " << status << std::endl;
+			destroy();
+			return false;
+		}
+		return true;
+	}
+
+	// Binds the framebuffer for drawing and sets the viewport to its size
+	void bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, width, height);
+	}
+
+	void destroy()
+	{
+		if (FBO != 0) {
+			glDeleteFramebuffers(1, &FBO);
+		}
+		if (colorTexture != 0) {
+			glDeleteTextures(1, &colorTexture);
+		}
+		if (depthRenderbuffer != 0) {
+			glDeleteRenderbuffers(1, &depthRenderbuffer);
+		}
+		FBO = colorTexture = depthRenderbuffer = 0;
+		width = height = 0;
+	}
+};
+
+#endif
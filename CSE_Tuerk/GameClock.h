@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef GAMECLOCK_H
+#define GAMECLOCK_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "Camera.h"
+
+// Default simulation rate and how many steps one frame may catch up before time is dropped
+const double DEFAULT_TICK_RATE = 120.0;
+const int DEFAULT_MAX_CATCH_UP = 8;
+
+// Fixed-rate simulation clock. Real time (double precision, so it doesn't degrade over long runs) is
+// accumulated and handed out in whole steps, the remainder is used to interpolate the render state.
+class FixedTimestep
+{
+public:
+	double step;				// seconds per simulation step
+	int maxStepsPerFrame;		// catch-up limit, anything beyond it is dropped so a spike can't spiral
+	long long stepIndex;		// number of steps simulated so far
+	double droppedTime;			// real time thrown away by the catch-up limit
+
+	FixedTimestep(double _step = 1.0 / DEFAULT_TICK_RATE, int _maxStepsPerFrame = DEFAULT_MAX_CATCH_UP)
+		: step(_step), maxStepsPerFrame(_maxStepsPerFrame), stepIndex(0), droppedTime(0.0), accumulator(0.0), lastTime(-1.0)
+	{}
+
+	// Takes the current real time and returns how many steps have to be simulated this frame
+	int advance(double now)
+	{
+		if (lastTime < 0.0) {
+			lastTime = now;
+		}
+		accumulator += now - lastTime;
+		lastTime = now;
+
+		int steps = (int)(accumulator / step);
+		if (steps > maxStepsPerFrame) {
+			droppedTime += (steps - maxStepsPerFrame) * step;
+			accumulator -= (steps - maxStepsPerFrame) * step;
+			steps = maxStepsPerFrame;
+		}
+		accumulator -= steps * step;
+		return steps;
+	}
+
+	// Time of the simulation after stepIndex steps. Always computed the same way, so recordings can rely on it
+	double simulationTime() const { return stepIndex * step; }
+
+	// Real time the current simulation state belongs to. The renderer interpolates by how far it is past this
+	double stepTime() const { return lastTime - accumulator; }
+
+	// Real time left until the next step is due
+	double timeToNextStep() const { return step - accumulator; }
+
+private:
+	double accumulator;
+	double lastTime;
+};
+
+// The part of the camera which the simulation changes and the renderer interpolates
+struct CameraState {
+	glm::vec3 position;
+
+	static CameraState capture(const Camera& camera)
+	{
+		CameraState state;
+		state.position = camera.Position;
+		return state;
+	}
+
+	// Orientation and zoom are not interpolated: mouse input is applied right away and must not lag behind
+	static void interpolate(const CameraState& previous, const CameraState& current, GLfloat alpha, Camera& camera)
+	{
+		camera.Position = glm::mix(previous.position, current.position, alpha);
+	}
+};
+
+#endif
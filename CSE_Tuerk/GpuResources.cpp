@@ -0,0 +1,328 @@
+#include "GpuResources.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+// Client format and type which go with an internal format, needed to allocate a texture without data. 0 if unknown
+static int pixelBytes(GLenum internalFormat, GLenum& format, GLenum& type)
+{
+	type = GL_UNSIGNED_BYTE;
+	switch (internalFormat) {
+	case GL_RED: case GL_R8: format = GL_RED; return 1;
+	case GL_RG: case GL_RG8: format = GL_RG; return 2;
+	case GL_RGB: case GL_RGB8: case GL_SRGB8: format = GL_RGB; return 3;
+	case GL_RGBA: case GL_RGBA8: case GL_SRGB8_ALPHA8: format = GL_RGBA; return 4;
+	case GL_R16F: format = GL_RED; type = GL_FLOAT; return 2;
+	case GL_R32F: format = GL_RED; type = GL_FLOAT; return 4;
+	case GL_RGBA16F: format = GL_RGBA; type = GL_FLOAT; return 8;
+	case GL_RGBA32F: format = GL_RGBA; type = GL_FLOAT; return 16;
+	case GL_DEPTH_COMPONENT24: format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; return 4;
+	case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; return 4;
+	case GL_DEPTH24_STENCIL8: format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; return 4;
+	default: format = 0; return 0;
+	}
+}
+
+GpuResources::GpuResources()
+	: frame(0), recycledBytes(0), reused(0), created(0)
+{
+	for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++) {
+		live[i] = 0;
+		liveBytes[i] = 0;
+	}
+	// Slot 0 stays unused, a null handle never matches anything
+	Slot none = { 0, 0, GPU_BUFFER, { 0, 0, 0, 0, false }, 0 };
+	slots.push_back(none);
+}
+
+GpuResources::~GpuResources()
+{
+	destroy();
+}
+
+GpuHandle GpuResources::createBuffer(GLsizeiptr size, const GLvoid* data, GLenum usage)
+{
+	StorageKey key = { usage, (std::max(size, (GLsizeiptr)1) + GPU_BUFFER_GRANULARITY - 1) / GPU_BUFFER_GRANULARITY * GPU_BUFFER_GRANULARITY, 0, 0, false };
+	GLuint buffer = takeRecycled(GPU_BUFFER, key);
+	if (buffer != 0) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		if (data != NULL) {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+		}
+	}
+	else {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, key.bytes, size == key.bytes ? data : NULL, usage);
+		if (data != NULL && size != key.bytes) {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return allocateSlot(buffer, GPU_BUFFER, key);
+}
+
+GpuHandle GpuResources::createTexture(GLenum internalFormat, GLsizei width, GLsizei height, bool mipmapped)
+{
+	StorageKey key = { internalFormat, 0, width, height, mipmapped };
+	GLuint texture = takeRecycled(GPU_TEXTURE, key);
+	if (texture != 0) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		return allocateSlot(texture, GPU_TEXTURE, key);
+	}
+
+	GLenum format, type;
+	if (pixelBytes(internalFormat, format, type) == 0) {
+		std::cout << "ERROR::GPURESOURCES::UNKNOWN_TEXTURE_FORMAT 0x" << std::hex << internalFormat << std::dec << std::endl;
+		return GpuHandle();
+	}
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	int levels = 1;
+	if (mipmapped) {
+		for (GLsizei size = std::max(width, height); size > 1; size /= 2)
+			levels++;
+	}
+	for (int level = 0; level < levels; level++) {
+		glTexImage2D(GL_TEXTURE_2D, level, internalFormat, std::max(width >> level, 1), std::max(height >> level, 1), 0, format, type, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	return allocateSlot(texture, GPU_TEXTURE, key);
+}
+
+GpuHandle GpuResources::createVertexArray()
+{
+	GLuint vertexArray;
+	glGenVertexArrays(1, &vertexArray);
+	StorageKey key = { 0, 0, 0, 0, false };
+	return allocateSlot(vertexArray, GPU_VERTEX_ARRAY, key);
+}
+
+GLuint GpuResources::name(GpuHandle handle) const
+{
+	const Slot* slot = slotFor(handle);
+	return slot != NULL ? slot->name : 0;
+}
+
+bool GpuResources::isValid(GpuHandle handle) const
+{
+	return slotFor(handle) != NULL;
+}
+
+GLsizeiptr GpuResources::bufferSize(GpuHandle handle) const
+{
+	const Slot* slot = slotFor(handle);
+	return slot != NULL && slot->type == GPU_BUFFER ? slot->key.bytes : 0;
+}
+
+void GpuResources::addRef(GpuHandle handle)
+{
+	if (slotFor(handle) != NULL) {
+		slots[handle.index].references++;
+	}
+}
+
+void GpuResources::release(GpuHandle& handle)
+{
+	if (handle.isNull())
+		return;
+	if (slotFor(handle) == NULL) {
+		std::cout << "ERROR::GPURESOURCES::STALE_HANDLE " << handle.index << "/" << handle.generation << std::endl;
+		handle = GpuHandle();
+		return;
+	}
+
+	Slot& slot = slots[handle.index];
+	handle = GpuHandle();
+	if (--slot.references > 0)
+		return;
+
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	Unused object = { slot.name, slot.type, slot.key, frame };
+	retired.push_back(object);
+	live[slot.type]--;
+	liveBytes[slot.type] -= storageBytes(slot.type, slot.key);
+
+	// The generation moves on, so handles which are still around don't find the next user of the slot
+	slot.name = 0;
+	slot.generation++;
+	if (slot.generation == 0)
+		slot.generation = 1;
+	freeSlots.push_back((GLuint)(&slot - &slots[0]));
+}
+
+void GpuResources::endFrame()
+{
+	PROFILE_ZONE("GpuResources");
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+
+	// Everything released this frame waits for the commands submitted so far
+	if (!retired.empty() && (fences.empty() || fences.back().frame != frame)) {
+		FrameFence fence = { frame, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+		fences.push_back(fence);
+	}
+
+	// Fences are passed in order, stop at the first one the GPU hasn't reached
+	size_t done = 0;
+	long long doneFrame = -1;
+	while (done < fences.size()) {
+		GLenum status = glClientWaitSync(fences[done].fence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(fences[done].fence);
+		doneFrame = fences[done].frame;
+		done++;
+	}
+	fences.erase(fences.begin(), fences.begin() + done);
+
+	if (doneFrame >= 0) {
+		size_t kept = 0;
+		for (size_t i = 0; i < retired.size(); i++) {
+			if (retired[i].frame <= doneFrame)
+				recycle(retired[i]);
+			else
+				retired[kept++] = retired[i];
+		}
+		retired.resize(kept);
+	}
+	trimRecycled();
+	frame++;
+}
+
+void GpuResources::destroy()
+{
+	for (size_t i = 1; i < slots.size(); i++) {
+		if (slots[i].references > 0) {
+			deleteObject(slots[i].name, slots[i].type);
+			slots[i].name = 0;
+			slots[i].references = 0;
+			slots[i].generation++;
+			freeSlots.push_back((GLuint)i);
+		}
+	}
+	for (size_t i = 0; i < retired.size(); i++)
+		deleteObject(retired[i].name, retired[i].type);
+	for (size_t i = 0; i < recycled.size(); i++)
+		deleteObject(recycled[i].name, recycled[i].type);
+	for (size_t i = 0; i < fences.size(); i++)
+		glDeleteSync(fences[i].fence);
+	retired.clear();
+	recycled.clear();
+	fences.clear();
+	recycledBytes = 0;
+	for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++) {
+		live[i] = 0;
+		liveBytes[i] = 0;
+	}
+}
+
+void GpuResources::printStatistics() const
+{
+	std::cout << "GpuResources: " << live[GPU_BUFFER] << " buffers (" << liveBytes[GPU_BUFFER] / 1024 << " KB), "
+		<< live[GPU_TEXTURE] << " textures (" << liveBytes[GPU_TEXTURE] / 1024 << " KB), " << live[GPU_VERTEX_ARRAY] << " vertex arrays, "
+		<< retired.size() << " waiting for the GPU, " << recycled.size() << " kept for reuse (" << recycledBytes / 1024 << " KB), "
+		<< reused << " of " << reused + created << " requests recycled" << std::endl;
+}
+
+GpuHandle GpuResources::allocateSlot(GLuint name, GpuResourceType type, const StorageKey& key)
+{
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	GLuint index;
+	if (!freeSlots.empty()) {
+		index = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		index = (GLuint)slots.size();
+		Slot slot = { 0, 1, type, key, 0 };
+		slots.push_back(slot);
+	}
+
+	Slot& slot = slots[index];
+	slot.name = name;
+	slot.type = type;
+	slot.key = key;
+	slot.references = 1;
+	live[type]++;
+	liveBytes[type] += storageBytes(type, key);
+
+	GpuHandle handle;
+	handle.index = index;
+	handle.generation = slot.generation;
+	return handle;
+}
+
+const GpuResources::Slot* GpuResources::slotFor(GpuHandle handle) const
+{
+	if (handle.isNull() || handle.index >= slots.size())
+		return NULL;
+	const Slot& slot = slots[handle.index];
+	return slot.generation == handle.generation && slot.references > 0 ? &slot : NULL;
+}
+
+// Newest match first, it is the most likely to still be resident
+GLuint GpuResources::takeRecycled(GpuResourceType type, const StorageKey& key)
+{
+	for (size_t i = recycled.size(); i-- > 0;) {
+		if (recycled[i].type == type && recycled[i].key == key) {
+			GLuint name = recycled[i].name;
+			recycledBytes -= storageBytes(type, key);
+			recycled.erase(recycled.begin() + i);
+			reused++;
+			return name;
+		}
+	}
+	created++;
+	return 0;
+}
+
+void GpuResources::recycle(const Unused& object)
+{
+	if (object.type == GPU_VERTEX_ARRAY) {
+		deleteObject(object.name, object.type);
+		return;
+	}
+	Unused entry = object;
+	entry.frame = frame;
+	recycled.push_back(entry);
+	recycledBytes += storageBytes(object.type, object.key);
+}
+
+// Drops what wasn't asked for in a while, and the oldest entries while over the memory limit
+void GpuResources::trimRecycled()
+{
+	size_t first = 0;
+	while (first < recycled.size() && (recycled[first].frame + GPU_RECYCLE_FRAMES < frame || recycledBytes > GPU_MAX_RECYCLED_BYTES)) {
+		deleteObject(recycled[first].name, recycled[first].type);
+		recycledBytes -= storageBytes(recycled[first].type, recycled[first].key);
+		first++;
+	}
+	recycled.erase(recycled.begin(), recycled.begin() + first);
+}
+
+void GpuResources::deleteObject(GLuint name, GpuResourceType type)
+{
+	if (name == 0)
+		return;
+	if (type == GPU_BUFFER)
+		glDeleteBuffers(1, &name);
+	else if (type == GPU_TEXTURE)
+		glDeleteTextures(1, &name);
+	else
+		glDeleteVertexArrays(1, &name);
+}
+
+size_t GpuResources::storageBytes(GpuResourceType type, const StorageKey& key)
+{
+	if (type == GPU_BUFFER)
+		return (size_t)key.bytes;
+	if (type != GPU_TEXTURE)
+		return 0;
+	GLenum format, pixelType;
+	size_t bytes = (size_t)key.width * key.height * pixelBytes(key.format, format, pixelType);
+	// The mip chain adds about a third
+	return key.mipmapped ? bytes + bytes / 3 : bytes;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#ifndef GPURESOURCES_H
+#define GPURESOURCES_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Refers to a GL object owned by GpuResources. Slots are reused, the generation tells an old handle
+// from the one the slot was handed out for last. A default constructed handle is null
+struct GpuHandle {
+	GLuint index;
+	GLuint generation;
+
+	GpuHandle() : index(0), generation(0) {}
+
+	bool isNull() const { return generation == 0; }
+	bool operator==(const GpuHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const GpuHandle& other) const { return !(*this == other); }
+};
+
+enum GpuResourceType {
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_VERTEX_ARRAY,
+	GPU_RESOURCE_TYPE_COUNT
+};
+
+// Buffer sizes are rounded up to this, so buffers of about the same size can be recycled for each other
+const GLsizeiptr GPU_BUFFER_GRANULARITY = 256;
+// Released buffers and textures the GPU is done with are kept this long for reuse, then deleted
+const int GPU_RECYCLE_FRAMES = 120;
+// Upper limit of the memory kept for reuse
+const size_t GPU_MAX_RECYCLED_BYTES = 64 * 1024 * 1024;
+
+// Owns the buffers, textures and vertex arrays of the scene. Users hold generational handles with reference counts.
+// When the last reference goes, the GL object isn't deleted right away: frames still in flight may use it, so it waits
+// for a fence set at the end of the frame. Buffers and textures the GPU is done with are then handed out again
+// for requests of the same size and format, instead of making the driver allocate new storage.
+// Needs a current GL context for everything, not thread safe
+class GpuResources
+{
+public:
+	GpuResources();
+	~GpuResources();
+
+	// Storage of at least size bytes (rounded up to GPU_BUFFER_GRANULARITY), filled with data if that isn't NULL.
+	// Uploaded through GL_COPY_WRITE_BUFFER, so no vertex array or other binding is touched
+	GpuHandle createBuffer(GLsizeiptr size, const GLvoid* data, GLenum usage);
+	// 2D texture storage without contents (all levels if mipmapped), the caller fills it with glTexSubImage2D.
+	// A recycled texture keeps its old parameters, so set them all. The texture is left bound to GL_TEXTURE_2D
+	GpuHandle createTexture(GLenum internalFormat, GLsizei width, GLsizei height, bool mipmapped);
+	// Vertex arrays carry their attribute setup with them, so they are never recycled
+	GpuHandle createVertexArray();
+
+	// GL name of the object, 0 for a null or released handle
+	GLuint name(GpuHandle handle) const;
+	bool isValid(GpuHandle handle) const;
+	GLsizeiptr bufferSize(GpuHandle handle) const;
+
+	void addRef(GpuHandle handle);
+	// Drops a reference and nulls the handle. Null handles are ignored
+	void release(GpuHandle& handle);
+
+	// Sets a fence behind the objects released this frame and recycles the ones whose fence has passed.
+	// Call once per frame on the rendering thread, after the frame's commands are submitted
+	void endFrame();
+	// Deletes all GL objects at once, handles still held become invalid
+	void destroy();
+
+	size_t liveCount(GpuResourceType type) const { return live[type]; }
+	size_t pendingCount() const { return retired.size(); }
+	size_t recycledCount() const { return recycled.size(); }
+	void printStatistics() const;
+
+private:
+	GpuResources(const GpuResources&);
+	GpuResources& operator=(const GpuResources&);
+
+	// What a buffer or texture can be recycled for
+	struct StorageKey {
+		GLenum format;			// buffer: usage, texture: internal format
+		GLsizeiptr bytes;		// buffer: rounded size, GLsizei would wrap past 2 GB. 0 for the others
+		GLsizei width;			// texture only
+		GLsizei height;
+		bool mipmapped;
+
+		bool operator==(const StorageKey& other) const
+		{
+			return format == other.format && bytes == other.bytes && width == other.width && height == other.height && mipmapped == other.mipmapped;
+		}
+	};
+
+	struct Slot {
+		GLuint name;
+		GLuint generation;
+		GpuResourceType type;
+		StorageKey key;
+		int references;			// 0 = free slot
+	};
+
+	// A GL object nobody holds anymore
+	struct Unused {
+		GLuint name;
+		GpuResourceType type;
+		StorageKey key;
+		long long frame;		// released in (retired) or recycled in (recycled)
+	};
+
+	struct FrameFence {
+		long long frame;
+		GLsync fence;
+	};
+
+	GpuHandle allocateSlot(GLuint name, GpuResourceType type, const StorageKey& key);
+	const Slot* slotFor(GpuHandle handle) const;
+	GLuint takeRecycled(GpuResourceType type, const StorageKey& key);
+	void recycle(const Unused& object);
+	void trimRecycled();
+	void deleteObject(GLuint name, GpuResourceType type);
+	static size_t storageBytes(GpuResourceType type, const StorageKey& key);
+
+	std::vector<Slot> slots;			// index 0 is never used, so no valid handle is all zero
+	std::vector<GLuint> freeSlots;
+	std::vector<Unused> retired;		// released, waiting for the fence of their frame
+	std::vector<FrameFence> fences;		// oldest first
+	std::vector<Unused> recycled;		// GPU is done with them, free for reuse
+	long long frame;
+	size_t recycledBytes;
+	size_t live[GPU_RESOURCE_TYPE_COUNT];
+	size_t liveBytes[GPU_RESOURCE_TYPE_COUNT];
+	unsigned long long reused;
+	unsigned long long created;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "InputRecorder.h"
+
+#include <iostream>
+#include <cstring>
+
+const char INPUT_LOG_MAGIC[4] = { 'C', 'S', 'E', 'I' };
+const unsigned int INPUT_LOG_VERSION = 3;	// 3: 64 bit times, 32 bits wrapped after 71 minutes
+
+InputRecorder::InputRecorder()
+	: lastCheckpoint(-CAMERA_CHECKPOINT_INTERVAL)
+{}
+
+InputRecorder::~InputRecorder()
+{
+	close();
+}
+
+bool InputRecorder::open(const std::string& path, double timestep)
+{
+	file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cout << "ERROR::INPUTRECORDER::FILE_NOT_OPENED " << path << std::endl;
+		return false;
+	}
+	file.write(INPUT_LOG_MAGIC, sizeof(INPUT_LOG_MAGIC));
+	write(INPUT_LOG_VERSION);
+	write(timestep);
+	lastCheckpoint = -CAMERA_CHECKPOINT_INTERVAL;
+	return true;
+}
+
+void InputRecorder::close()
+{
+	if (file.is_open()) {
+		file.close();
+	}
+}
+
+void InputRecorder::recordKey(double time, int key, int action)
+{
+	if (!isRecording())
+		return;
+	writeHeader(INPUT_KEY, time);
+	write((short)key);
+	write((unsigned char)action);
+}
+
+void InputRecorder::recordMouse(double time, double x, double y)
+{
+	if (!isRecording())
+		return;
+	writeHeader(INPUT_MOUSE, time);
+	write((GLfloat)x);
+	write((GLfloat)y);
+}
+
+void InputRecorder::recordScroll(double time, double y)
+{
+	if (!isRecording())
+		return;
+	writeHeader(INPUT_SCROLL, time);
+	write((GLfloat)y);
+}
+
+void InputRecorder::recordCamera(double time, const Camera& camera)
+{
+	if (!isRecording() || time - lastCheckpoint < CAMERA_CHECKPOINT_INTERVAL)
+		return;
+	writeHeader(INPUT_CAMERA, time);
+	write(camera.Position.x);
+	write(camera.Position.y);
+	write(camera.Position.z);
+	write(camera.Yaw);
+	write(camera.Pitch);
+	write(camera.Zoom);
+	lastCheckpoint = time;
+}
+
+void InputRecorder::writeHeader(unsigned char type, double time)
+{
+	// Rounded down, so the replay (which compares against the exact step time) never applies an event a step late
+	write(type);
+	write((unsigned long long)(time * 1000000.0));
+}
+
+InputReplay::InputReplay()
+	: step(0.0), cursor(0), checkpointCursor(0), deviation(0.0f)
+{}
+
+bool InputReplay::load(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	char magic[4];
+	unsigned int version = 0;
+	if (!file.is_open() || !file.read(magic, sizeof(magic)) || memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic)) != 0
+		|| !read(file, version) || version != INPUT_LOG_VERSION || !read(file, step) || step <= 0.0) {
+		std::cout << "ERROR::INPUTREPLAY::NOT_AN_INPUT_LOG " << path << std::endl;
+		return false;
+	}
+
+	events.clear();
+	InputEvent event;
+	while (read(file, event.type) && read(file, event.time)) {
+		bool complete = true;
+		short key;
+		unsigned char action;
+		switch (event.type) {
+		case INPUT_KEY:
+			complete = read(file, key) && read(file, action);
+			event.key = key;
+			event.action = action;
+			break;
+		case INPUT_MOUSE:
+			complete = read(file, event.x) && read(file, event.y);
+			break;
+		case INPUT_SCROLL:
+			complete = read(file, event.y);
+			break;
+		case INPUT_CAMERA:
+			complete = read(file, event.position.x) && read(file, event.position.y) && read(file, event.position.z)
+				&& read(file, event.yaw) && read(file, event.pitch) && read(file, event.zoom);
+			break;
+		default:
+			complete = false;
+		}
+		if (!complete) {
+			std::cout << "ERROR::INPUTREPLAY::TRUNCATED_LOG " << path << std::endl;
+			break;
+		}
+		events.push_back(event);
+	}
+
+	cursor = 0;
+	checkpointCursor = 0;
+	deviation = 0.0f;
+	std::cout << "Replay: " << events.size() << " events, " << duration() << "s" << std::endl;
+	return !events.empty();
+}
+
+bool InputReplay::next(double time, InputEvent& event)
+{
+	while (cursor < events.size() && events[cursor].time <= time * 1000000.0) {
+		event = events[cursor++];
+		if (event.type != INPUT_CAMERA)
+			return true;
+	}
+	return false;
+}
+
+double InputReplay::duration() const
+{
+	return events.empty() ? 0.0 : events.back().time / 1000000.0;
+}
+
+void InputReplay::checkCamera(double time, const Camera& camera)
+{
+	for (; checkpointCursor < events.size() && events[checkpointCursor].time <= time * 1000000.0; checkpointCursor++) {
+		const InputEvent& checkpoint = events[checkpointCursor];
+		if (checkpoint.type == INPUT_CAMERA)
+			deviation = glm::max(deviation, glm::length(checkpoint.position - camera.Position));
+	}
+}
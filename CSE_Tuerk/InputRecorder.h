@@ -0,0 +1,97 @@
+#pragma once
+
+#ifndef INPUTRECORDER_H
+#define INPUTRECORDER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "Camera.h"
+
+// Kinds of records in an input log
+enum InputEventType {
+	INPUT_KEY = 1,		// key, action
+	INPUT_MOUSE = 2,	// cursor position x, y
+	INPUT_SCROLL = 3,	// scroll offset y
+	INPUT_CAMERA = 4	// camera state checkpoint, only used to check a replay
+};
+
+struct InputEvent {
+	unsigned char type;
+	unsigned long long time;	// simulation time in microseconds
+	int key;
+	int action;
+	GLfloat x;
+	GLfloat y;
+	glm::vec3 position;
+	GLfloat yaw;
+	GLfloat pitch;
+	GLfloat zoom;
+};
+
+// Minimum time between two camera checkpoints in a recording
+const double CAMERA_CHECKPOINT_INTERVAL = 0.25;
+
+// Writes timestamped input events and camera checkpoints into a compact binary log.
+// Layout: "CSEI", uint32 version, double simulation step, then per record uint8 type + uint64 time (us) + payload.
+// Times are simulation times (FixedTimestep::simulationTime), so a replay with the same step is exact.
+class InputRecorder
+{
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	bool open(const std::string& path, double timestep);
+	void close();
+	bool isRecording() const { return file.is_open(); }
+
+	// Input has to be stamped with the time of the step it is applied in, camera checkpoints with the time after a step
+	void recordKey(double time, int key, int action);
+	void recordMouse(double time, double x, double y);
+	void recordScroll(double time, double y);
+	void recordCamera(double time, const Camera& camera);
+
+private:
+	void writeHeader(unsigned char type, double time);
+	template <typename T> void write(T value) { file.write((const char*)&value, sizeof(T)); }
+
+	std::ofstream file;
+	double lastCheckpoint;
+};
+
+// Reads an input log back and hands out its events in time order
+class InputReplay
+{
+public:
+	InputReplay();
+
+	bool load(const std::string& path);
+	bool isLoaded() const { return !events.empty(); }
+
+	// Next input event (no checkpoints) which happened at or before the given replay time. False if there is none yet
+	bool next(double time, InputEvent& event);
+	bool finished() const { return cursor >= events.size(); }
+	double duration() const;
+	// Simulation step the log was recorded with
+	double timestep() const { return step; }
+	int stepCount() const { return (int)(duration() / step) + 1; }
+
+	// Compares the replayed camera with the recorded checkpoints up to the given time
+	void checkCamera(double time, const Camera& camera);
+	GLfloat maxDeviation() const { return deviation; }
+
+private:
+	template <typename T> bool read(std::ifstream& file, T& value) { return (bool)file.read((char*)&value, sizeof(T)); }
+
+	std::vector<InputEvent> events;
+	double step;
+	size_t cursor;
+	size_t checkpointCursor;
+	GLfloat deviation;
+};
+
+#endif
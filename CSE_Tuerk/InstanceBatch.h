@@ -0,0 +1,16 @@
+#pragma once
+
+#ifndef INSTANCEBATCH_H
+#define INSTANCEBATCH_H
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+// Instances stored next to each other in an instance buffer, drawn with one call
+struct InstanceBatch {
+	GLint first;
+	GLsizei count;
+	glm::vec3 center;		// drawn front to back by this
+};
+
+#endif
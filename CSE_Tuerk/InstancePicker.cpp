@@ -0,0 +1,313 @@
+#include "InstancePicker.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include <gtc/matrix_transform.hpp>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "BenchmarkHarness.h"
+
+// Median splits halve the instances per level, so this is enough for far more instances than fit in memory
+const int MAX_PICK_DEPTH = 64;
+
+PickRay PickRay::fromCamera(Camera& camera, const glm::mat4& projection, double cursorX, double cursorY, int width, int height)
+{
+	// Window y runs down, normalized device y up
+	glm::vec4 viewport(0.0f, 0.0f, (GLfloat)width, (GLfloat)height);
+	glm::vec3 window((GLfloat)cursorX, (GLfloat)(height - cursorY), 0.0f);
+	glm::mat4 view = camera.GetViewMatrix();
+	glm::vec3 nearPoint = glm::unProject(window, view, projection, viewport);
+	window.z = 1.0f;
+	glm::vec3 farPoint = glm::unProject(window, view, projection, viewport);
+
+	PickRay ray;
+	ray.origin = camera.Position;
+	ray.direction = glm::normalize(farPoint - nearPoint);
+	return ray;
+}
+
+InstancePicker::InstancePicker()
+	: objects(0), moved(false)
+{}
+
+int InstancePicker::addObject(const std::vector<glm::vec3>& positions, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	Object object = { boundsMin, boundsMax, (int)boxes.size() };
+	objectBounds.push_back(object);
+	boxes.reserve(boxes.size() + positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		Box box;
+		box.min = positions[i] + boundsMin;
+		box.max = positions[i] + boundsMax;
+		box.object = objects;
+		box.instance = (int)i;
+		boxes.push_back(box);
+	}
+	return objects++;
+}
+
+void InstancePicker::clear()
+{
+	boxes.clear();
+	nodes.clear();
+	objectBounds.clear();
+	boxIndex.clear();
+	objects = 0;
+	moved = false;
+}
+
+void InstancePicker::build()
+{
+	PROFILE_ZONE("BuildPicker");
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	nodes.clear();
+	if (boxes.empty())
+		return;
+	// A binary tree with n / PICK_LEAF_SIZE leaves has less than twice as many nodes
+	nodes.reserve(2 * (boxes.size() / PICK_LEAF_SIZE + 1));
+	buildNode(0, (int)boxes.size());
+
+	// The boxes are reordered now
+	boxIndex.resize(boxes.size());
+	for (size_t i = 0; i < boxes.size(); i++) {
+		boxIndex[objectBounds[boxes[i].object].first + boxes[i].instance] = (int)i;
+	}
+	moved = false;
+}
+
+void InstancePicker::moveInstance(int object, int instance, const glm::vec3& position)
+{
+	if (object < 0 || object >= objects || instance < 0 || objectBounds[object].first + instance >= (int)boxIndex.size()) {
+		std::cout << "ERROR::PICKER::NO_SUCH_INSTANCE object " << object << " instance " << instance << std::endl;
+		return;
+	}
+	Box& box = boxes[boxIndex[objectBounds[object].first + instance]];
+	box.min = position + objectBounds[object].boundsMin;
+	box.max = position + objectBounds[object].boundsMax;
+	moved = true;
+}
+
+// Children come after their parent, so going backwards every node sees its children fitted already
+void InstancePicker::refit()
+{
+	if (!moved)
+		return;
+	PROFILE_ZONE("RefitPicker");
+	for (size_t i = nodes.size(); i-- > 0;) {
+		Node& node = nodes[i];
+		if (node.count > 0) {
+			node.min = boxes[node.first].min;
+			node.max = boxes[node.first].max;
+			for (int j = node.first + 1; j < node.first + node.count; j++) {
+				node.min = glm::min(node.min, boxes[j].min);
+				node.max = glm::max(node.max, boxes[j].max);
+			}
+		}
+		else {
+			node.min = glm::min(nodes[i + 1].min, nodes[node.first].min);
+			node.max = glm::max(nodes[i + 1].max, nodes[node.first].max);
+		}
+	}
+	moved = false;
+}
+
+// Sorts boxes [first, first + count) into a subtree, returns its node
+int InstancePicker::buildNode(int first, int count)
+{
+	int index = (int)nodes.size();
+	nodes.push_back(Node());
+
+	glm::vec3 min = boxes[first].min;
+	glm::vec3 max = boxes[first].max;
+	glm::vec3 centerMin = (boxes[first].min + boxes[first].max) * 0.5f;
+	glm::vec3 centerMax = centerMin;
+	for (int i = first + 1; i < first + count; i++) {
+		min = glm::min(min, boxes[i].min);
+		max = glm::max(max, boxes[i].max);
+		glm::vec3 center = (boxes[i].min + boxes[i].max) * 0.5f;
+		centerMin = glm::min(centerMin, center);
+		centerMax = glm::max(centerMax, center);
+	}
+	nodes[index].min = min;
+	nodes[index].max = max;
+
+	if (count <= PICK_LEAF_SIZE) {
+		nodes[index].first = first;
+		nodes[index].count = count;
+		return index;
+	}
+
+	// Half of the boxes on each side of the median center along the longest axis
+	glm::vec3 size = centerMax - centerMin;
+	int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+	int half = count / 2;
+	std::nth_element(boxes.begin() + first, boxes.begin() + first + half, boxes.begin() + first + count,
+		[axis](const Box& a, const Box& b) { return a.min[axis] + a.max[axis] < b.min[axis] + b.max[axis]; });
+
+	// Depth first, so the left child lands right after this node
+	buildNode(first, half);
+	int right = buildNode(first + half, count - half);
+	nodes[index].first = right;
+	nodes[index].count = 0;
+	return index;
+}
+
+bool InstancePicker::pick(const PickRay& ray, PickHit& hit, GLfloat maxDistance) const
+{
+	if (nodes.empty())
+		return false;
+
+	glm::vec3 inverseDirection = inverse(ray.direction);
+	GLfloat nearest = maxDistance;
+	int found = -1;
+
+	// Nearer child first, subtrees starting behind the nearest hit so far are skipped
+	int stack[MAX_PICK_DEPTH];
+	int top = 0;
+	GLfloat entry;
+	if (!intersect(nodes[0].min, nodes[0].max, ray.origin, inverseDirection, nearest, entry))
+		return false;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (node.count > 0) {
+			for (int i = node.first; i < node.first + node.count; i++) {
+				GLfloat distance;
+				if (intersect(boxes[i].min, boxes[i].max, ray.origin, inverseDirection, nearest, distance)) {
+					nearest = distance;
+					found = i;
+				}
+			}
+			continue;
+		}
+
+		int left = (int)(&node - &nodes[0]) + 1;
+		int right = node.first;
+		GLfloat leftEntry, rightEntry;
+		bool hitLeft = intersect(nodes[left].min, nodes[left].max, ray.origin, inverseDirection, nearest, leftEntry);
+		bool hitRight = intersect(nodes[right].min, nodes[right].max, ray.origin, inverseDirection, nearest, rightEntry);
+		if (hitLeft && hitRight) {
+			// Pushed last, popped first
+			if (leftEntry <= rightEntry) {
+				stack[top++] = right;
+				stack[top++] = left;
+			}
+			else {
+				stack[top++] = left;
+				stack[top++] = right;
+			}
+		}
+		else if (hitLeft) {
+			stack[top++] = left;
+		}
+		else if (hitRight) {
+			stack[top++] = right;
+		}
+	}
+
+	if (found < 0)
+		return false;
+	hit.object = boxes[found].object;
+	hit.instance = boxes[found].instance;
+	hit.distance = nearest;
+	hit.point = ray.origin + ray.direction * nearest;
+	return true;
+}
+
+bool InstancePicker::pickBruteForce(const PickRay& ray, PickHit& hit, GLfloat maxDistance) const
+{
+	glm::vec3 inverseDirection = inverse(ray.direction);
+	GLfloat nearest = maxDistance;
+	int found = -1;
+	for (size_t i = 0; i < boxes.size(); i++) {
+		GLfloat distance;
+		if (intersect(boxes[i].min, boxes[i].max, ray.origin, inverseDirection, nearest, distance)) {
+			nearest = distance;
+			found = (int)i;
+		}
+	}
+
+	if (found < 0)
+		return false;
+	hit.object = boxes[found].object;
+	hit.instance = boxes[found].instance;
+	hit.distance = nearest;
+	hit.point = ray.origin + ray.direction * nearest;
+	return true;
+}
+
+// Axis-parallel rays get a tiny slope instead of an infinite inverse, which would make a NaN out of a ray running exactly in a box face
+glm::vec3 InstancePicker::inverse(const glm::vec3& direction)
+{
+	glm::vec3 result;
+	for (int axis = 0; axis < 3; axis++) {
+		GLfloat component = direction[axis];
+		if (std::abs(component) < 1e-20f)
+			component = component < 0.0f ? -1e-20f : 1e-20f;
+		result[axis] = 1.0f / component;
+	}
+	return result;
+}
+
+// Slab test. distance is where the ray enters the box, 0 if it starts inside. Only hits before maxDistance count
+bool InstancePicker::intersect(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverseDirection,
+	GLfloat maxDistance, GLfloat& distance)
+{
+	glm::vec3 t0 = (min - origin) * inverseDirection;
+	glm::vec3 t1 = (max - origin) * inverseDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	GLfloat enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	GLfloat exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+	if (enter > exit || enter >= maxDistance)
+		return false;
+	distance = enter;
+	return true;
+}
+
+// A million unit cubes spread at random, rays from above the field in random directions.
+// The first rays are checked against testing every instance
+int runPickBenchmark()
+{
+	const int COUNT = 1000000;
+	const int RAYS = 10000;
+	const int CHECKED_RAYS = 200;
+
+	seedBenchmark();
+	std::vector<glm::vec3> positions(COUNT);
+	randomPositions(positions, glm::vec3(-1000.0f, -20.0f, -1000.0f), glm::vec3(1000.0f, 20.0f, 1000.0f));
+	InstancePicker instances;
+	instances.addObject(positions, glm::vec3(-0.5f), glm::vec3(0.5f));
+	long long start = Profiler::now();
+	instances.build();
+	double buildMs = elapsedMs(start);
+
+	std::vector<PickRay> rays(RAYS);
+	for (int i = 0; i < RAYS; i++) {
+		rays[i].origin = glm::vec3((GLfloat)(std::rand() % 2000) - 1000.0f, 40.0f, (GLfloat)(std::rand() % 2000) - 1000.0f);
+		glm::vec3 direction((GLfloat)(std::rand() % 200) - 100.0f, -(GLfloat)(std::rand() % 100) - 1.0f, (GLfloat)(std::rand() % 200) - 100.0f);
+		rays[i].direction = glm::normalize(direction);
+	}
+
+	QueryTimes times(RAYS);
+	int hits = times.run([&](int i) { PickHit hit; return instances.pick(rays[i], hit); });
+
+	double bruteMs;
+	if (!checkAgainstReference<PickHit>("ERROR::PICKING::RESULT_DIFFERS ray", CHECKED_RAYS,
+		[&](int i, PickHit& hit) { return instances.pick(rays[i], hit); },
+		[&](int i, PickHit& hit) { return instances.pickBruteForce(rays[i], hit); },
+		[](const PickHit& hit, const PickHit& expected) { return std::abs(hit.distance - expected.distance) <= 1e-3f; }, bruteMs)) {
+		return 1;
+	}
+
+	std::cout << "Picking, " << COUNT << " instances: BVH of " << instances.nodeCount() << " nodes built in " << buildMs << "ms" << std::endl;
+	std::cout << "  " << RAYS << " rays, " << hits << " hits: ";
+	times.print();
+	std::cout << " (testing every instance: " << bruteMs << "ms)" << std::endl;
+	return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef INSTANCEPICKER_H
+#define INSTANCEPICKER_H
+
+#include <cstddef>
+#include <vector>
+#include <cfloat>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "Camera.h"
+
+// Instances per BVH leaf
+const int PICK_LEAF_SIZE = 4;
+
+struct PickRay {
+	glm::vec3 origin;
+	glm::vec3 direction;	// normalized
+
+	// Through a pixel of the camera's view, in window coordinates (origin top left, like the GLFW cursor).
+	// projection has to be the one the view is drawn with
+	static PickRay fromCamera(Camera& camera, const glm::mat4& projection, double cursorX, double cursorY, int width, int height);
+};
+
+struct PickHit {
+	int object;			// as returned by addObject
+	int instance;		// index into the positions the object was added with
+	GLfloat distance;	// along the ray
+	glm::vec3 point;
+};
+
+// Finds the instance a ray hits first. The instances of all objects are boxes (the object's bounds moved to each
+// position) in one bounding volume hierarchy, so a pick visits a few dozen nodes instead of every position.
+// Built once on the CPU, moved instances only refit it. Picks only read it and may run on any thread, just not
+// while instances move
+class InstancePicker
+{
+public:
+	InstancePicker();
+
+	// Instances are the local bounds moved to each position. Returns the object number used in hits.
+	// The positions are copied, build() has to run again after adding objects
+	int addObject(const std::vector<glm::vec3>& positions, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	void clear();
+	// Median splits along the longest axis of the centers, down to PICK_LEAF_SIZE instances per leaf
+	void build();
+	// Moves an instance, its box keeps its size. The nodes follow with the next refit(), until then picks may miss
+	// it. Needs build() first
+	void moveInstance(int object, int instance, const glm::vec3& position);
+	// Fits the nodes around the moved boxes again, bottom up. The tree itself stays, so picks get slower the further
+	// instances moved from where they were built. Nothing to do if nothing moved
+	void refit();
+
+	// Nearest hit up to maxDistance, false if the ray misses everything
+	bool pick(const PickRay& ray, PickHit& hit, GLfloat maxDistance = FLT_MAX) const;
+	// Same result by testing every instance, the reference for the benchmark
+	bool pickBruteForce(const PickRay& ray, PickHit& hit, GLfloat maxDistance = FLT_MAX) const;
+
+	size_t instanceCount() const { return boxes.size(); }
+	size_t nodeCount() const { return nodes.size(); }
+	int objectCount() const { return objects; }
+
+private:
+	struct Box {
+		glm::vec3 min;
+		glm::vec3 max;
+		int object;
+		int instance;
+	};
+
+	// Inner node: the left child follows it, the right one is at first. Leaf: boxes [first, first + count)
+	struct Node {
+		glm::vec3 min;
+		int first;
+		glm::vec3 max;
+		int count;		// 0 for inner nodes
+	};
+
+	// Local bounds of an object and where its instances start in boxIndex
+	struct Object {
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		int first;
+	};
+
+	int buildNode(int first, int count);
+	static glm::vec3 inverse(const glm::vec3& direction);
+	static bool intersect(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin, const glm::vec3& inverseDirection,
+		GLfloat maxDistance, GLfloat& distance);
+
+	std::vector<Box> boxes;		// reordered by build() so each leaf's boxes are next to each other
+	std::vector<Node> nodes;	// root first
+	std::vector<Object> objectBounds;
+	std::vector<int> boxIndex;	// first of the object + instance -> its box, set by build()
+	int objects;
+	bool moved;					// boxes moved since the nodes were fitted
+};
+
+// --bench-pick: times rays against a million instances, returns the exit code
+int runPickBenchmark();
+
+#endif
@@ -15,18 +15,8 @@ public:
 	{}
 
 protected:
-	void prepareVertices()
-	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof_vertices, vertices, GL_STATIC_DRAW);
-		// Position attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
-		glBindVertexArray(0); // Unbind cubeVAO
-	}
+	// Position only vertex format, the same cube as Cube without texture coordinates (shares its buffer)
+	VertexLayout vertexLayout() const { return VertexLayout::positions(); }
 };
 
 #endif
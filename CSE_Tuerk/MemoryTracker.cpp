@@ -0,0 +1,342 @@
+#include "MemoryTracker.h"
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <iostream>
+#include <iomanip>
+
+#if MEMORY_TRACKING_ENABLED
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#else
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+#endif
+
+const int MAX_STACK_FRAMES = 24;
+
+static const char* TAG_NAMES[MEMORY_TAG_COUNT] = { "General", "Scene", "Renderer", "Images", "Capture", "Profiler" };
+
+// Zero-initialized before any constructor runs, so allocations during static initialization are counted as well
+struct TagCounters {
+	std::atomic<long long> liveBytes;
+	std::atomic<long long> peakBytes;
+	std::atomic<long long> liveAllocations;
+	std::atomic<unsigned long long> allocations;
+};
+static TagCounters counters[MEMORY_TAG_COUNT];
+
+static thread_local int currentTag = MEMORY_TAG_GENERAL;
+
+// Frame check state
+static std::atomic<bool> checkFrames(false);
+static std::atomic<unsigned long long> inFrameAllocations(0);
+static std::atomic<int> reportedFrames(0);
+static std::mutex reportMutex;
+static thread_local bool inFrame = false;
+static thread_local bool reporting = false;		// allocations made while printing a report aren't reported again
+static thread_local int threadFrames = 0;
+static thread_local unsigned long long frameCount = 0;
+static thread_local unsigned long long frameBytes = 0;
+
+MemoryTagStats MemoryTracker::statistics(MemoryTag tag)
+{
+	MemoryTagStats stats;
+	stats.liveBytes = counters[tag].liveBytes.load();
+	stats.peakBytes = counters[tag].peakBytes.load();
+	stats.liveAllocations = counters[tag].liveAllocations.load();
+	stats.allocations = counters[tag].allocations.load();
+	return stats;
+}
+
+const char* MemoryTracker::tagName(MemoryTag tag)
+{
+	return tag >= 0 && tag < MEMORY_TAG_COUNT ? TAG_NAMES[tag] : "?";
+}
+
+void MemoryTracker::printStatistics()
+{
+#if MEMORY_TRACKING_ENABLED
+	std::cout << "Memory     live KB    peak KB   blocks  allocations" << std::endl;
+	for (int tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+		MemoryTagStats stats = statistics((MemoryTag)tag);
+		std::cout << std::left << std::setw(9) << TAG_NAMES[tag] << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << stats.liveBytes / 1024.0 << std::setw(11) << stats.peakBytes / 1024.0
+			<< std::setw(9) << stats.liveAllocations << std::setw(13) << stats.allocations << std::endl;
+	}
+	if (checkFrames) {
+		std::cout << inFrameAllocations.load() << " allocations inside frames" << std::endl;
+	}
+#else
+	std::cout << "Memory tracking is compiled out (MEMORY_TRACKING_ENABLED 0)" << std::endl;
+#endif
+}
+
+MemoryTag MemoryTracker::threadTag()
+{
+	return (MemoryTag)currentTag;
+}
+
+void MemoryTracker::setThreadTag(MemoryTag tag)
+{
+	currentTag = tag;
+}
+
+void MemoryTracker::enableFrameChecks(bool enable)
+{
+	checkFrames = enable;
+}
+
+bool MemoryTracker::frameChecksEnabled()
+{
+	return checkFrames;
+}
+
+void MemoryTracker::beginFrame()
+{
+	threadFrames++;
+	inFrame = threadFrames > MEMORY_CHECK_WARMUP_FRAMES;
+	frameCount = 0;
+	frameBytes = 0;
+}
+
+void MemoryTracker::endFrame()
+{
+	inFrame = false;
+	if (frameCount > 0 && ++reportedFrames <= MAX_FRAME_ALLOCATION_REPORTS) {
+		std::lock_guard<std::mutex> lock(reportMutex);
+		reporting = true;
+		std::cout << "ERROR::MEMORY::FRAME_ALLOCATIONS frame " << threadFrames << ": " << frameCount << " allocations, " << frameBytes << " bytes" << std::endl;
+		reporting = false;
+	}
+}
+
+unsigned long long MemoryTracker::frameAllocations()
+{
+	return inFrameAllocations;
+}
+
+#if MEMORY_TRACKING_ENABLED
+
+// In front of every block. 16 bytes keep the alignment malloc gives
+struct AllocationHeader {
+	size_t size;
+	int tag;
+};
+const size_t HEADER_SIZE = 16;
+static_assert(sizeof(AllocationHeader) <= HEADER_SIZE, "the header has to fit in front of the block");
+
+static void printCallStack()
+{
+	void* frames[MAX_STACK_FRAMES];
+#ifdef _WIN32
+	USHORT count = CaptureStackBackTrace(3, MAX_STACK_FRAMES, frames, NULL);
+	HANDLE process = GetCurrentProcess();
+	static bool symbolsLoaded = false;
+	if (!symbolsLoaded) {
+		SymSetOptions(SYMOPT_UNDNAME | SYMOPT_LOAD_LINES | SYMOPT_DEFERRED_LOADS);
+		SymInitialize(process, NULL, TRUE);
+		symbolsLoaded = true;
+	}
+
+	char buffer[sizeof(SYMBOL_INFO) + 256];
+	SYMBOL_INFO* symbol = (SYMBOL_INFO*)buffer;
+	for (USHORT i = 0; i < count; i++) {
+		DWORD64 address = (DWORD64)frames[i];
+		symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		symbol->MaxNameLen = 255;
+		std::cout << "    " << (SymFromAddr(process, address, NULL, symbol) ? symbol->Name : "?");
+		IMAGEHLP_LINE64 line;
+		line.SizeOfStruct = sizeof(line);
+		DWORD displacement;
+		if (SymGetLineFromAddr64(process, address, &displacement, &line)) {
+			std::cout << " (" << line.FileName << ":" << line.LineNumber << ")";
+		}
+		std::cout << std::endl;
+	}
+#else
+	int count = backtrace(frames, MAX_STACK_FRAMES);
+	std::cout.flush();
+	if (count > 3) {
+		backtrace_symbols_fd(frames + 3, count - 3, STDOUT_FILENO);
+	}
+#endif
+}
+
+// Called for every allocation, only does something inside a frame of this thread
+static void checkFrameAllocation(size_t size, int tag)
+{
+	if (!inFrame || reporting || !checkFrames)
+		return;
+	frameCount++;
+	frameBytes += size;
+	if (++inFrameAllocations > MAX_FRAME_ALLOCATION_REPORTS)
+		return;
+
+	std::lock_guard<std::mutex> lock(reportMutex);
+	reporting = true;
+	std::cout << "ERROR::MEMORY::ALLOCATION_IN_FRAME " << size << " bytes (" << TAG_NAMES[tag] << "), frame " << threadFrames << std::endl;
+	printCallStack();
+	reporting = false;
+}
+
+static void countAllocation(int tag, long long size)
+{
+	TagCounters& tagCounters = counters[tag];
+	long long live = tagCounters.liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	long long peak = tagCounters.peakBytes.load(std::memory_order_relaxed);
+	while (live > peak && !tagCounters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+	}
+}
+
+static void* trackedAllocate(size_t size, int tag)
+{
+	AllocationHeader* header = static_cast<AllocationHeader*>(malloc(size + HEADER_SIZE));
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+	header->tag = tag;
+
+	countAllocation(tag, (long long)size);
+	counters[tag].liveAllocations.fetch_add(1, std::memory_order_relaxed);
+	counters[tag].allocations.fetch_add(1, std::memory_order_relaxed);
+	checkFrameAllocation(size, tag);
+	return reinterpret_cast<char*>(header) + HEADER_SIZE;
+}
+
+static AllocationHeader* headerOf(void* memory)
+{
+	return reinterpret_cast<AllocationHeader*>(static_cast<char*>(memory) - HEADER_SIZE);
+}
+
+static void* trackedReallocate(void* memory, size_t size, int tag)
+{
+	if (memory == NULL)
+		return trackedAllocate(size, tag);
+
+	AllocationHeader* header = headerOf(memory);
+	size_t oldSize = header->size;
+	tag = header->tag;
+	header = static_cast<AllocationHeader*>(realloc(header, size + HEADER_SIZE));
+	if (header == NULL)
+		return NULL;
+	header->size = size;
+
+	countAllocation(tag, (long long)size - (long long)oldSize);
+	counters[tag].allocations.fetch_add(1, std::memory_order_relaxed);
+	checkFrameAllocation(size, tag);
+	return reinterpret_cast<char*>(header) + HEADER_SIZE;
+}
+
+static void trackedFree(void* memory)
+{
+	if (memory == NULL)
+		return;
+	AllocationHeader* header = headerOf(memory);
+	counters[header->tag].liveBytes.fetch_sub((long long)header->size, std::memory_order_relaxed);
+	counters[header->tag].liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+	free(header);
+}
+
+// Replaced global allocation functions, everything allocated with new in the program goes through here
+
+void* operator new(size_t size)
+{
+	void* memory = trackedAllocate(size, currentTag);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	void* memory = trackedAllocate(size, currentTag);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size, currentTag);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return trackedAllocate(size, currentTag);
+}
+
+void operator delete(void* memory) noexcept
+{
+	trackedFree(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	trackedFree(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept
+{
+	trackedFree(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept
+{
+	trackedFree(memory);
+}
+
+#if defined(__cpp_sized_deallocation) || (defined(_MSC_VER) && _MSC_VER >= 1900)
+void operator delete(void* memory, size_t) noexcept
+{
+	trackedFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+	trackedFree(memory);
+}
+#endif
+
+// SOIL and stb_image call these instead of malloc/realloc/free when built with SOIL_TRACKED_ALLOCATOR
+extern "C" void* soil_tracked_malloc(size_t size)
+{
+	return trackedAllocate(size, MEMORY_TAG_IMAGES);
+}
+
+extern "C" void* soil_tracked_realloc(void* memory, size_t size)
+{
+	return trackedReallocate(memory, size, MEMORY_TAG_IMAGES);
+}
+
+extern "C" void soil_tracked_free(void* memory)
+{
+	trackedFree(memory);
+}
+
+#else
+
+extern "C" void* soil_tracked_malloc(size_t size)
+{
+	return malloc(size);
+}
+
+extern "C" void* soil_tracked_realloc(void* memory, size_t size)
+{
+	return realloc(memory, size);
+}
+
+extern "C" void soil_tracked_free(void* memory)
+{
+	free(memory);
+}
+
+#endif
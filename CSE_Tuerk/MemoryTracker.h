@@ -0,0 +1,78 @@
+#pragma once
+
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+// Set to 0 to keep the default global new/delete
+#ifndef MEMORY_TRACKING_ENABLED
+#define MEMORY_TRACKING_ENABLED 1
+#endif
+
+// What an allocation is counted as: the tag of the allocating thread's innermost MEMORY_TAG scope
+enum MemoryTag {
+	MEMORY_TAG_GENERAL,		// no scope
+	MEMORY_TAG_SCENE,		// objects, positions, instance data
+	MEMORY_TAG_RENDERER,	// render graph, shaders, lighting
+	MEMORY_TAG_IMAGES,		// SOIL / stb_image, routed in through soil_tracked_malloc
+	MEMORY_TAG_CAPTURE,		// screenshots, video
+	MEMORY_TAG_PROFILER,
+	MEMORY_TAG_COUNT
+};
+
+// Frames at the start of each thread which may allocate (first graph compile, lists growing to their size)
+const int MEMORY_CHECK_WARMUP_FRAMES = 5;
+// Allocations inside frames which get their call stack printed, later ones are only counted
+const int MAX_FRAME_ALLOCATION_REPORTS = 16;
+
+struct MemoryTagStats {
+	long long liveBytes;
+	long long peakBytes;
+	long long liveAllocations;
+	unsigned long long allocations;		// ever made
+};
+
+// Counts all heap memory per tag. Global new/delete are replaced (MemoryTracker.cpp), every block carries
+// a small header with its size and tag. Aligned allocations (AlignedAllocator.h) go through new as well.
+// The frame check is a debug mode: every heap allocation between beginFrame() and endFrame() on the same
+// thread is reported with its call stack, the steady state is supposed to need none
+class MemoryTracker
+{
+public:
+	static MemoryTagStats statistics(MemoryTag tag);
+	static const char* tagName(MemoryTag tag);
+	// Live / peak bytes and allocation counts per tag
+	static void printStatistics();
+
+	static MemoryTag threadTag();
+	static void setThreadTag(MemoryTag tag);
+
+	static void enableFrameChecks(bool enable);
+	static bool frameChecksEnabled();
+	// Frames may not nest, each thread has its own
+	static void beginFrame();
+	static void endFrame();
+	// Allocations found inside frames so far
+	static unsigned long long frameAllocations();
+};
+
+// Counts the allocations of the enclosing scope as tag (on this thread)
+class MemoryTagScope
+{
+public:
+	explicit MemoryTagScope(MemoryTag tag) : previous(MemoryTracker::threadTag()) { MemoryTracker::setThreadTag(tag); }
+	~MemoryTagScope() { MemoryTracker::setThreadTag(previous); }
+
+private:
+	MemoryTag previous;
+};
+
+#define MEMORY_CONCAT_INNER(a, b) a##b
+#define MEMORY_CONCAT(a, b) MEMORY_CONCAT_INNER(a, b)
+
+#if MEMORY_TRACKING_ENABLED
+#define MEMORY_TAG(tag) MemoryTagScope MEMORY_CONCAT(memoryTag, __LINE__)(tag)
+#else
+#define MEMORY_TAG(tag)
+#endif
+
+#endif
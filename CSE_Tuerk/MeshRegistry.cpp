@@ -0,0 +1,273 @@
+#include "MeshRegistry.h"
+
+#include <iostream>
+#include <cstring>
+
+#include "MemoryTracker.h"
+
+// 64 bit FNV-1a
+const unsigned long long HASH_OFFSET = 14695981039346656037ULL;
+const unsigned long long HASH_PRIME = 1099511628211ULL;
+
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= HASH_PRIME;
+	}
+	return hash;
+}
+
+bool VertexLayout::operator==(const VertexLayout& other) const
+{
+	if (stride != other.stride || attributeCount != other.attributeCount)
+		return false;
+	for (int i = 0; i < attributeCount; i++) {
+		if (attributes[i].location != other.attributes[i].location || attributes[i].components != other.attributes[i].components
+			|| attributes[i].offset != other.attributes[i].offset)
+			return false;
+	}
+	return true;
+}
+
+MeshRegistry::MeshRegistry(GpuResources* _resources)
+	: resources(_resources), requestedBytes(0)
+{}
+
+MeshRegistry::~MeshRegistry()
+{
+	if (!meshes.empty()) {
+		std::cout << "ERROR::MESHREGISTRY::LEAK " << meshes.size() << " meshes still registered" << std::endl;
+	}
+	for (std::multimap<unsigned long long, Mesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it) {
+		resources->release(it->second->vertexArray);
+		resources->release(it->second->vertexBuffer);
+		resources->release(it->second->elementBuffer);
+		delete it->second;
+	}
+}
+
+Mesh* MeshRegistry::acquire(const GLfloat* vertices, size_t sizeofVertices, const GLuint* indices, size_t sizeofIndices, const VertexLayout& layout, GLuint flags)
+{
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	if (layout.stride == 0) {
+		std::cout << "ERROR::MESHREGISTRY::EMPTY_LAYOUT" << std::endl;
+		return NULL;
+	}
+
+	Mesh* mesh = new Mesh();
+	mesh->layout = layout;
+	mesh->bufferLayout = layout;
+	mesh->vertices.assign(vertices, vertices + sizeofVertices / sizeof(GLfloat));
+	if (indices != NULL) {
+		mesh->indices.assign(indices, indices + sizeofIndices / sizeof(GLuint));
+	}
+	mesh->vertexCount = (GLsizei)(mesh->vertices.size() / layout.stride);
+	mesh->indexCount = (GLsizei)mesh->indices.size();
+	mesh->flags = flags;
+	mesh->ownsBuffer = false;
+	mesh->references = 1;
+	hashMesh(*mesh);
+	requestedBytes += sizeofVertices + sizeofIndices;
+
+	Mesh* existing = findExact(*mesh);
+	if (existing != NULL) {
+		delete mesh;
+		existing->references++;
+		// Has to stay packed for the new user as well
+		existing->flags |= flags & MESH_PACKED;
+		return existing;
+	}
+
+	Mesh* superset = (flags & MESH_PACKED) ? NULL : findSuperset(*mesh);
+	if (superset != NULL) {
+		// View: another VAO over the superset's buffers
+		mesh->bufferLayout = superset->bufferLayout;
+		mesh->vertexBuffer = superset->vertexBuffer;
+		mesh->elementBuffer = superset->elementBuffer;
+		resources->addRef(mesh->vertexBuffer);
+		resources->addRef(mesh->elementBuffer);
+		setupVertexArray(mesh);
+	}
+	else {
+		upload(mesh);
+		if (!(flags & MESH_PACKED)) {
+			adoptSubsets(mesh);
+		}
+	}
+	meshes.insert(std::make_pair(mesh->hash, mesh));
+	return mesh;
+}
+
+void MeshRegistry::release(Mesh* mesh)
+{
+	if (mesh == NULL)
+		return;
+	requestedBytes -= mesh->vertices.size() * sizeof(GLfloat) + mesh->indices.size() * sizeof(GLuint);
+	if (--mesh->references > 0)
+		return;
+
+	// Views of this mesh hold references of their own to the buffers, so only the last user frees them
+	resources->release(mesh->vertexArray);
+	resources->release(mesh->vertexBuffer);
+	resources->release(mesh->elementBuffer);
+	std::pair<std::multimap<unsigned long long, Mesh*>::iterator, std::multimap<unsigned long long, Mesh*>::iterator> range = meshes.equal_range(mesh->hash);
+	for (std::multimap<unsigned long long, Mesh*>::iterator it = range.first; it != range.second; ++it) {
+		if (it->second == mesh) {
+			meshes.erase(it);
+			break;
+		}
+	}
+	delete mesh;
+}
+
+size_t MeshRegistry::uploadedBytes() const
+{
+	size_t bytes = 0;
+	for (std::multimap<unsigned long long, Mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
+		if (it->second->ownsBuffer) {
+			bytes += it->second->vertices.size() * sizeof(GLfloat) + it->second->indices.size() * sizeof(GLuint);
+		}
+	}
+	return bytes;
+}
+
+void MeshRegistry::printStatistics() const
+{
+	size_t views = 0;
+	for (std::multimap<unsigned long long, Mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
+		if (!it->second->ownsBuffer)
+			views++;
+	}
+	std::cout << "MeshRegistry: " << meshes.size() << " meshes (" << views << " views), "
+		<< uploadedBytes() << " bytes uploaded for " << requestedBytes << " bytes registered" << std::endl;
+}
+
+Mesh* MeshRegistry::findExact(const Mesh& candidate) const
+{
+	std::pair<std::multimap<unsigned long long, Mesh*>::const_iterator, std::multimap<unsigned long long, Mesh*>::const_iterator> range = meshes.equal_range(candidate.hash);
+	for (std::multimap<unsigned long long, Mesh*>::const_iterator it = range.first; it != range.second; ++it) {
+		const Mesh& mesh = *it->second;
+		if (!(mesh.layout == candidate.layout) || mesh.vertices != candidate.vertices || mesh.indices != candidate.indices)
+			continue;
+		// A packed request can't share a view into a wider buffer
+		if ((candidate.flags & MESH_PACKED) && !(mesh.bufferLayout == mesh.layout))
+			continue;
+		return it->second;
+	}
+	return NULL;
+}
+
+Mesh* MeshRegistry::findSuperset(const Mesh& candidate) const
+{
+	for (std::multimap<unsigned long long, Mesh*>::const_iterator it = meshes.begin(); it != meshes.end(); ++it) {
+		if (isSubset(candidate, *it->second))
+			return it->second;
+	}
+	return NULL;
+}
+
+// Same vertices and indices, and every attribute of subset is in superset with the same values
+bool MeshRegistry::isSubset(const Mesh& subset, const Mesh& superset)
+{
+	if (&subset == &superset || subset.vertexCount != superset.vertexCount || subset.indices != superset.indices
+		|| subset.layout.attributeCount >= superset.layout.attributeCount)
+		return false;
+
+	for (int a = 0; a < subset.layout.attributeCount; a++) {
+		const VertexAttribute& attribute = subset.layout.attributes[a];
+		const VertexAttribute* match = superset.layout.find(attribute.location);
+		if (match == NULL || match->components != attribute.components
+			|| subset.attributeHashes[a] != superset.attributeHashes[match - superset.layout.attributes])
+			return false;
+
+		for (GLsizei v = 0; v < subset.vertexCount; v++) {
+			const GLfloat* own = &subset.vertices[v * subset.layout.stride + attribute.offset];
+			const GLfloat* other = &superset.vertices[v * superset.layout.stride + match->offset];
+			if (memcmp(own, other, attribute.components * sizeof(GLfloat)) != 0)
+				return false;
+		}
+	}
+	return true;
+}
+
+void MeshRegistry::upload(Mesh* mesh)
+{
+	mesh->vertexBuffer = resources->createBuffer(mesh->vertices.size() * sizeof(GLfloat), &mesh->vertices[0], GL_STATIC_DRAW);
+	if (!mesh->indices.empty()) {
+		mesh->elementBuffer = resources->createBuffer(mesh->indices.size() * sizeof(GLuint), &mesh->indices[0], GL_STATIC_DRAW);
+	}
+	mesh->ownsBuffer = true;
+	setupVertexArray(mesh);
+}
+
+// Earlier meshes whose data is part of mesh drop their own buffers and read from mesh's instead
+void MeshRegistry::adoptSubsets(Mesh* mesh)
+{
+	for (std::multimap<unsigned long long, Mesh*>::iterator it = meshes.begin(); it != meshes.end(); ++it) {
+		Mesh* subset = it->second;
+		if (!subset->ownsBuffer || (subset->flags & MESH_PACKED) || !isSubset(*subset, *mesh))
+			continue;
+
+		resources->release(subset->vertexBuffer);
+		resources->release(subset->elementBuffer);
+		subset->bufferLayout = mesh->bufferLayout;
+		subset->vertexBuffer = mesh->vertexBuffer;
+		subset->elementBuffer = mesh->elementBuffer;
+		resources->addRef(subset->vertexBuffer);
+		resources->addRef(subset->elementBuffer);
+		subset->ownsBuffer = false;
+		// Same VAO, the users keep their handle
+		setupVertexArray(subset);
+	}
+}
+
+// Points the layout's attributes at where they are in the buffer
+void MeshRegistry::setupVertexArray(Mesh* mesh)
+{
+	if (mesh->vertexArray.isNull()) {
+		mesh->vertexArray = resources->createVertexArray();
+	}
+	GLsizei stride = mesh->bufferLayout.stride * sizeof(GLfloat);
+
+	glBindVertexArray(resources->name(mesh->vertexArray));
+	glBindBuffer(GL_ARRAY_BUFFER, resources->name(mesh->vertexBuffer));
+	for (int a = 0; a < mesh->layout.attributeCount; a++) {
+		const VertexAttribute& attribute = mesh->layout.attributes[a];
+		const VertexAttribute* stored = mesh->bufferLayout.find(attribute.location);
+		glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(stored->offset * sizeof(GLfloat)));
+		glEnableVertexAttribArray(attribute.location);
+	}
+	// The element buffer binding is part of the VAO, keep it bound until the VAO is unbound
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources->name(mesh->elementBuffer));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshRegistry::hashMesh(Mesh& mesh)
+{
+	const VertexLayout& layout = mesh.layout;
+	unsigned long long hash = HASH_OFFSET;
+	hash = hashBytes(hash, &layout.stride, sizeof(layout.stride));
+	for (int a = 0; a < layout.attributeCount; a++) {
+		hash = hashBytes(hash, &layout.attributes[a], sizeof(VertexAttribute));
+	}
+	if (!mesh.vertices.empty())
+		hash = hashBytes(hash, &mesh.vertices[0], mesh.vertices.size() * sizeof(GLfloat));
+	if (!mesh.indices.empty())
+		hash = hashBytes(hash, &mesh.indices[0], mesh.indices.size() * sizeof(GLuint));
+	mesh.hash = hash;
+
+	// Each attribute on its own, independent of where it sits in the vertex
+	for (int a = 0; a < layout.attributeCount; a++) {
+		const VertexAttribute& attribute = layout.attributes[a];
+		unsigned long long attributeHash = HASH_OFFSET;
+		attributeHash = hashBytes(attributeHash, &attribute.location, sizeof(attribute.location));
+		attributeHash = hashBytes(attributeHash, &attribute.components, sizeof(attribute.components));
+		for (GLsizei v = 0; v < mesh.vertexCount; v++) {
+			attributeHash = hashBytes(attributeHash, &mesh.vertices[v * layout.stride + attribute.offset], attribute.components * sizeof(GLfloat));
+		}
+		mesh.attributeHashes[a] = attributeHash;
+	}
+}
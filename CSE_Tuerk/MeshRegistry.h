@@ -0,0 +1,126 @@
+#pragma once
+
+#ifndef MESHREGISTRY_H
+#define MESHREGISTRY_H
+
+#include <cstddef>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+
+#include "GpuResources.h"
+
+const int MAX_VERTEX_ATTRIBUTES = 4;
+
+// One float attribute of an interleaved vertex
+struct VertexAttribute {
+	GLuint location;
+	GLint components;
+	GLuint offset;		// in floats from the start of the vertex
+};
+
+// Interleaved float vertex format. Attributes are added in the order they sit in the vertex
+struct VertexLayout {
+	GLuint stride;		// floats per vertex
+	int attributeCount;
+	VertexAttribute attributes[MAX_VERTEX_ATTRIBUTES];
+
+	VertexLayout() : stride(0), attributeCount(0) {}
+
+	VertexLayout& add(GLuint location, GLint components)
+	{
+		if (attributeCount < MAX_VERTEX_ATTRIBUTES) {
+			VertexAttribute attribute = { location, components, stride };
+			attributes[attributeCount++] = attribute;
+			stride += components;
+		}
+		return *this;
+	}
+
+	// Attribute at location, NULL if the layout doesn't have it
+	const VertexAttribute* find(GLuint location) const
+	{
+		for (int i = 0; i < attributeCount; i++) {
+			if (attributes[i].location == location)
+				return &attributes[i];
+		}
+		return NULL;
+	}
+
+	bool operator==(const VertexLayout& other) const;
+
+	// The formats of object.vs: position (0), position (0) + texture coordinates (1)
+	static VertexLayout positions() { return VertexLayout().add(0, 3); }
+	static VertexLayout positionsUV() { return VertexLayout().add(0, 3).add(1, 2); }
+};
+
+// acquire() flags
+enum MeshFlag {
+	MESH_PACKED = 1 << 0		// keep the vertices tightly packed in their own buffer, never a view into a wider format (e.g. depth-only streams)
+};
+
+// Geometry on the GPU, shared by everyone who registered the same content. Read-only for the users
+struct Mesh {
+	GpuHandle vertexArray;		// attributes of layout, set up for drawing
+	GpuHandle vertexBuffer;		// may hold a wider vertex format than layout (view)
+	GpuHandle elementBuffer;	// null without indices
+	GLsizei vertexCount;
+	GLsizei indexCount;
+	VertexLayout layout;		// as registered
+
+private:
+	friend class MeshRegistry;
+
+	VertexLayout bufferLayout;	// format in vertexBuffer, layout's attributes are found there by location
+	std::vector<GLfloat> vertices;	// kept to compare against, the hash alone could collide
+	std::vector<GLuint> indices;
+	unsigned long long hash;
+	unsigned long long attributeHashes[MAX_VERTEX_ATTRIBUTES];	// per attribute of layout, to find views
+	GLuint flags;
+	bool ownsBuffer;			// uploaded for this mesh, otherwise a view into another mesh's buffer
+	int references;
+};
+
+// Deduplicates geometry. Meshes are hashed by vertex and index content together with the vertex layout, registering
+// the same data again returns the existing mesh with its buffers and VAO. If a layout only has a subset of the
+// attributes of a registered mesh with matching data (e.g. position only vs. position + UV), the new mesh becomes a
+// view: its own VAO, but reading the other mesh's buffer. A mesh which arrives with a superset takes over the buffer of
+// earlier subsets, so GPU memory grows with the unique geometry, whatever order the objects are created in.
+// The VAO is shared, users which add their own attributes (instance data) have to set their pointers before drawing.
+// Needs a current GL context, not thread safe
+class MeshRegistry
+{
+public:
+	explicit MeshRegistry(GpuResources* _resources);
+	~MeshRegistry();
+
+	// sizeofIndices 0 for non-indexed geometry. The data is copied
+	Mesh* acquire(const GLfloat* vertices, size_t sizeofVertices, const GLuint* indices, size_t sizeofIndices, const VertexLayout& layout, GLuint flags = 0);
+	void release(Mesh* mesh);
+
+	GpuResources* gpuResources() const { return resources; }
+	size_t meshCount() const { return meshes.size(); }
+	// Vertex and index bytes uploaded, and what separate buffers per registration would have taken
+	size_t uploadedBytes() const;
+	size_t registeredBytes() const { return requestedBytes; }
+	void printStatistics() const;
+
+private:
+	MeshRegistry(const MeshRegistry&);
+	MeshRegistry& operator=(const MeshRegistry&);
+
+	Mesh* findExact(const Mesh& candidate) const;
+	Mesh* findSuperset(const Mesh& candidate) const;
+	static bool isSubset(const Mesh& subset, const Mesh& superset);
+	void upload(Mesh* mesh);
+	void adoptSubsets(Mesh* mesh);
+	void setupVertexArray(Mesh* mesh);
+	static void hashMesh(Mesh& mesh);
+
+	GpuResources* resources;
+	std::multimap<unsigned long long, Mesh*> meshes;	// content hash -> mesh
+	size_t requestedBytes;		// sum over all live registrations
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "ObjectPool.h"
+
+#include "AlignedAllocator.h"
+
+// Blocks keep the alignment malloc would give
+const size_t BLOCK_ALIGNMENT = 16;
+
+ObjectPool::ObjectPool(size_t _blockSize, size_t _blocksPerChunk)
+	: blockSize((_blockSize + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1)), blocksPerChunk(_blocksPerChunk > 0 ? _blocksPerChunk : 1),
+	freeList(NULL), live(0)
+{
+	if (blockSize < sizeof(FreeBlock))
+		blockSize = BLOCK_ALIGNMENT;
+}
+
+ObjectPool::~ObjectPool()
+{
+	if (live != 0) {
+		std::cout << "ERROR::OBJECTPOOL::LEAK " << live << " objects still alive" << std::endl;
+	}
+	for (size_t i = 0; i < chunks.size(); i++)
+		alignedFree(chunks[i]);
+}
+
+void* ObjectPool::allocate(size_t size)
+{
+	if (size > blockSize)
+		return NULL;
+	if (freeList == NULL) {
+		addChunk();
+		if (freeList == NULL)
+			throw std::bad_alloc();
+	}
+
+	FreeBlock* block = freeList;
+	freeList = block->next;
+	live++;
+	return block;
+}
+
+void ObjectPool::deallocate(void* memory)
+{
+	if (memory == NULL)
+		return;
+	FreeBlock* block = static_cast<FreeBlock*>(memory);
+	block->next = freeList;
+	freeList = block;
+	live--;
+}
+
+void ObjectPool::addChunk()
+{
+	char* chunk = static_cast<char*>(alignedAlloc(blockSize * blocksPerChunk, SIMD_ALIGNMENT));
+	if (chunk == NULL)
+		return;
+	chunks.push_back(chunk);
+
+	// Linked back to front, so the blocks are handed out in address order
+	for (size_t i = blocksPerChunk; i-- > 0;) {
+		FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * blockSize);
+		block->next = freeList;
+		freeList = block;
+	}
+}
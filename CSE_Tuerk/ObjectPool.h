@@ -0,0 +1,66 @@
+#pragma once
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <cstddef>
+#include <vector>
+#include <new>
+#include <utility>
+#include <iostream>
+
+// Blocks of one fixed size for objects which come and go, e.g. render objects. Blocks are carved out of larger chunks,
+// freed blocks are handed out again first, so once the pool has grown creating an object doesn't call the heap.
+// Chunks are only released with the pool. Not thread safe
+class ObjectPool
+{
+public:
+	ObjectPool(size_t _blockSize, size_t _blocksPerChunk = 64);
+	~ObjectPool();
+
+	// NULL if size is larger than the block size
+	void* allocate(size_t size);
+	void deallocate(void* memory);
+
+	template <typename T, typename... Args>
+	T* create(Args&&... args)
+	{
+		void* memory = allocate(sizeof(T));
+		if (memory == NULL) {
+			std::cout << "ERROR::OBJECTPOOL::OBJECT_TOO_LARGE " << sizeof(T) << " > " << blockSize << " bytes" << std::endl;
+			return NULL;
+		}
+		return new (memory) T(std::forward<Args>(args)...);
+	}
+
+	// object may be a base class pointer if the destructor is virtual
+	template <typename T>
+	void destroy(T* object)
+	{
+		if (object == NULL)
+			return;
+		object->~T();
+		deallocate(object);
+	}
+
+	size_t liveCount() const { return live; }
+	size_t chunkCount() const { return chunks.size(); }
+
+private:
+	ObjectPool(const ObjectPool&);
+	ObjectPool& operator=(const ObjectPool&);
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	void addChunk();
+
+	size_t blockSize;
+	size_t blocksPerChunk;
+	std::vector<char*> chunks;
+	FreeBlock* freeList;
+	size_t live;
+};
+
+#endif
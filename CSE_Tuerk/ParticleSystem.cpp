@@ -0,0 +1,323 @@
+#include "ParticleSystem.h"
+
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+#include <gtc/type_ptr.hpp>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "BenchmarkHarness.h"
+
+ParticleSystem::ParticleSystem(size_t _capacity, ThreadPool* _threadPool, unsigned int seed)
+	: threadPool(_threadPool), gravity(0.0f, -9.81f, 0.0f), damping(1.0f), random(seed != 0 ? seed : 1), runningJob(NULL), jobKernels(NULL),
+	jobStep(0.0f), jobDamping(1.0f), packTarget(NULL), dropped(0)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	positions.resize(_capacity);
+	velocities.resize(_capacity);
+	life.resize(_capacity, 0.0f);
+	inverseLifetime.resize(_capacity, 1.0f);
+	colors.resize(_capacity, 0);
+	alive.resize(_capacity, 0);
+
+	// Handed out from the back, so the first particles are at the start of the storage
+	freeList.resize(_capacity);
+	for (size_t i = 0; i < _capacity; i++) {
+		freeList[i] = (int)(_capacity - 1 - i);
+	}
+
+	int jobs = (int)((_capacity + PARTICLE_JOB_SIZE - 1) / PARTICLE_JOB_SIZE);
+	jobAlive.resize(jobs, 0);
+	packOffsets.resize(jobs, 0);
+	retired.resize(jobs);
+	for (int i = 0; i < jobs; i++) {
+		retired[i].reserve(PARTICLE_JOB_SIZE);
+	}
+}
+
+int ParticleSystem::addEmitter(const ParticleEmitter& emitter)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	emitters.push_back(emitter);
+	emitted.push_back(0.0f);
+	return (int)emitters.size() - 1;
+}
+
+void ParticleSystem::update(GLfloat dt, const BatchMathKernels* k)
+{
+	PROFILE_ZONE("UpdateParticles");
+	for (size_t i = 0; i < emitters.size(); i++) {
+		emitted[i] += emitters[i].rate * dt;
+		int count = (int)emitted[i];
+		emitted[i] -= (GLfloat)count;
+		emit(emitters[i], count);
+	}
+
+	jobKernels = k != NULL ? k : &BatchMath::kernels();
+	jobStep = dt;
+	jobDamping = std::pow(damping, dt);
+	runJobs(&ParticleSystem::updateJob);
+
+	for (size_t i = 0; i < retired.size(); i++) {
+		freeList.insert(freeList.end(), retired[i].begin(), retired[i].end());
+		retired[i].clear();
+	}
+}
+
+void ParticleSystem::pack(ParticleInstance* out)
+{
+	size_t offset = 0;
+	for (size_t i = 0; i < jobAlive.size(); i++) {
+		packOffsets[i] = offset;
+		offset += jobAlive[i];
+	}
+	packTarget = out;
+	runJobs(&ParticleSystem::packJob);
+	packTarget = NULL;
+}
+
+size_t ParticleSystem::aliveCount() const
+{
+	size_t count = 0;
+	for (size_t i = 0; i < jobAlive.size(); i++) {
+		count += jobAlive[i];
+	}
+	return count;
+}
+
+void ParticleSystem::emit(const ParticleEmitter& emitter, int count)
+{
+	for (int n = 0; n < count; n++) {
+		if (freeList.empty()) {
+			dropped += count - n;
+			return;
+		}
+		int i = freeList.back();
+		freeList.pop_back();
+
+		positions.x[i] = emitter.position.x;
+		positions.y[i] = emitter.position.y;
+		positions.z[i] = emitter.position.z;
+		velocities.x[i] = emitter.velocity.x + randomFloat() * emitter.spread;
+		velocities.y[i] = emitter.velocity.y + randomFloat() * emitter.spread;
+		velocities.z[i] = emitter.velocity.z + randomFloat() * emitter.spread;
+		life[i] = emitter.lifetime * (0.75f + 0.25f * randomFloat());
+		inverseLifetime[i] = 1.0f / life[i];
+		colors[i] = packColor(emitter.color);
+		alive[i] = 1;
+		jobAlive[i / PARTICLE_JOB_SIZE]++;
+	}
+}
+
+// Dead particles are moved along with the living ones, skipping them would cost more than it saves
+void ParticleSystem::updateJob(int job)
+{
+	if (jobAlive[job] == 0)
+		return;
+	size_t first = (size_t)job * PARTICLE_JOB_SIZE;
+	size_t count = std::min((size_t)PARTICLE_JOB_SIZE, capacity() - first);
+	float* position[3] = { &positions.x[first], &positions.y[first], &positions.z[first] };
+	float* velocity[3] = { &velocities.x[first], &velocities.y[first], &velocities.z[first] };
+	jobKernels->integrateParticles(&gravity[0], jobDamping, jobStep, position, velocity, &life[first], count);
+
+	int living = 0;
+	for (size_t i = first; i < first + count; i++) {
+		if (!alive[i])
+			continue;
+		if (life[i] <= 0.0f) {
+			alive[i] = 0;
+			retired[job].push_back((int)i);
+		}
+		else {
+			living++;
+		}
+	}
+	jobAlive[job] = living;
+}
+
+void ParticleSystem::packJob(int job)
+{
+	if (jobAlive[job] == 0)
+		return;
+	size_t first = (size_t)job * PARTICLE_JOB_SIZE;
+	size_t count = std::min((size_t)PARTICLE_JOB_SIZE, capacity() - first);
+	ParticleInstance* out = packTarget + packOffsets[job];
+	for (size_t i = first; i < first + count; i++) {
+		if (!alive[i])
+			continue;
+		out->position[0] = positions.x[i];
+		out->position[1] = positions.y[i];
+		out->position[2] = positions.z[i];
+		out->age = 1.0f - life[i] * inverseLifetime[i];
+		out->color = colors[i];
+		out++;
+	}
+}
+
+// The job goes through a member, with only [this] captured the lambda fits into std::function without allocating
+void ParticleSystem::runJobs(void (ParticleSystem::*job)(int))
+{
+	int jobs = (int)jobAlive.size();
+	runningJob = job;
+	if (threadPool != NULL) {
+		threadPool->parallelFor(jobs, [this](int i) { (this->*runningJob)(i); });
+	}
+	else {
+		for (int i = 0; i < jobs; i++) {
+			(this->*runningJob)(i);
+		}
+	}
+}
+
+// -1 ... 1
+GLfloat ParticleSystem::randomFloat()
+{
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	return (GLfloat)(random & 0xffffff) / (GLfloat)0x800000 - 1.0f;
+}
+
+GLuint ParticleSystem::packColor(const glm::vec4& color)
+{
+	glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	return (GLuint)clamped.r | ((GLuint)clamped.g << 8) | ((GLuint)clamped.b << 16) | ((GLuint)clamped.a << 24);
+}
+
+ParticleRenderer::ParticleRenderer(ShaderLibrary* library, GpuResources* _resources, size_t capacity)
+	: resources(_resources)
+{
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	shader = library->get("shaders/particle.vs", "shaders/particle.frag", 0);
+	instanceBuffer = resources->createBuffer(capacity * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
+	vertexArray = resources->createVertexArray();
+
+	// The quad corners come from gl_VertexID, only the instances have attributes
+	GLsizei stride = sizeof(ParticleInstance);
+	glBindVertexArray(resources->name(vertexArray));
+	glBindBuffer(GL_ARRAY_BUFFER, resources->name(instanceBuffer));
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribDivisor(0, 1);
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (GLvoid*)(4 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribDivisor(1, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+ParticleRenderer::~ParticleRenderer()
+{
+	resources->release(vertexArray);
+	resources->release(instanceBuffer);
+}
+
+void ParticleRenderer::draw(ParticleSystem& particles, const glm::mat4& view, const glm::mat4& projection, GLfloat size)
+{
+	PROFILE_GPU_ZONE("Particles");
+	size_t count = particles.aliveCount();
+	if (count == 0 || shader == NULL)
+		return;
+
+	// Invalidating gives a fresh store, no waiting for the draw of the last frame
+	glBindBuffer(GL_ARRAY_BUFFER, resources->name(instanceBuffer));
+	void* data = glMapBufferRange(GL_ARRAY_BUFFER, 0, count * sizeof(ParticleInstance), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (data == NULL) {
+		std::cout << "ERROR::PARTICLES::MAP_FAILED" << std::endl;
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return;
+	}
+	{
+		PROFILE_ZONE("PackParticles");
+		particles.pack((ParticleInstance*)data);
+	}
+	bool intact = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (!intact) {
+		std::cout << "ERROR::PARTICLES::BUFFER_LOST" << std::endl;
+		return;
+	}
+
+	shader->Use();
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	glUniform1f(glGetUniformLocation(shader->Program, "particleSize"), size);
+
+	glDepthMask(GL_FALSE);
+	glBlendFunc(GL_ONE, GL_ONE);
+	glBindVertexArray(resources->name(vertexArray));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
+	glBindVertexArray(0);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_TRUE);
+}
+
+// A million particles from a fountain, stepped at 60 Hz until the pool is full. Then steps and packs are timed with the
+// scalar kernels on one thread, the best kernels on one thread and the best kernels on all threads, and the particles
+// compared to the scalar ones. No window, the instances are packed into memory instead of a mapped buffer
+int runParticleBenchmark()
+{
+	const size_t COUNT = 1000000;
+	const int WARMUP_STEPS = 180;
+	const int STEPS = 60;
+	const GLfloat STEP = 1.0f / 60.0f;
+	const GLfloat LIFETIME = 2.0f;
+
+	ThreadPool threadPool;
+	const BatchMathKernels* kernels[] = { BatchMath::kernels(BATCH_MATH_SCALAR), &BatchMath::kernels(), &BatchMath::kernels() };
+	ThreadPool* pools[] = { NULL, NULL, &threadPool };
+	std::vector<ParticleInstance> instances(COUNT);
+	std::vector<glm::vec3> reference;
+
+	std::cout << "Particles, " << COUNT << ", " << threadPool.threadCount() << " threads:" << std::endl;
+	for (int run = 0; run < 3; run++) {
+		ParticleSystem particles(COUNT, pools[run]);
+		ParticleEmitter fountain;
+		fountain.position = glm::vec3(0.0f);
+		fountain.velocity = glm::vec3(0.0f, 6.0f, 0.0f);
+		fountain.spread = 1.5f;
+		fountain.lifetime = LIFETIME;
+		fountain.rate = COUNT / LIFETIME * 1.5f;
+		fountain.color = glm::vec4(1.0f);
+		particles.addEmitter(fountain);
+		particles.setDamping(0.8f);
+		for (int step = 0; step < WARMUP_STEPS; step++) {
+			particles.update(STEP, kernels[run]);
+		}
+
+		double updateMs = 0.0, packMs = 0.0;
+		for (int step = 0; step < STEPS; step++) {
+			long long start = Profiler::now();
+			particles.update(STEP, kernels[run]);
+			long long updated = Profiler::now();
+			particles.pack(&instances[0]);
+			updateMs += elapsedMs(start, updated);
+			packMs += elapsedMs(updated);
+		}
+
+		// Same emission on every run, only the kernels round differently (FMA)
+		GLfloat maxError = 0.0f;
+		if (run == 0) {
+			reference.resize(COUNT);
+			for (size_t i = 0; i < COUNT; i++) {
+				reference[i] = particles.isAlive(i) ? particles.position(i) : glm::vec3(0.0f);
+			}
+		}
+		else {
+			for (size_t i = 0; i < COUNT; i++) {
+				if (particles.isAlive(i))
+					maxError = std::max(maxError, relativeError(particles.position(i), reference[i]));
+			}
+		}
+
+		std::cout << "  " << kernels[run]->name << (pools[run] != NULL ? ", all threads" : ", 1 thread") << ": " << particles.aliveCount()
+			<< " alive, update " << updateMs / STEPS << "ms, pack " << packMs / STEPS << "ms, max relative error " << maxError << std::endl;
+		if (maxError > 1e-3f) {
+			std::cout << "ERROR::PARTICLES::" << kernels[run]->name << " results differ from the scalar kernels" << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#ifndef PARTICLESYSTEM_H
+#define PARTICLESYSTEM_H
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "BatchMath.h"
+#include "ThreadPool.h"
+#include "ShaderLibrary.h"
+#include "GpuResources.h"
+
+// Particles per update / pack job, a job never looks at the particles of another one
+const int PARTICLE_JOB_SIZE = 16384;
+
+struct ParticleEmitter {
+	glm::vec3 position;
+	glm::vec3 velocity;		// average start velocity
+	GLfloat spread;			// random start velocity on top, up to this in every direction
+	GLfloat rate;			// particles per second
+	GLfloat lifetime;		// seconds, each particle lives between half and all of it
+	glm::vec4 color;
+};
+
+// What the particle shader reads per instance
+struct ParticleInstance {
+	GLfloat position[3];
+	GLfloat age;			// 0 when emitted, 1 when it dies
+	GLuint color;			// RGBA8, red in the lowest byte
+};
+
+// Particles stored as structure of arrays, moved by the batch math integrateParticles kernel. Updates and packs run
+// in jobs of PARTICLE_JOB_SIZE particles on the thread pool, jobs without living particles are skipped. Emitters take
+// their particles from a free list which dead particles go back to, so the storage never grows. No GL involved,
+// ParticleRenderer draws the result
+class ParticleSystem
+{
+public:
+	// threadPool may be NULL, the jobs then run on the calling thread
+	ParticleSystem(size_t _capacity, ThreadPool* _threadPool, unsigned int seed = 1);
+
+	int addEmitter(const ParticleEmitter& emitter);
+	ParticleEmitter& emitter(int index) { return emitters[index]; }
+	void setGravity(const glm::vec3& _gravity) { gravity = _gravity; }
+	// Velocity kept per second
+	void setDamping(GLfloat _damping) { damping = _damping; }
+
+	// Emits, moves and retires the particles. k forces a kernel level, e.g. for the benchmark
+	void update(GLfloat dt, const BatchMathKernels* k = NULL);
+	// Writes the living particles to out, which needs room for aliveCount() of them
+	void pack(ParticleInstance* out);
+
+	size_t capacity() const { return life.size(); }
+	size_t aliveCount() const;
+	unsigned long long droppedCount() const { return dropped; }
+	glm::vec3 position(size_t i) const { return positions[i]; }
+	bool isAlive(size_t i) const { return alive[i] != 0; }
+
+private:
+	ParticleSystem(const ParticleSystem&);
+	ParticleSystem& operator=(const ParticleSystem&);
+
+	void emit(const ParticleEmitter& emitter, int count);
+	void updateJob(int job);
+	void packJob(int job);
+	void runJobs(void (ParticleSystem::*job)(int));
+	GLfloat randomFloat();
+	static GLuint packColor(const glm::vec4& color);
+
+	ThreadPool* threadPool;
+	std::vector<ParticleEmitter> emitters;
+	std::vector<GLfloat> emitted;		// per emitter, particles due but not yet emitted (fractions)
+	glm::vec3 gravity;
+	GLfloat damping;
+	unsigned int random;				// xorshift state
+
+	PointsSoA positions;
+	PointsSoA velocities;
+	SimdFloatArray life;				// seconds left, dead at 0
+	SimdFloatArray inverseLifetime;		// 1 / seconds in total, packing multiplies instead of dividing
+	std::vector<GLuint> colors;
+	std::vector<unsigned char> alive;
+	std::vector<int> freeList;			// dead particles, the next one emitted is at the back
+
+	// Per job
+	std::vector<int> jobAlive;			// living particles, emitted ones included
+	std::vector<std::vector<int> > retired;		// died in the last update, back into the free list afterwards
+	std::vector<size_t> packOffsets;
+
+	// Arguments of the running jobs
+	void (ParticleSystem::*runningJob)(int);
+	const BatchMathKernels* jobKernels;
+	GLfloat jobStep;
+	GLfloat jobDamping;
+	ParticleInstance* packTarget;
+	unsigned long long dropped;			// emitted with the free list empty
+};
+
+// Draws a particle system as camera facing quads in one instanced call. The living particles are packed straight
+// into the instance buffer while it is mapped, a new store every frame, so the GPU can still read the last one
+class ParticleRenderer
+{
+public:
+	ParticleRenderer(ShaderLibrary* library, GpuResources* _resources, size_t capacity);
+	~ParticleRenderer();
+
+	// Additive blending, depth tested but not written. size is the edge length of the quads in world units
+	void draw(ParticleSystem& particles, const glm::mat4& view, const glm::mat4& projection, GLfloat size);
+
+private:
+	ParticleRenderer(const ParticleRenderer&);
+	ParticleRenderer& operator=(const ParticleRenderer&);
+
+	GpuResources* resources;
+	Shader* shader;						// owned by the library
+	GpuHandle vertexArray;
+	GpuHandle instanceBuffer;
+};
+
+// --bench-particles: times updating and packing a million particles per kernel set (no GL), returns the exit code
+int runParticleBenchmark();
+
+#endif
@@ -0,0 +1,135 @@
+#include "PixelConversion.h"
+
+#include <cstddef>
+
+#ifdef PIXEL_CONVERSION_SSE2
+#include <emmintrin.h>
+#endif
+
+// Fixed point coefficients (x 256). Each row adds up to 256 (Y) or 0 (U, V), so no clamping is needed.
+// The chroma bias is 127 instead of 128, otherwise the 16-bit SIMD sums overflow for pure blue / red
+static inline unsigned char luma(int r, int g, int b)
+{
+	return (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+static inline unsigned char chromaU(int r, int g, int b)
+{
+	return (unsigned char)(((-43 * r - 85 * g + 128 * b + 127) >> 8) + 128);
+}
+
+static inline unsigned char chromaV(int r, int g, int b)
+{
+	return (unsigned char)(((128 * r - 107 * g - 21 * b + 127) >> 8) + 128);
+}
+
+void flipRGBAToRGB(const unsigned char* rgba, int width, int height, unsigned char* rgb)
+{
+	for (int y = 0; y < height; y++) {
+		const unsigned char* src = rgba + (size_t)(height - 1 - y) * width * 4;
+		unsigned char* dst = rgb + (size_t)y * width * 3;
+		for (int x = 0; x < width; x++) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			src += 4;
+			dst += 3;
+		}
+	}
+}
+
+#ifdef PIXEL_CONVERSION_SSE2
+// Channels of 8 RGBA pixels as 16-bit lanes
+static inline void loadChannels(const unsigned char* src, __m128i& r, __m128i& g, __m128i& b)
+{
+	const __m128i mask = _mm_set1_epi32(0xFF);
+	__m128i p0 = _mm_loadu_si128((const __m128i*)src);
+	__m128i p1 = _mm_loadu_si128((const __m128i*)(src + 16));
+	r = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask), _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask), _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+
+// The products add up to at most 255 * 256, which still fits unsigned 16 bits
+static inline __m128i lumaSSE2(__m128i r, __m128i g, __m128i b)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)), _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+}
+
+// Signed sums stay within +-255 * 128
+static inline __m128i chromaSSE2(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)), _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+	sum = _mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(127)), 8);
+	return _mm_add_epi16(sum, _mm_set1_epi16(128));
+}
+
+// Average of 2x2 blocks: a and b hold the vertical sums of 16 pixels, the result 8 averages
+static inline __m128i blockAverage(__m128i a, __m128i b)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	__m128i sums = _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+	return _mm_srli_epi16(_mm_add_epi16(sums, _mm_set1_epi16(2)), 2);
+}
+#endif
+
+void flipRGBAToYUV420(const unsigned char* rgba, int width, int height, unsigned char* yPlane, unsigned char* uPlane, unsigned char* vPlane)
+{
+	int chromaWidth = (width + 1) / 2;
+	size_t stride = (size_t)width * 4;
+
+	// Two output rows at a time, they share a chroma row. An odd last row is paired with itself
+	for (int y = 0; y < height; y += 2) {
+		int bottomRow = y + 1 < height ? y + 1 : y;
+		const unsigned char* top = rgba + (size_t)(height - 1 - y) * stride;
+		const unsigned char* bottom = rgba + (size_t)(height - 1 - bottomRow) * stride;
+		unsigned char* yTop = yPlane + (size_t)y * width;
+		unsigned char* yBottom = yPlane + (size_t)bottomRow * width;
+		unsigned char* u = uPlane + (size_t)(y / 2) * chromaWidth;
+		unsigned char* v = vPlane + (size_t)(y / 2) * chromaWidth;
+
+		int x = 0;
+#ifdef PIXEL_CONVERSION_SSE2
+		// 16 pixels of both rows -> 32 luma and 8 chroma samples
+		for (; x + 16 <= width; x += 16) {
+			__m128i r0, g0, b0, r1, g1, b1, r2, g2, b2, r3, g3, b3;
+			loadChannels(top + x * 4, r0, g0, b0);
+			loadChannels(top + x * 4 + 32, r1, g1, b1);
+			loadChannels(bottom + x * 4, r2, g2, b2);
+			loadChannels(bottom + x * 4 + 32, r3, g3, b3);
+
+			_mm_storeu_si128((__m128i*)(yTop + x), _mm_packus_epi16(lumaSSE2(r0, g0, b0), lumaSSE2(r1, g1, b1)));
+			_mm_storeu_si128((__m128i*)(yBottom + x), _mm_packus_epi16(lumaSSE2(r2, g2, b2), lumaSSE2(r3, g3, b3)));
+
+			__m128i r = blockAverage(_mm_add_epi16(r0, r2), _mm_add_epi16(r1, r3));
+			__m128i g = blockAverage(_mm_add_epi16(g0, g2), _mm_add_epi16(g1, g3));
+			__m128i b = blockAverage(_mm_add_epi16(b0, b2), _mm_add_epi16(b1, b3));
+			_mm_storel_epi64((__m128i*)(u + x / 2), _mm_packus_epi16(chromaSSE2(r, g, b, -43, -85, 128), _mm_setzero_si128()));
+			_mm_storel_epi64((__m128i*)(v + x / 2), _mm_packus_epi16(chromaSSE2(r, g, b, 128, -107, -21), _mm_setzero_si128()));
+		}
+#endif
+		// Rest of the row (all of it without SSE2), an odd last column is paired with itself
+		for (; x < width; x += 2) {
+			int right = x + 1 < width ? x + 1 : x;
+			const unsigned char* p[4] = { top + x * 4, top + right * 4, bottom + x * 4, bottom + right * 4 };
+			int r = 0, g = 0, b = 0;
+			for (int i = 0; i < 4; i++) {
+				r += p[i][0];
+				g += p[i][1];
+				b += p[i][2];
+			}
+			yTop[x] = luma(p[0][0], p[0][1], p[0][2]);
+			yTop[right] = luma(p[1][0], p[1][1], p[1][2]);
+			yBottom[x] = luma(p[2][0], p[2][1], p[2][2]);
+			yBottom[right] = luma(p[3][0], p[3][1], p[3][2]);
+			r = (r + 2) >> 2;
+			g = (g + 2) >> 2;
+			b = (b + 2) >> 2;
+			u[x / 2] = chromaU(r, g, b);
+			v[x / 2] = chromaV(r, g, b);
+		}
+	}
+}
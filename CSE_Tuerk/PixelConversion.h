@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef PIXELCONVERSION_H
+#define PIXELCONVERSION_H
+
+// SSE2 is always there on x64 and with /arch:SSE2 (default for x86 since VS2012)
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PIXEL_CONVERSION_SSE2
+#endif
+
+// Conversions of read back frames (RGBA rows, bottom row first, as glReadPixels returns them).
+// All outputs are top row first
+
+// Tightly packed RGB, alpha is dropped
+void flipRGBAToRGB(const unsigned char* rgba, int width, int height, unsigned char* rgb);
+
+// Planar YUV 4:2:0, full range BT.601 (as in JPEG, Y4M "C420jpeg"). Chroma planes are (width + 1) / 2 x (height + 1) / 2,
+// each chroma sample is the average of a 2x2 block
+void flipRGBAToYUV420(const unsigned char* rgba, int width, int height, unsigned char* y, unsigned char* u, unsigned char* v);
+
+#endif
@@ -0,0 +1,283 @@
+#include "Profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+
+#include "MemoryTracker.h"
+
+// Thread id used for the GPU timeline in the trace
+const int GPU_THREAD_ID = 1000;
+// Weight of the newest frame in the averages of the summary
+const double STATS_SMOOTHING = 0.05;
+
+std::mutex Profiler::ringsMutex;
+std::vector<CpuEventRing*> Profiler::rings;
+Profiler::GpuFrame Profiler::gpuFrames[GPU_FRAME_LATENCY];
+long long Profiler::frameIndex = 0;
+long long Profiler::gpuOffset = 0;
+bool Profiler::hasTimerQueries = false;
+bool Profiler::hasDebugGroups = false;
+bool Profiler::capturing = false;
+std::vector<Profiler::TraceEvent> Profiler::captured;
+std::map<const char*, double> Profiler::cpuStats;
+std::map<const char*, double> Profiler::gpuStats;
+std::map<const char*, double> Profiler::frameTimes;
+std::map<std::string, int> Profiler::internedNames;
+std::map<const char*, const char*> Profiler::internedPointers;
+
+static thread_local CpuEventRing* currentRing = NULL;
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+void Profiler::init()
+{
+	MEMORY_TAG(MEMORY_TAG_PROFILER);
+	// Timer queries are core since 3.3, debug groups need KHR_debug (core in 4.3)
+	hasTimerQueries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	hasDebugGroups = GLEW_KHR_debug != 0;
+
+	if (hasTimerQueries) {
+		GLint64 gpuNow;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuOffset = gpuNow - now();
+	}
+	setThreadName("Main");
+}
+
+void Profiler::shutdown()
+{
+	for (int i = 0; i < GPU_FRAME_LATENCY; i++) {
+		for (size_t q = 0; q < gpuFrames[i].queries.size(); q++) {
+			glDeleteQueries(1, &gpuFrames[i].queries[q].begin);
+			glDeleteQueries(1, &gpuFrames[i].queries[q].end);
+		}
+		gpuFrames[i].queries.clear();
+		gpuFrames[i].used = 0;
+	}
+}
+
+void Profiler::beginFrame()
+{
+	// The queries of this slot were issued GPU_FRAME_LATENCY frames ago, so they are usually done by now
+	GpuFrame& frame = gpuFrames[frameIndex % GPU_FRAME_LATENCY];
+	resolveGpuFrame(frame);
+	frame.used = 0;
+}
+
+void Profiler::endFrame()
+{
+	MEMORY_TAG(MEMORY_TAG_PROFILER);
+	drainCpuEvents();
+	frameIndex++;
+}
+
+void Profiler::startCapture()
+{
+	captured.clear();
+	capturing = true;
+}
+
+void Profiler::stopCapture()
+{
+	capturing = false;
+}
+
+bool Profiler::isCapturing()
+{
+	return capturing;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path)
+{
+	std::ofstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+		return false;
+	}
+
+	// Chrome expects microseconds
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << GPU_THREAD_ID << ",\"args\":{\"name\":\"GPU\"}}";
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (size_t i = 0; i < rings.size(); i++) {
+			file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << rings[i]->threadId
+				<< ",\"args\":{\"name\":\"" << rings[i]->threadName << "\"}}";
+		}
+	}
+	for (size_t i = 0; i < captured.size(); i++) {
+		const TraceEvent& event = captured[i];
+		file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.threadId == GPU_THREAD_ID ? "gpu" : "cpu")
+			<< "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << event.threadId
+			<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+	}
+	file << "\n]}\n";
+	std::cout << "Profiler: wrote " << captured.size() << " events to " << path << std::endl;
+	return true;
+}
+
+std::string Profiler::summary()
+{
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(2) << "CPU";
+	for (std::map<const char*, double>::iterator it = cpuStats.begin(); it != cpuStats.end(); ++it)
+		line << " " << it->first << " " << it->second << "ms";
+	line << " | GPU";
+	for (std::map<const char*, double>::iterator it = gpuStats.begin(); it != gpuStats.end(); ++it)
+		line << " " << it->first << " " << it->second << "ms";
+	unsigned long long dropped = droppedEvents();
+	if (dropped > 0)
+		line << " | " << dropped << " events dropped";
+	return line.str();
+}
+
+const std::map<const char*, double>& Profiler::lastFrameTimes()
+{
+	return frameTimes;
+}
+
+unsigned long long Profiler::droppedEvents()
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	unsigned long long dropped = 0;
+	for (size_t i = 0; i < rings.size(); i++)
+		dropped += rings[i]->dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	threadRing()->threadName = name;
+}
+
+long long Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Profiler::pushCpuEvent(const char* name, long long start, long long end)
+{
+	CpuEventRing* ring = threadRing();
+	unsigned int head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= CPU_RING_CAPACITY) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	ProfileEvent& event = ring->events[head % CPU_RING_CAPACITY];
+	event.name = name;
+	event.start = start;
+	event.end = end;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+int Profiler::beginGpuZone(const char* name)
+{
+	if (hasDebugGroups)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+	if (!hasTimerQueries)
+		return -1;
+
+	// Query objects are reused every GPU_FRAME_LATENCY frames, new ones are only created for additional zones
+	GpuFrame& frame = gpuFrames[frameIndex % GPU_FRAME_LATENCY];
+	if (frame.used == frame.queries.size()) {
+		GpuQuery query;
+		glGenQueries(1, &query.begin);
+		glGenQueries(1, &query.end);
+		frame.queries.push_back(query);
+	}
+	GpuQuery& query = frame.queries[frame.used];
+	query.name = name;
+	glQueryCounter(query.begin, GL_TIMESTAMP);
+	return (int)frame.used++;
+}
+
+void Profiler::endGpuZone(int query)
+{
+	if (query >= 0)
+		glQueryCounter(gpuFrames[frameIndex % GPU_FRAME_LATENCY].queries[query].end, GL_TIMESTAMP);
+	if (hasDebugGroups)
+		glPopDebugGroup();
+}
+
+CpuEventRing* Profiler::threadRing()
+{
+	if (currentRing == NULL) {
+		MEMORY_TAG(MEMORY_TAG_PROFILER);
+		currentRing = new CpuEventRing();
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		currentRing->threadId = (int)rings.size();
+		std::ostringstream name;
+		name << "Thread " << currentRing->threadId;
+		currentRing->threadName = name.str();
+		rings.push_back(currentRing);
+	}
+	return currentRing;
+}
+
+void Profiler::drainCpuEvents()
+{
+	// Values are reset instead of erased so the map doesn't allocate again every frame
+	for (std::map<const char*, double>::iterator it = frameTimes.begin(); it != frameTimes.end(); ++it)
+		it->second = 0.0;
+
+	std::lock_guard<std::mutex> lock(ringsMutex);
+	for (size_t i = 0; i < rings.size(); i++) {
+		CpuEventRing* ring = rings[i];
+		unsigned int tail = ring->tail.load(std::memory_order_relaxed);
+		unsigned int head = ring->head.load(std::memory_order_acquire);
+		for (; tail != head; tail++) {
+			const ProfileEvent& event = ring->events[tail % CPU_RING_CAPACITY];
+			record(event.name, ring->threadId, event.start, event.end, false);
+		}
+		ring->tail.store(tail, std::memory_order_release);
+	}
+}
+
+void Profiler::resolveGpuFrame(GpuFrame& frame)
+{
+	if (frame.used == 0)
+		return;
+
+	// Queries finish in order, so if the last one is available all of them are. Otherwise the frame is skipped
+	GLuint available = 0;
+	glGetQueryObjectuiv(frame.queries[frame.used - 1].end, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return;
+
+	for (size_t i = 0; i < frame.used; i++) {
+		GLuint64 begin, end;
+		glGetQueryObjectui64v(frame.queries[i].begin, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[i].end, GL_QUERY_RESULT, &end);
+		record(frame.queries[i].name, GPU_THREAD_ID, (long long)begin - gpuOffset, (long long)end - gpuOffset, true);
+	}
+}
+
+void Profiler::record(const char* name, int threadId, long long start, long long end, bool gpu)
+{
+	name = intern(name);
+	if (capturing && captured.size() < MAX_CAPTURED_EVENTS) {
+		TraceEvent event = { name, threadId, start, end };
+		captured.push_back(event);
+	}
+
+	double& average = gpu ? gpuStats[name] : cpuStats[name];
+	double ms = (end - start) / 1000000.0;
+	average = average == 0.0 ? ms : average + (ms - average) * STATS_SMOOTHING;
+	if (!gpu)
+		frameTimes[name] += ms;
+}
+
+// Only allocates the first time a literal shows up
+const char* Profiler::intern(const char* name)
+{
+	std::map<const char*, const char*>::iterator known = internedPointers.find(name);
+	if (known != internedPointers.end())
+		return known->second;
+	MEMORY_TAG(MEMORY_TAG_PROFILER);
+	const char* interned = internedNames.insert(std::make_pair(std::string(name), 0)).first->first.c_str();
+	internedPointers[name] = interned;
+	return interned;
+}
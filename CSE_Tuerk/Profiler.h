@@ -0,0 +1,157 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+
+#include <GL/glew.h>
+
+// Set to 0 to compile all zones out
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Number of frames a GPU query may take until its result is read back (reading earlier would stall)
+const int GPU_FRAME_LATENCY = 4;
+// Events per thread which can wait for the main thread to collect them, newer events are dropped if full
+const unsigned int CPU_RING_CAPACITY = 4096;
+// Upper limit of events kept for the Chrome trace export
+const size_t MAX_CAPTURED_EVENTS = 1000000;
+
+// A finished zone, times are nanoseconds since program start
+struct ProfileEvent {
+	const char* name;	// has to be a string literal (only the pointer is stored)
+	long long start;
+	long long end;
+};
+
+// Single producer / single consumer ring of CPU events. The owning thread pushes, the main thread drains in endFrame
+struct CpuEventRing {
+	ProfileEvent events[CPU_RING_CAPACITY];
+	std::atomic<unsigned int> head;		// next write position, only changed by the producer
+	std::atomic<unsigned int> tail;		// next read position, only changed by the consumer
+	std::atomic<unsigned int> dropped;	// events lost because the ring was full, only changed by the producer
+	int threadId;
+	std::string threadName;
+
+	CpuEventRing() : head(0), tail(0), dropped(0), threadId(0) {}
+};
+
+// Scoped-zone profiler for CPU (per thread) and GPU (GL_TIMESTAMP queries) work.
+// Results can be exported as a Chrome trace (chrome://tracing) or shown as a short summary.
+class Profiler
+{
+public:
+	// Needs a current GL context, checks which GL features (timer queries, debug groups) are available
+	static void init();
+	static void shutdown();
+
+	static void beginFrame();
+	static void endFrame();
+
+	// Recording of all events for the trace export
+	static void startCapture();
+	static void stopCapture();
+	static bool isCapturing();
+	static bool writeChromeTrace(const std::string& path);
+
+	// One line with the average duration of every zone, e.g. for the window title. Ends with the dropped events if there were any
+	static std::string summary();
+
+	// CPU milliseconds per zone collected by the last endFrame (zones of the same name are summed up).
+	// Keys are interned, one per name, whichever literal the zones used
+	static const std::map<const char*, double>& lastFrameTimes();
+	// CPU events lost so far because a thread's ring was full
+	static unsigned long long droppedEvents();
+
+	// Name of the calling thread in the trace
+	static void setThreadName(const char* name);
+
+	static long long now();
+	static void pushCpuEvent(const char* name, long long start, long long end);
+	static int beginGpuZone(const char* name);
+	static void endGpuZone(int query);
+
+private:
+	struct GpuQuery {
+		const char* name;
+		GLuint begin;
+		GLuint end;
+	};
+
+	struct GpuFrame {
+		std::vector<GpuQuery> queries;
+		size_t used;
+	};
+
+	struct TraceEvent {
+		const char* name;
+		int threadId;
+		long long start;
+		long long end;
+	};
+
+	static CpuEventRing* threadRing();
+	static void drainCpuEvents();
+	static void resolveGpuFrame(GpuFrame& frame);
+	static void record(const char* name, int threadId, long long start, long long end, bool gpu);
+	// The same name from different literals (e.g. in several translation units) becomes one pointer, owned by internedNames
+	static const char* intern(const char* name);
+
+	static std::mutex ringsMutex;			// only taken when a thread registers its ring and while draining
+	static std::vector<CpuEventRing*> rings;
+	static GpuFrame gpuFrames[GPU_FRAME_LATENCY];
+	static long long frameIndex;
+	static long long gpuOffset;				// GL_TIMESTAMP - now() at init
+	static bool hasTimerQueries;
+	static bool hasDebugGroups;
+	static bool capturing;
+	static std::vector<TraceEvent> captured;
+	static std::map<const char*, double> cpuStats;	// exponential moving average in ms per zone
+	static std::map<const char*, double> gpuStats;
+	static std::map<const char*, double> frameTimes;
+	static std::map<std::string, int> internedNames;	// only the keys are used
+	static std::map<const char*, const char*> internedPointers;	// literal -> interned name, so a known literal needs no string compare
+};
+
+// Measures the CPU time of the enclosing scope
+class ProfileZone
+{
+public:
+	ProfileZone(const char* _name) : name(_name), start(Profiler::now()) {}
+	~ProfileZone() { Profiler::pushCpuEvent(name, start, Profiler::now()); }
+
+private:
+	const char* name;
+	long long start;
+};
+
+// Measures CPU and GPU time of the enclosing scope and marks it as a debug group for GL debuggers
+class ProfileGpuZone
+{
+public:
+	ProfileGpuZone(const char* _name) : cpu(_name), query(Profiler::beginGpuZone(_name)) {}
+	~ProfileGpuZone() { Profiler::endGpuZone(query); }
+
+private:
+	ProfileZone cpu;
+	int query;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_ZONE(name) ProfileGpuZone PROFILE_CONCAT(profileGpuZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_GPU_ZONE(name)
+#endif
+
+#endif
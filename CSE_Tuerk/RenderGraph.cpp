@@ -0,0 +1,517 @@
+#include "RenderGraph.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+GLuint RenderPassContext::texture(RenderResource resource) const
+{
+	int physical = graph->resources[resource].physical;
+	return physical >= 0 ? graph->textures[physical].texture : 0;
+}
+
+void RenderPassContext::blit(RenderResource source, GLsizei sourceWidth, GLsizei sourceHeight, GLbitfield mask, GLenum filter) const
+{
+	const RenderGraph::Resource& resource = graph->resources[source];
+	GLuint readFramebuffer = resource.importedFramebuffer;
+	if (!resource.imported) {
+		if (resource.readFramebuffer == 0) {
+			std::vector<GLuint> colors;
+			GLuint depth = 0;
+			if (RenderGraph::isDepthFormat(resource.desc.format))
+				depth = texture(source);
+			else
+				colors.push_back(texture(source));
+			resource.readFramebuffer = graph->framebufferFor(colors, depth, RenderGraph::hasStencil(resource.desc.format));
+		}
+		readFramebuffer = resource.readFramebuffer;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+	glBlitFramebuffer(0, 0, sourceWidth, sourceHeight, 0, 0, width, height, mask, filter);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(RenderResource resource)
+{
+	graph->passes[pass].reads.push_back(resource);
+	graph->compiled = false;
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(RenderResource resource)
+{
+	graph->passes[pass].writes.push_back(resource);
+	graph->compiled = false;
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::depth(RenderResource resource, bool readOnly)
+{
+	graph->passes[pass].depth = resource;
+	graph->passes[pass].depthReadOnly = readOnly;
+	graph->compiled = false;
+	return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::keepAlive()
+{
+	graph->passes[pass].keepAlive = true;
+	graph->compiled = false;
+	return *this;
+}
+
+RenderGraph::RenderGraph()
+	: compiled(false)
+{}
+
+RenderGraph::~RenderGraph()
+{
+	destroy();
+}
+
+RenderResource RenderGraph::createTarget(const std::string& name, const RenderTargetDesc& desc)
+{
+	Resource resource = { name, desc, false, 0, -1, 0 };
+	resources.push_back(resource);
+	compiled = false;
+	return (RenderResource)resources.size() - 1;
+}
+
+RenderResource RenderGraph::importFramebuffer(const std::string& name, GLuint framebuffer, GLsizei width, GLsizei height)
+{
+	Resource resource = { name, RenderTargetDesc(width, height, 0), true, framebuffer, -1, 0 };
+	resources.push_back(resource);
+	compiled = false;
+	return (RenderResource)resources.size() - 1;
+}
+
+RenderGraph::PassBuilder RenderGraph::addPass(const char* name, RenderPassFunction execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = execute;
+	pass.depth = NO_RENDER_RESOURCE;
+	pass.depthReadOnly = false;
+	pass.keepAlive = false;
+	pass.culled = false;
+	pass.framebuffer = 0;
+	pass.width = pass.height = 0;
+	passes.push_back(pass);
+	compiled = false;
+	return PassBuilder(this, (int)passes.size() - 1);
+}
+
+void RenderGraph::execute()
+{
+	if (!compiled) {
+		compile();
+	}
+
+	GLuint boundFramebuffer = (GLuint)-1;
+	for (size_t i = 0; i < order.size(); i++) {
+		Pass& pass = passes[order[i]];
+		PROFILE_GPU_ZONE(pass.name);
+
+		bool hasAttachments = !pass.writes.empty() || pass.depth != NO_RENDER_RESOURCE;
+		if (hasAttachments) {
+			// Passes into the same attachments are sorted next to each other, so this is skipped between them
+			if (pass.framebuffer != boundFramebuffer) {
+				glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+				boundFramebuffer = pass.framebuffer;
+			}
+			glViewport(0, 0, pass.width, pass.height);
+		}
+		if (pass.depthReadOnly) {
+			glDepthMask(GL_FALSE);
+		}
+
+		RenderPassContext context = { this, pass.framebuffer, pass.width, pass.height };
+		pass.execute(context);
+
+		if (pass.depthReadOnly) {
+			glDepthMask(GL_TRUE);
+		}
+	}
+}
+
+void RenderGraph::reset()
+{
+	resources.clear();
+	passes.clear();
+	order.clear();
+	compiled = false;
+}
+
+void RenderGraph::destroy()
+{
+	for (std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end(); ++it) {
+		glDeleteFramebuffers(1, &it->second);
+	}
+	framebuffers.clear();
+	for (size_t i = 0; i < textures.size(); i++) {
+		glDeleteTextures(1, &textures[i].texture);
+	}
+	textures.clear();
+	reset();
+}
+
+void RenderGraph::printStatistics() const
+{
+	size_t transient = 0;
+	size_t bytes = 0;
+	for (size_t i = 0; i < resources.size(); i++) {
+		if (resources[i].physical >= 0)
+			transient++;
+	}
+	for (size_t i = 0; i < textures.size(); i++) {
+		GLenum format = textures[i].desc.format;
+		size_t pixelSize = format == GL_RGBA16F ? 8 : format == GL_R8 ? 1 : format == GL_R16F ? 2 : 4;
+		bytes += textures[i].desc.width * textures[i].desc.height * pixelSize;
+	}
+	std::cout << "RenderGraph: " << order.size() << " of " << passes.size() << " passes, "
+		<< transient << " targets in " << textures.size() << " textures (" << bytes / (1024 * 1024) << " MB)" << std::endl;
+}
+
+void RenderGraph::compile()
+{
+	PROFILE_ZONE("CompileRenderGraph");
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	buildDependencies();
+	cullPasses();
+	sortPasses();
+	assignTextures();
+	createFramebuffers();
+	compiled = true;
+	printStatistics();
+}
+
+// Declaration order decides what a read sees: the last write declared before it.
+// Writes also wait for all reads of the previous contents (write after read)
+void RenderGraph::buildDependencies()
+{
+	std::vector<int> lastWriter(resources.size(), -1);
+	std::vector<std::vector<int> > readers(resources.size());
+
+	for (int p = 0; p < (int)passes.size(); p++) {
+		Pass& pass = passes[p];
+		pass.dependencies.clear();
+
+		std::vector<RenderResource> reads = pass.reads;
+		std::vector<RenderResource> writes = pass.writes;
+		if (pass.depth != NO_RENDER_RESOURCE) {
+			(pass.depthReadOnly ? reads : writes).push_back(pass.depth);
+		}
+
+		for (size_t i = 0; i < reads.size(); i++) {
+			if (std::find(writes.begin(), writes.end(), reads[i]) != writes.end()) {
+				std::cout << "ERROR::RENDERGRAPH::FEEDBACK_LOOP " << pass.name << " reads and writes " << resources[reads[i]].name << std::endl;
+			}
+			if (lastWriter[reads[i]] >= 0)
+				pass.dependencies.push_back(lastWriter[reads[i]]);
+			readers[reads[i]].push_back(p);
+		}
+		for (size_t i = 0; i < writes.size(); i++) {
+			if (lastWriter[writes[i]] >= 0)
+				pass.dependencies.push_back(lastWriter[writes[i]]);
+			pass.dependencies.insert(pass.dependencies.end(), readers[writes[i]].begin(), readers[writes[i]].end());
+			lastWriter[writes[i]] = p;
+			readers[writes[i]].clear();
+		}
+	}
+}
+
+// A pass is needed if it writes an imported resource, is kept alive, or writes something a needed pass uses later.
+// Writes keep the previous contents, so the earlier writers of a needed resource are needed as well
+void RenderGraph::cullPasses()
+{
+	std::vector<bool> needed(resources.size(), false);
+	for (int p = (int)passes.size() - 1; p >= 0; p--) {
+		Pass& pass = passes[p];
+		bool used = pass.keepAlive;
+		for (size_t i = 0; i < pass.writes.size(); i++)
+			used = used || needed[pass.writes[i]] || resources[pass.writes[i]].imported;
+		if (pass.depth != NO_RENDER_RESOURCE && !pass.depthReadOnly)
+			used = used || needed[pass.depth];
+
+		pass.culled = !used;
+		if (pass.culled)
+			continue;
+
+		for (size_t i = 0; i < pass.reads.size(); i++)
+			needed[pass.reads[i]] = true;
+		for (size_t i = 0; i < pass.writes.size(); i++)
+			needed[pass.writes[i]] = true;
+		if (pass.depth != NO_RENDER_RESOURCE)
+			needed[pass.depth] = true;
+	}
+}
+
+// Topological order. Of all passes which are ready, the one with the same attachments as the previous pass goes first
+// (no framebuffer switch), otherwise the one declared first
+void RenderGraph::sortPasses()
+{
+	order.clear();
+	std::vector<int> waitingFor(passes.size(), 0);
+	std::vector<std::vector<int> > dependents(passes.size());
+	for (int p = 0; p < (int)passes.size(); p++) {
+		if (passes[p].culled)
+			continue;
+		for (size_t i = 0; i < passes[p].dependencies.size(); i++) {
+			int dependency = passes[p].dependencies[i];
+			if (!passes[dependency].culled) {
+				waitingFor[p]++;
+				dependents[dependency].push_back(p);
+			}
+		}
+	}
+
+	std::vector<int> ready;
+	for (int p = 0; p < (int)passes.size(); p++) {
+		if (!passes[p].culled && waitingFor[p] == 0)
+			ready.push_back(p);
+	}
+
+	while (!ready.empty()) {
+		size_t pick = 0;
+		for (size_t i = 1; i < ready.size(); i++) {
+			if (ready[i] < ready[pick])
+				pick = i;
+		}
+		if (!order.empty()) {
+			const Pass& previous = passes[order.back()];
+			for (size_t i = 0; i < ready.size(); i++) {
+				const Pass& candidate = passes[ready[i]];
+				if (candidate.writes == previous.writes && candidate.depth == previous.depth) {
+					pick = i;
+					break;
+				}
+			}
+		}
+
+		int p = ready[pick];
+		ready.erase(ready.begin() + pick);
+		order.push_back(p);
+		for (size_t i = 0; i < dependents[p].size(); i++) {
+			if (--waitingFor[dependents[p][i]] == 0)
+				ready.push_back(dependents[p][i]);
+		}
+	}
+}
+
+// Transient resources live from their first to their last use in the execution order.
+// A texture is handed to the next resource with the same descriptor once its previous owner is done with it
+void RenderGraph::assignTextures()
+{
+	const int UNUSED = -1;
+	std::vector<int> firstUse(resources.size(), UNUSED);
+	std::vector<int> lastUse(resources.size(), UNUSED);
+	for (int position = 0; position < (int)order.size(); position++) {
+		const Pass& pass = passes[order[position]];
+		std::vector<RenderResource> used = pass.reads;
+		used.insert(used.end(), pass.writes.begin(), pass.writes.end());
+		if (pass.depth != NO_RENDER_RESOURCE)
+			used.push_back(pass.depth);
+		for (size_t i = 0; i < used.size(); i++) {
+			if (firstUse[used[i]] == UNUSED)
+				firstUse[used[i]] = position;
+			lastUse[used[i]] = position;
+		}
+	}
+
+	// By first use, so every texture is free again as soon as possible
+	std::vector<RenderResource> byFirstUse;
+	for (RenderResource r = 0; r < (RenderResource)resources.size(); r++) {
+		resources[r].physical = -1;
+		if (!resources[r].imported && firstUse[r] != UNUSED)
+			byFirstUse.push_back(r);
+	}
+	for (size_t i = 1; i < byFirstUse.size(); i++) {
+		for (size_t j = i; j > 0 && firstUse[byFirstUse[j]] < firstUse[byFirstUse[j - 1]]; j--)
+			std::swap(byFirstUse[j], byFirstUse[j - 1]);
+	}
+
+	// Textures of an earlier compile are reused first
+	std::vector<bool> assigned(textures.size(), false);
+	for (size_t i = 0; i < textures.size(); i++)
+		textures[i].availableFrom = 0;
+
+	for (size_t i = 0; i < byFirstUse.size(); i++) {
+		Resource& resource = resources[byFirstUse[i]];
+		int physical = -1;
+		for (size_t t = 0; t < textures.size() && physical < 0; t++) {
+			if (textures[t].desc == resource.desc && textures[t].availableFrom <= firstUse[byFirstUse[i]])
+				physical = (int)t;
+		}
+		if (physical < 0) {
+			PhysicalTexture texture = { resource.desc, createTexture(resource.desc), 0 };
+			textures.push_back(texture);
+			assigned.push_back(false);
+			physical = (int)textures.size() - 1;
+		}
+		resource.physical = physical;
+		textures[physical].availableFrom = lastUse[byFirstUse[i]] + 1;
+		assigned[physical] = true;
+	}
+
+	// Textures the new graph doesn't need anymore are freed, together with the framebuffers using them
+	std::vector<int> remap(textures.size(), -1);
+	std::vector<PhysicalTexture> kept;
+	for (size_t t = 0; t < textures.size(); t++) {
+		if (assigned[t]) {
+			remap[t] = (int)kept.size();
+			kept.push_back(textures[t]);
+			continue;
+		}
+		for (std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.begin(); it != framebuffers.end();) {
+			if (std::find(it->first.begin(), it->first.end(), textures[t].texture) != it->first.end()) {
+				glDeleteFramebuffers(1, &it->second);
+				framebuffers.erase(it++);
+			}
+			else {
+				++it;
+			}
+		}
+		glDeleteTextures(1, &textures[t].texture);
+	}
+	textures.swap(kept);
+	for (size_t r = 0; r < resources.size(); r++) {
+		if (resources[r].physical >= 0)
+			resources[r].physical = remap[resources[r].physical];
+	}
+}
+
+void RenderGraph::createFramebuffers()
+{
+	// Textures may have moved, the blit framebuffers are looked up again
+	for (size_t i = 0; i < resources.size(); i++)
+		resources[i].readFramebuffer = 0;
+
+	for (size_t i = 0; i < order.size(); i++) {
+		Pass& pass = passes[order[i]];
+		pass.framebuffer = 0;
+		pass.width = pass.height = 0;
+
+		// An imported framebuffer comes with its own attachments
+		bool imported = false;
+		for (size_t w = 0; w < pass.writes.size(); w++) {
+			const Resource& resource = resources[pass.writes[w]];
+			if (resource.imported) {
+				if (pass.writes.size() > 1 || pass.depth != NO_RENDER_RESOURCE)
+					std::cout << "ERROR::RENDERGRAPH::IMPORTED_TARGET_NOT_ALONE " << pass.name << std::endl;
+				pass.framebuffer = resource.importedFramebuffer;
+				pass.width = resource.desc.width;
+				pass.height = resource.desc.height;
+				imported = true;
+			}
+		}
+		if (imported || (pass.writes.empty() && pass.depth == NO_RENDER_RESOURCE))
+			continue;
+
+		std::vector<GLuint> colors;
+		for (size_t w = 0; w < pass.writes.size(); w++)
+			colors.push_back(textures[resources[pass.writes[w]].physical].texture);
+		GLuint depth = 0;
+		bool stencil = false;
+		if (pass.depth != NO_RENDER_RESOURCE) {
+			depth = textures[resources[pass.depth].physical].texture;
+			stencil = hasStencil(resources[pass.depth].desc.format);
+		}
+		pass.framebuffer = framebufferFor(colors, depth, stencil);
+
+		const RenderTargetDesc& size = resources[pass.writes.empty() ? pass.depth : pass.writes[0]].desc;
+		pass.width = size.width;
+		pass.height = size.height;
+	}
+}
+
+GLuint RenderGraph::framebufferFor(const std::vector<GLuint>& colors, GLuint depth, bool depthStencil) const
+{
+	std::vector<GLuint> key = colors;
+	key.push_back(depth);
+	std::map<std::vector<GLuint>, GLuint>::iterator it = framebuffers.find(key);
+	if (it != framebuffers.end())
+		return it->second;
+
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	std::vector<GLenum> drawBuffers;
+	for (size_t i = 0; i < colors.size(); i++) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum)i, GL_TEXTURE_2D, colors[i], 0);
+		drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum)i);
+	}
+	if (depth != 0) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, depthStencil ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	}
+	// Draw buffers are framebuffer state, so they're set once here
+	if (drawBuffers.empty()) {
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
+	else {
+		glDrawBuffers((GLsizei)drawBuffers.size(), &drawBuffers[0]);
+	}
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "ERROR::RENDERGRAPH::FRAMEBUFFER_NOT_COMPLETE " << status << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	framebuffers[key] = framebuffer;
+	return framebuffer;
+}
+
+GLuint RenderGraph::createTexture(const RenderTargetDesc& desc)
+{
+	GLenum format = GL_RGBA;
+	GLenum type = GL_UNSIGNED_BYTE;
+	switch (desc.format) {
+	case GL_RGBA16F:
+	case GL_RGBA32F:
+		type = GL_FLOAT;
+		break;
+	case GL_R8:
+		format = GL_RED;
+		break;
+	case GL_R16F:
+	case GL_R32F:
+		format = GL_RED;
+		type = GL_FLOAT;
+		break;
+	case GL_DEPTH24_STENCIL8:
+		format = GL_DEPTH_STENCIL;
+		type = GL_UNSIGNED_INT_24_8;
+		break;
+	case GL_DEPTH_COMPONENT24:
+	case GL_DEPTH_COMPONENT32F:
+		format = GL_DEPTH_COMPONENT;
+		type = GL_FLOAT;
+		break;
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0, format, type, NULL);
+	GLint filter = isDepthFormat(desc.format) ? GL_NEAREST : GL_LINEAR;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+bool RenderGraph::isDepthFormat(GLenum format)
+{
+	return format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+}
+
+bool RenderGraph::hasStencil(GLenum format)
+{
+	return format == GL_DEPTH24_STENCIL8;
+}
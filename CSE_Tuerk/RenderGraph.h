@@ -0,0 +1,159 @@
+#pragma once
+
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+#include <GL/glew.h>
+
+// Index of a resource in a RenderGraph
+typedef int RenderResource;
+const RenderResource NO_RENDER_RESOURCE = -1;
+
+// Size and format of a transient texture. Textures with equal descriptors can share memory
+struct RenderTargetDesc {
+	GLsizei width;
+	GLsizei height;
+	GLenum format;		// sized internal format, e.g. GL_RGBA8, GL_RGBA16F, GL_R8, GL_DEPTH24_STENCIL8
+
+	RenderTargetDesc(GLsizei _width = 0, GLsizei _height = 0, GLenum _format = GL_RGBA8)
+		: width(_width), height(_height), format(_format)
+	{}
+
+	bool operator<(const RenderTargetDesc& other) const
+	{
+		if (width != other.width) return width < other.width;
+		if (height != other.height) return height < other.height;
+		return format < other.format;
+	}
+	bool operator==(const RenderTargetDesc& other) const
+	{
+		return width == other.width && height == other.height && format == other.format;
+	}
+};
+
+class RenderGraph;
+
+// What a pass gets to see while it executes. Its framebuffer is already bound and the viewport set
+struct RenderPassContext {
+	const RenderGraph* graph;
+	GLuint framebuffer;
+	GLsizei width;
+	GLsizei height;
+
+	// GL texture behind a resource the pass declared as read
+	GLuint texture(RenderResource resource) const;
+	// Copies (a part of) a resource into the bound framebuffer, scaled to the whole viewport
+	void blit(RenderResource source, GLsizei sourceWidth, GLsizei sourceHeight, GLbitfield mask = GL_COLOR_BUFFER_BIT, GLenum filter = GL_LINEAR) const;
+};
+
+typedef std::function<void(const RenderPassContext&)> RenderPassFunction;
+
+// Frame described as passes which declare the resources they read and write.
+// compile() orders the passes by their dependencies, culls passes nobody uses and lets transient
+// textures whose lifetimes don't overlap share the same GL texture. FBOs are cached per attachment set.
+// The graph is meant to be set up once and executed every frame, it is only compiled again after a change.
+class RenderGraph
+{
+public:
+	// Returned by addPass to declare what the pass accesses
+	class PassBuilder
+	{
+	public:
+		PassBuilder(RenderGraph* _graph, int _pass) : graph(_graph), pass(_pass) {}
+
+		// Sampled as a texture
+		PassBuilder& read(RenderResource resource);
+		// Color attachment, in the order of the calls (MRT). Existing contents are kept, the pass clears if it wants to
+		PassBuilder& write(RenderResource resource);
+		// Depth(-stencil) attachment, only tested against if readOnly
+		PassBuilder& depth(RenderResource resource, bool readOnly = false);
+		// Never culled, even if nothing reads what it writes
+		PassBuilder& keepAlive();
+
+	private:
+		RenderGraph* graph;
+		int pass;
+	};
+
+	RenderGraph();
+	~RenderGraph();
+
+	// Texture owned by the graph, only alive between its first and last use
+	RenderResource createTarget(const std::string& name, const RenderTargetDesc& desc);
+	// Framebuffer owned by someone else (e.g. 0 = window). Passes writing it are never culled
+	RenderResource importFramebuffer(const std::string& name, GLuint framebuffer, GLsizei width, GLsizei height);
+
+	// name has to be a string literal, it is used for the profiler zones
+	PassBuilder addPass(const char* name, RenderPassFunction execute);
+
+	// Compiles if needed and runs all passes
+	void execute();
+	// Drops all passes and resources, GL objects are kept for the next graph
+	void reset();
+	// Deletes all GL objects
+	void destroy();
+
+	// Statistics of the last compile
+	void printStatistics() const;
+	size_t executedPassCount() const { return order.size(); }
+	size_t textureCount() const { return textures.size(); }
+
+private:
+	struct Resource {
+		std::string name;
+		RenderTargetDesc desc;
+		bool imported;
+		GLuint importedFramebuffer;
+		int physical;			// index into textures, -1 if imported or unused
+		mutable GLuint readFramebuffer;	// blits from it, looked up on the first blit after a compile
+	};
+
+	struct Pass {
+		const char* name;
+		RenderPassFunction execute;
+		std::vector<RenderResource> reads;
+		std::vector<RenderResource> writes;
+		RenderResource depth;
+		bool depthReadOnly;
+		bool keepAlive;
+		// Filled by compile
+		std::vector<int> dependencies;
+		bool culled;
+		GLuint framebuffer;
+		GLsizei width;
+		GLsizei height;
+	};
+
+	struct PhysicalTexture {
+		RenderTargetDesc desc;
+		GLuint texture;
+		int availableFrom;		// first position in the order where it is free again
+	};
+
+	friend struct RenderPassContext;
+
+	void compile();
+	void buildDependencies();
+	void cullPasses();
+	void sortPasses();
+	void assignTextures();
+	void createFramebuffers();
+	GLuint framebufferFor(const std::vector<GLuint>& colors, GLuint depth, bool depthStencil) const;
+	static GLuint createTexture(const RenderTargetDesc& desc);
+	static bool isDepthFormat(GLenum format);
+	static bool hasStencil(GLenum format);
+
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<int> order;					// passes in execution order (without the culled ones)
+	std::vector<PhysicalTexture> textures;	// kept over reset(), so a rebuilt graph reuses them
+	mutable std::map<std::vector<GLuint>, GLuint> framebuffers;	// key: color textures..., depth texture
+	bool compiled;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "ScreenshotWriter.h"
+
+#include <iostream>
+#include <cstring>
+#include <ctime>
+
+#include <SOIL.h>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "PixelConversion.h"
+
+ScreenshotWriter::ScreenshotWriter()
+	: stopping(false), counter(0)
+{}
+
+ScreenshotWriter::~ScreenshotWriter()
+{
+	stop();
+}
+
+void ScreenshotWriter::start()
+{
+	if (thread.joinable())
+		return;
+	stopping = false;
+	thread = std::thread(&ScreenshotWriter::run, this);
+}
+
+void ScreenshotWriter::stop()
+{
+	if (!thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	thread.join();
+}
+
+void ScreenshotWriter::save(const std::string& path, ReadbackImage& image)
+{
+	Job job;
+	job.path = path;
+	job.image.width = image.width;
+	job.image.height = image.height;
+	job.image.pixels.swap(image.pixels);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wakeUp.notify_one();
+}
+
+std::string ScreenshotWriter::nextPath()
+{
+	char stamp[32];
+	time_t now = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+	return std::string("screenshot_") + stamp + "_" + std::to_string(++counter) + ".bmp";
+}
+
+void ScreenshotWriter::run()
+{
+	Profiler::setThreadName("Screenshots");
+	MemoryTracker::setThreadTag(MEMORY_TAG_CAPTURE);
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wakeUp.wait(lock, [this] { return stopping || !jobs.empty(); });
+		if (jobs.empty())
+			return;
+
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+
+		lock.unlock();
+		if (write(job)) {
+			std::cout << "Saved " << job.path << std::endl;
+		}
+		lock.lock();
+	}
+}
+
+// GL rows start at the bottom and the alpha of the back buffer is whatever the blending left there,
+// so the rows are flipped and alpha dropped in one go
+bool ScreenshotWriter::write(const Job& job)
+{
+	PROFILE_ZONE("SaveScreenshot");
+	GLsizei width = job.image.width;
+	GLsizei height = job.image.height;
+	std::vector<unsigned char> rgb((size_t)width * height * 3);
+	flipRGBAToRGB(&job.image.pixels[0], width, height, &rgb[0]);
+
+	int type = SOIL_SAVE_TYPE_TGA;
+	size_t dot = job.path.rfind('.');
+	std::string extension = dot == std::string::npos ? "" : job.path.substr(dot);
+	if (extension == ".bmp")
+		type = SOIL_SAVE_TYPE_BMP;
+	else if (extension == ".dds")
+		type = SOIL_SAVE_TYPE_DDS;
+
+	if (!SOIL_save_image(job.path.c_str(), type, width, height, 3, &rgb[0])) {
+		std::cout << "ERROR::SCREENSHOT::SAVE_FAILED " << job.path << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef SCREENSHOTWRITER_H
+#define SCREENSHOTWRITER_H
+
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "AsyncReadback.h"
+
+// Flips, converts and encodes read back images on a background thread, so the render thread only queues them.
+// The format follows the file extension: .bmp, .dds, everything else is written as TGA
+class ScreenshotWriter
+{
+public:
+	ScreenshotWriter();
+	~ScreenshotWriter();
+
+	void start();
+	// Writes everything still queued, then ends the thread
+	void stop();
+
+	// Takes the pixels of the image, it is empty afterwards
+	void save(const std::string& path, ReadbackImage& image);
+
+	// screenshot_<date>_<time>_<n>.bmp, unique for this run
+	std::string nextPath();
+
+private:
+	struct Job {
+		std::string path;
+		ReadbackImage image;
+	};
+
+	void run();
+	static bool write(const Job& job);
+
+	std::deque<Job> jobs;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::thread thread;
+	bool stopping;
+	int counter;
+};
+
+#endif
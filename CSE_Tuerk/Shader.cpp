@@ -35,9 +35,19 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
 	{
 		std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
 	}
-	const GLchar* vShaderCode = vertexCode.c_str();
-	const GLchar * fShaderCode = fragmentCode.c_str();
 	// 2. Compile shaders
+	this->compile(vertexCode.c_str(), fragmentCode.c_str());
+}
+
+Shader* Shader::FromSource(const std::string& vertexCode, const std::string& fragmentCode)
+{
+	Shader* shader = new Shader();
+	shader->compile(vertexCode.c_str(), fragmentCode.c_str());
+	return shader;
+}
+
+void Shader::compile(const GLchar* vShaderCode, const GLchar* fShaderCode)
+{
 	GLuint vertex, fragment;
 	GLint success;
 	GLchar infoLog[512];
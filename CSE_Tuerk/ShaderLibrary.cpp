@@ -0,0 +1,197 @@
+#include "ShaderLibrary.h"
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+#include <algorithm>
+
+// Names of the #defines, in the same order as the ShaderFeature bits
+static const char* FEATURE_DEFINES[SHADER_FEATURE_COUNT] = {
+	"INSTANCED",
+	"TEXTURED",
+	"LOD_TINT",
+	"VERTEX_UV",
+	"OIT",
+	"CLUSTERED_LIGHTING"
+};
+
+// Nested includes deeper than this are an error, this also stops cycles through differently spelled paths
+const int MAX_INCLUDE_DEPTH = 8;
+
+ShaderLibrary::ShaderLibrary()
+{}
+
+ShaderLibrary::~ShaderLibrary()
+{
+	// Several keys can point to the same program, so only delete the unique ones
+	for (std::map<std::string, Shader*>::iterator it = programs.begin(); it != programs.end(); ++it) {
+		glDeleteProgram(it->second->Program);
+		delete it->second;
+	}
+}
+
+Shader* ShaderLibrary::get(const std::string& vertexPath, const std::string& fragmentPath, GLuint features)
+{
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	// Texture coordinates only exist in the position + uv vertex format
+	if ((features & SHADER_TEXTURED) && !(features & SHADER_VERTEX_UV)) {
+		std::cout << "ERROR::SHADERLIBRARY::TEXTURED_NEEDS_VERTEX_UV " << vertexPath << std::endl;
+		features &= ~SHADER_TEXTURED;
+	}
+
+	VariantKey key = { vertexPath, fragmentPath, features };
+	std::map<VariantKey, Shader*>::iterator found = variants.find(key);
+	if (found != variants.end())
+		return found->second;
+
+	std::string vertexCode, fragmentCode;
+	if (!preprocess(vertexPath, features, vertexCode) || !preprocess(fragmentPath, features, fragmentCode)) {
+		std::cout << "ERROR::SHADERLIBRARY::PREPROCESSING_FAILED " << vertexPath << " " << fragmentPath << " " << features << std::endl;
+		return NULL;
+	}
+
+	// Different keys can end up with the same source (e.g. a feature the files don't use), compile those only once
+	std::string source = vertexCode + '\0' + fragmentCode;
+	std::map<std::string, Shader*>::iterator same = programs.find(source);
+	if (same != programs.end()) {
+		variants[key] = same->second;
+		return same->second;
+	}
+
+	if (programs.size() >= MAX_SHADER_VARIANTS) {
+		std::cout << "ERROR::SHADERLIBRARY::TOO_MANY_VARIANTS " << vertexPath << " " << features << std::endl;
+		return NULL;
+	}
+
+	PROFILE_ZONE("CompileShader");
+	Shader* shader = Shader::FromSource(vertexCode, fragmentCode);
+	programs[source] = shader;
+	variants[key] = shader;
+	return shader;
+}
+
+bool ShaderLibrary::preprocess(const std::string& path, GLuint features, std::string& out)
+{
+	std::string body;
+	std::set<std::string> included;
+	std::vector<std::string> expanding;
+	if (!appendFile(path, body, included, expanding))
+		return false;
+
+	// The #version directive has to stay the first statement, the feature defines go right after it
+	std::string version;
+	if (body.compare(0, 8, "#version") == 0) {
+		size_t end = body.find('\n');
+		version = body.substr(0, end + 1);
+		body.erase(0, end + 1);
+	}
+
+	std::string defines;
+	for (int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+		if (features & (1 << i))
+			defines += std::string("#define ") + FEATURE_DEFINES[i] + " 1\n";
+	}
+
+	// Which file each source string number of the driver errors stands for
+	std::ostringstream files;
+	for (std::set<std::string>::iterator it = included.begin(); it != included.end(); ++it)
+		files << "// source " << sourceId(*it) << ": " << *it << "\n";
+
+	// Keep the line numbers of compile errors in sync with the file
+	std::ostringstream line;
+	line << "#line 2 " << sourceId(path) << "\n";
+	out = version + defines + files.str() + line.str() + body;
+	return true;
+}
+
+bool ShaderLibrary::appendFile(const std::string& path, std::string& out, std::set<std::string>& included, std::vector<std::string>& expanding)
+{
+	if ((int)expanding.size() > MAX_INCLUDE_DEPTH) {
+		std::cout << "ERROR::SHADERLIBRARY::INCLUDE_TOO_DEEP " << path << std::endl;
+		return false;
+	}
+	// A file including itself, directly or through others, would otherwise be skipped below and compile without it
+	if (std::find(expanding.begin(), expanding.end(), path) != expanding.end()) {
+		std::cout << "ERROR::SHADERLIBRARY::INCLUDE_CYCLE";
+		for (size_t i = 0; i < expanding.size(); i++)
+			std::cout << " " << expanding[i] << " ->";
+		std::cout << " " << path << std::endl;
+		return false;
+	}
+	// Every file is pasted only once per variant (like #pragma once), e.g. a file two others include
+	if (!included.insert(path).second)
+		return true;
+
+	const std::string* source = readFile(path);
+	if (source == NULL)
+		return false;
+
+	// Includes are resolved relative to the including file
+	std::string directory;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != std::string::npos)
+		directory = path.substr(0, slash + 1);
+
+	std::istringstream lines(*source);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(lines, line)) {
+		lineNumber++;
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			out += line + "\n";
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = line.find('"', open + 1);
+		if (open == std::string::npos || close == std::string::npos) {
+			std::cout << "ERROR::SHADERLIBRARY::BAD_INCLUDE " << path << "(" << lineNumber << ")" << std::endl;
+			return false;
+		}
+		std::string includePath = directory + line.substr(open + 1, close - open - 1);
+		std::ostringstream lineDirective;
+		lineDirective << "#line 1 " << sourceId(includePath) << "\n";
+		out += lineDirective.str();
+		expanding.push_back(path);
+		bool appended = appendFile(includePath, out, included, expanding);
+		expanding.pop_back();
+		if (!appended)
+			return false;
+		lineDirective.str("");
+		lineDirective << "#line " << (lineNumber + 1) << " " << sourceId(path) << "\n";
+		out += lineDirective.str();
+	}
+	return true;
+}
+
+const std::string* ShaderLibrary::readFile(const std::string& path)
+{
+	std::map<std::string, std::string>::iterator cached = files.find(path);
+	if (cached != files.end())
+		return &cached->second;
+
+	std::ifstream file(path.c_str());
+	if (!file.is_open()) {
+		std::cout << "ERROR::SHADERLIBRARY::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+		return NULL;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	return &(files[path] = stream.str());
+}
+
+int ShaderLibrary::sourceId(const std::string& path)
+{
+	std::map<std::string, int>::iterator found = sourceIds.find(path);
+	if (found != sourceIds.end())
+		return found->second;
+	int id = (int)sourcePaths.size();
+	sourceIds[path] = id;
+	sourcePaths.push_back(path);
+	return id;
+}
+
+const std::string* ShaderLibrary::sourcePath(int id) const
+{
+	return id >= 0 && id < (int)sourcePaths.size() ? &sourcePaths[id] : NULL;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef SHADERLIBRARY_H
+#define SHADERLIBRARY_H
+
+#include <string>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <GL/glew.h>
+#include "shader.h"
+
+// Feature bits which make up the permutation key of a shader variant. Every bit is turned into a #define
+// at the top of the shader source, so a variant only contains the code it really needs (no uniform branching)
+enum ShaderFeature {
+	SHADER_INSTANCED = 1 << 0,		// INSTANCED ... per-object offset is read from vertex attribute 2 instead of the "model" uniform
+	SHADER_TEXTURED = 1 << 1,		// TEXTURED ... sample "cubeTexture" with the vertex texture coordinates (needs SHADER_VERTEX_UV)
+	SHADER_LOD_TINT = 1 << 2,		// LOD_TINT ... tint by camera distance on the GPU instead of setting "colorLOD" per object
+	SHADER_VERTEX_UV = 1 << 3,		// VERTEX_UV ... vertex format is position + texture coordinates (otherwise position only)
+	SHADER_OIT = 1 << 4,			// OIT ... write weighted blended transparency (accumulation + weight targets) instead of a color
+	SHADER_CLUSTERED_LIGHTING = 1 << 5,	// CLUSTERED_LIGHTING ... shade with the point lights of the fragment's cluster (ClusteredLighting)
+	SHADER_FEATURE_COUNT = 6
+};
+
+// Upper limit of compiled programs. The key space is small, so hitting it means something requests variants in a loop
+const size_t MAX_SHADER_VARIANTS = 32;
+
+// Loads shader sources, resolves #include directives, injects the feature #defines and compiles
+// each variant the first time it is requested. Variants with identical final source share one program.
+class ShaderLibrary
+{
+public:
+	ShaderLibrary();
+	~ShaderLibrary();
+
+	// Returns the program for the given sources and feature bits, compiles it on first use. NULL if the limit is reached
+	// or a file (or an include) can't be read or includes itself, failed variants aren't cached so a later call tries again
+	Shader* get(const std::string& vertexPath, const std::string& fragmentPath, GLuint features);
+
+	// Number of programs which were actually compiled (<= number of requested keys)
+	size_t compileCount() const { return programs.size(); }
+	// File behind the source string number in a driver error (the second number of the #line directives), NULL if unknown
+	const std::string* sourcePath(int id) const;
+
+private:
+	struct VariantKey {
+		std::string vertexPath;
+		std::string fragmentPath;
+		GLuint features;
+
+		bool operator<(const VariantKey& other) const {
+			if (features != other.features) return features < other.features;
+			if (vertexPath != other.vertexPath) return vertexPath < other.vertexPath;
+			return fragmentPath < other.fragmentPath;
+		}
+	};
+
+	bool preprocess(const std::string& path, GLuint features, std::string& out);
+	// expanding holds the files whose includes are being resolved, from the top level file down
+	bool appendFile(const std::string& path, std::string& out, std::set<std::string>& included, std::vector<std::string>& expanding);
+	const std::string* readFile(const std::string& path);
+	// Source string number of a file, the same in every variant
+	int sourceId(const std::string& path);
+
+	std::map<std::string, std::string> files;		// raw file contents, every file is read from disk only once
+	std::map<VariantKey, Shader*> variants;			// permutation key -> program
+	std::map<std::string, Shader*> programs;		// preprocessed vertex + fragment source -> program (deduplication)
+	std::map<std::string, int> sourceIds;			// path -> source string number in #line directives
+	std::vector<std::string> sourcePaths;			// source string number -> path
+};
+
+#endif
@@ -0,0 +1,44 @@
+// Transform and tint helpers shared by all object shader variants
+
+uniform mat4 view;
+uniform mat4 projection;
+
+#ifdef INSTANCED
+layout (location = 2) in vec3 instanceOffset;
+#else
+uniform mat4 model;
+#endif
+
+// World space position of a vertex, either from the instance offset or from the model matrix
+vec4 worldPosition(vec3 position)
+{
+#ifdef INSTANCED
+	return vec4(position + instanceOffset, 1.0f);
+#else
+	return model * vec4(position, 1.0f);
+#endif
+}
+
+// Origin of the object the vertex belongs to
+vec3 objectCenter()
+{
+#ifdef INSTANCED
+	return instanceOffset;
+#else
+	return model[3].xyz;
+#endif
+}
+
+#ifdef LOD_TINT
+uniform vec3 viewPos;
+
+// Same distance bands as SimpleObject::levelOfDetail, selected without branching
+vec3 lodTint(vec3 center)
+{
+	float dist = length(viewPos - center);
+	vec3 tintNear = vec3(1.0f, 236.0f / 255.0f, 179.0f / 255.0f);
+	vec3 tintMiddle = vec3(1.0f, 193.0f / 255.0f, 7.0f / 255.0f);
+	vec3 tintFar = vec3(1.0f, 111.0f / 255.0f, 0.0f);
+	return mix(tintNear, mix(tintMiddle, tintFar, step(40.0f, dist)), step(20.0f, dist));
+}
+#endif
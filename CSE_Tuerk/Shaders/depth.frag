@@ -0,0 +1,7 @@
+#version 330 core
+
+// Depth pre-pass: nothing to shade, only the depth of the fragment is written
+
+void main()
+{
+}
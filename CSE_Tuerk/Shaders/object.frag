@@ -0,0 +1,75 @@
+#version 330 core
+in vec4 ourColor;
+#ifdef VERTEX_UV
+in vec2 TexCoord;
+#endif
+
+#ifdef OIT
+// Weighted blended order-independent transparency, blended with ONE, ONE (rgb) and ZERO, ONE_MINUS_SRC_ALPHA (alpha):
+// target 0 sums up the weighted premultiplied color and multiplies the revealage in alpha, target 1 sums up the weights
+layout (location = 0) out vec4 accum;
+layout (location = 1) out float weight;
+#else
+out vec4 color;
+#endif
+
+#ifdef TEXTURED
+uniform sampler2D cubeTexture;
+#endif
+
+#ifdef CLUSTERED_LIGHTING
+in vec3 viewPosition;
+
+// Filled by ClusteredLighting every frame, all positions are in view space
+uniform samplerBuffer lightData;		// 2 texels per light: position + radius, color + intensity
+uniform usamplerBuffer clusterGrid;		// per cluster: offset into lightIndices, number of lights
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterCount;				// tiles x, tiles y, depth slices
+uniform vec2 clusterTileSize;			// in pixels
+uniform vec2 clusterSliceParams;		// slice = log(depth) * x + y
+uniform vec3 ambientLight;
+
+// Diffuse light of all point lights in the cluster of this fragment
+vec3 clusteredLighting(vec3 position)
+{
+	// The vertex format has no normals, the face normal comes from the screen space derivatives instead
+	vec3 normal = normalize(cross(dFdx(position), dFdy(position)));
+
+	ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTileSize), clusterCount.xy - 1);
+	int slice = clamp(int(log(-position.z) * clusterSliceParams.x + clusterSliceParams.y), 0, clusterCount.z - 1);
+	uvec2 range = texelFetch(clusterGrid, (slice * clusterCount.y + tile.y) * clusterCount.x + tile.x).xy;
+
+	vec3 light = ambientLight;
+	for (uint i = 0u; i < range.y; i++) {
+		int index = int(texelFetch(lightIndices, int(range.x + i)).x);
+		vec4 positionRadius = texelFetch(lightData, index * 2);
+		vec4 colorIntensity = texelFetch(lightData, index * 2 + 1);
+		vec3 toLight = positionRadius.xyz - position;
+		float dist = length(toLight);
+		float falloff = clamp(1.0f - dist / positionRadius.w, 0.0f, 1.0f);
+		light += colorIntensity.rgb * colorIntensity.a * falloff * falloff * max(dot(normal, toLight / max(dist, 1e-4f)), 0.0f);
+	}
+	return light;
+}
+#endif
+
+void main()
+{
+#ifdef TEXTURED
+	vec4 result = texture(cubeTexture, TexCoord) * ourColor;
+#else
+	vec4 result = ourColor;
+#endif
+#ifdef CLUSTERED_LIGHTING
+	result.rgb *= clusteredLighting(viewPosition);
+#endif
+
+#ifdef OIT
+	// Near and opaque fragments count more (weight function from McGuire & Bavoil)
+	float w = clamp(pow(min(1.0f, result.a * 10.0f) + 0.01f, 3.0f) * 1e8 * pow(1.0f - gl_FragCoord.z * 0.9f, 3.0f), 1e-2, 3e3);
+	accum = vec4(result.rgb * result.a * w, result.a);
+	weight = result.a * w;
+#else
+	color = result;
+#endif
+}
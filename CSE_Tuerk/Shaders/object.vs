@@ -0,0 +1,35 @@
+#version 330 core
+#include "common.glsl"
+
+layout (location = 0) in vec3 position;
+#ifdef VERTEX_UV
+layout (location = 1) in vec2 texCoord;
+out vec2 TexCoord;
+#endif
+
+out vec4 ourColor;
+#ifdef CLUSTERED_LIGHTING
+out vec3 viewPosition;
+#endif
+
+// The depth pre-pass uses another variant, the main pass only passes GL_EQUAL if both compute the exact same depth
+invariant gl_Position;
+
+uniform vec4 inColor;
+
+void main()
+{
+    // Note that we read the multiplication from right to left
+    gl_Position = projection * view * worldPosition(position);
+#ifdef CLUSTERED_LIGHTING
+    viewPosition = (view * worldPosition(position)).xyz;
+#endif
+#ifdef VERTEX_UV
+    TexCoord = vec2(texCoord.x, 1.0 - texCoord.y);
+#endif
+#ifdef LOD_TINT
+    ourColor = inColor * vec4(lodTint(objectCenter()), 1.0f);
+#else
+    ourColor = inColor;
+#endif
+}
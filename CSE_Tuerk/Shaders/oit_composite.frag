@@ -0,0 +1,20 @@
+#version 330 core
+// Resolves the weighted blended transparency targets over the opaque scene (blended with SRC_ALPHA, ONE_MINUS_SRC_ALPHA)
+
+out vec4 color;
+
+uniform sampler2D accumTexture;
+uniform sampler2D weightTexture;
+
+void main()
+{
+	// The viewport matches the area the targets were rendered into, so the pixel can be fetched directly
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 accum = texelFetch(accumTexture, pixel, 0);
+	float revealage = accum.a;
+	if (revealage >= 1.0f)
+		discard;	// nothing transparent in this pixel
+
+	float weightSum = texelFetch(weightTexture, pixel, 0).r;
+	color = vec4(accum.rgb / max(weightSum, 1e-5f), 1.0f - revealage);
+}
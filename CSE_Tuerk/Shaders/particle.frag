@@ -0,0 +1,15 @@
+#version 330 core
+// Round particles fading out to the edge, blended additively (ONE, ONE)
+
+in vec2 corner;
+in vec4 ourColor;
+
+out vec4 color;
+
+void main()
+{
+	float falloff = 1.0f - dot(corner, corner);
+	if (falloff <= 0.0f)
+		discard;
+	color = vec4(ourColor.rgb * (ourColor.a * falloff), 1.0f);
+}
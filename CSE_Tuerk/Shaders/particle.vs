@@ -0,0 +1,22 @@
+#version 330 core
+// Camera facing quads, one instance per particle. The corners come from gl_VertexID, there is no vertex buffer
+
+layout (location = 0) in vec4 particle;			// position, age (0 when emitted, 1 when it dies)
+layout (location = 1) in vec4 particleColor;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float particleSize;
+
+out vec2 corner;
+out vec4 ourColor;
+
+void main()
+{
+	// Triangle strip: (-1, -1), (1, -1), (-1, 1), (1, 1)
+	corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0f - 1.0f;
+	// Spread out in view space, so the quad always faces the camera
+	vec4 center = view * vec4(particle.xyz, 1.0f);
+	gl_Position = projection * (center + vec4(corner * particleSize * 0.5f, 0.0f, 0.0f));
+	ourColor = vec4(particleColor.rgb, particleColor.a * (1.0f - particle.w));
+}
@@ -37,6 +37,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "soil_allocator.h"
 
 /*	error reporting	*/
 char *result_string_pointer = "SOIL initialized";
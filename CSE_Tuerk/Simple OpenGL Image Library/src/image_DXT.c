@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include "soil_allocator.h"
 
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
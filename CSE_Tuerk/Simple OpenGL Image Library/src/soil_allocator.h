@@ -0,0 +1,32 @@
+/*
+	Include after <stdlib.h>. With SOIL_TRACKED_ALLOCATOR defined, all heap memory of SOIL and
+	stb_image goes through allocation functions the application provides (e.g. to count it).
+	Without it nothing changes.
+*/
+
+#ifndef HEADER_SOIL_ALLOCATOR
+#define HEADER_SOIL_ALLOCATOR
+
+#ifdef SOIL_TRACKED_ALLOCATOR
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *soil_tracked_malloc( size_t size );
+void *soil_tracked_realloc( void *memory, size_t size );
+void soil_tracked_free( void *memory );
+
+#ifdef __cplusplus
+}
+#endif
+
+#define malloc(size) soil_tracked_malloc(size)
+#define realloc(memory, size) soil_tracked_realloc(memory, size)
+#define free(memory) soil_tracked_free(memory)
+
+#endif /* SOIL_TRACKED_ALLOCATOR */
+
+#endif /* HEADER_SOIL_ALLOCATOR */
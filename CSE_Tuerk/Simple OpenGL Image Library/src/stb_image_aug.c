@@ -77,6 +77,7 @@
 #include <memory.h>
 #include <assert.h>
 #include <stdarg.h>
+#include "soil_allocator.h"
 
 #ifndef _MSC_VER
   #ifdef __cplusplus
@@ -5,6 +5,19 @@
 
 #include <GL/glew.h>
 #include "shader.h"
+#include "ShaderLibrary.h"
+#include "Profiler.h"
+#include "BatchMath.h"
+#include "FrameArena.h"
+#include "GpuResources.h"
+#include "MeshRegistry.h"
+#include "InstanceBatch.h"
+#include "DirtyRanges.h"
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
 
 class SimpleObject
 {
@@ -15,26 +28,55 @@ public:
 	size_t sizeof_indices;
 	std::vector<glm::vec3> positions;
 	GLfloat color[4];
-	GLuint VAO; 
-	GLuint VBO;
-	GLuint EBO;
+	MeshRegistry* meshes;		// set by prepare()
+	GpuResources* resources;	// owns the GL objects below
+	Mesh* mesh;				// geometry, possibly shared with other objects
+	Mesh* depthMesh;		// tightly packed positions for the depth pre-pass
+	GpuHandle instanceVBO;	// per-instance offsets (attribute 2), only used by SHADER_INSTANCED variants
+	GpuHandle streamedVBO;	// offsets filled by someone else (streamInstances), drawn instead of positions
+	const std::vector<InstanceBatch>* streamedBatches;	// NULL = draw positions
+	Shader* depthShader;	// owned by the library
+	GLfloat batchSize;		// instances are grouped into cells of this size and drawn front to back per cell, 0 = one batch
 	Shader* shader;
-	GLuint texture;
+	GLuint shaderFeatures;	// ShaderFeature bits of the variant in use
+	bool libraryShader;		// shader comes from a ShaderLibrary (uniform layout of object.vs)
+	GpuHandle texture;		// released with the object
 	int type;	// 1...vertices, 0...triangles
 
 protected:
 	GLint modelLoc;
 	GLint viewLoc;
 	GLint projLoc;
+	size_t instanceCount;	// number of positions currently uploaded to instanceVBO
+	std::vector<glm::vec3> instanceData;	// instanceVBO contents when grouped into batches, empty = positions in order
+	std::vector<GLuint> instanceSlots;		// per position, its element in instanceVBO when grouped
+	DirtyRanges dirtyInstances;				// elements of instanceVBO changed by setPosition
+
+	std::vector<InstanceBatch> batches;		// one per grid cell, in instanceVBO
+	std::vector<std::pair<GLfloat, int> > batchOrder;	// distance, batch index; kept to avoid allocations per frame
+	PointsSoA sortPositions;				// positions as SoA for the distance kernel, scratch of sortBackToFront
+	SimdFloatArray sortDistances;
+	std::vector<glm::vec3> drawOrder;		// sortAndDraw, kept to avoid allocations per frame
+
+	struct SortKey {
+		GLfloat distance;
+		GLuint index;
+		bool operator<(const SortKey& other) const
+		{
+			return distance < other.distance || (distance == other.distance && index < other.index);
+		}
+	};
 
 public:
 	
 	SimpleObject(GLfloat _vertices[], size_t _sizeof_vertices)
+		: dirtyInstances(sizeof(glm::vec3))
 	{
 		init(_vertices, _sizeof_vertices);
 	}
 	
 	SimpleObject(GLfloat _vertices[], size_t _sizeof_vertices, GLuint _indices[], size_t _sizeof_indices)
+		: dirtyInstances(sizeof(glm::vec3))
 	{
 		init(_vertices, _sizeof_vertices);
 
@@ -44,17 +86,49 @@ public:
 		sizeof_indices = _sizeof_indices;
 	}
 
-	~SimpleObject()
+	virtual ~SimpleObject()
 	{
-		delete vertices;
-		delete indices;
+		delete[] vertices;
+		delete[] indices;
 
-		// Properly de-allocate all resources once they've outlived their purpose
-		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VBO);
-		glDeleteBuffers(1, &EBO);
+		// The GL objects are deleted (or recycled) once the GPU is done with them, handles which were never created are null
+		if (meshes != NULL) {
+			meshes->release(mesh);
+			meshes->release(depthMesh);
+			resources->release(instanceVBO);
+			resources->release(texture);
+		}
+	}
+
+	// Moves one instance. Once uploaded only the moved instances go up again, with flushInstances().
+	// An instance stays in the batch it was grouped into, batches only order the drawing
+	void setPosition(size_t i, const glm::vec3& position)
+	{
+		positions[i] = position;
+		if (instanceCount != positions.size())
+			return;
+		size_t slot = i;
+		if (!instanceSlots.empty()) {
+			slot = instanceSlots[i];
+			instanceData[slot] = position;
+		}
+		dirtyInstances.mark(slot);
+	}
+
+	// Uploads the instances moved since the last call, at most the budget. Once per frame before drawing,
+	// the passes drawing the object (depth pre-pass, shading) then see the same instances
+	void flushInstances()
+	{
+		if (streamedBatches != NULL || dirtyInstances.empty() || instanceCount != positions.size())
+			return;
+		const std::vector<glm::vec3>& uploaded = instanceData.empty() ? positions : instanceData;
+		dirtyInstances.flush(resources->name(instanceVBO), &uploaded[0]);
 	}
 
+	// Bytes of moved instances uploaded per flushInstances() at most
+	void setInstanceUploadBudget(size_t bytes) { dirtyInstances.setBudget(bytes); }
+	const DirtyRanges& instanceUpdates() const { return dirtyInstances; }
+
 	void setColor(GLfloat _color[])
 	{
 		memcpy(color, _color, 4*sizeof(GLfloat));
@@ -78,25 +152,43 @@ public:
 		shader = new Shader(vs, frag);
 	}
 
+	// Uses a (cached) variant of the library. The program is owned by the library
+	void buildAndCompileShader(ShaderLibrary* library, const GLchar* vs, const GLchar* frag, GLuint features)
+	{
+		shader = library->get(vs, frag, features);
+		shaderFeatures = features;
+		libraryShader = true;
+	}
+
 	void bindTexture(char name[])
 	{
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
+		glBindTexture(GL_TEXTURE_2D, resources->name(texture));
 		glUniform1i(glGetUniformLocation((*shader).Program, name), 0);
 	}
 
-	void prepare(int _type) {
+	// Registers the vertices (and indices), objects with the same geometry share its buffers
+	void prepare(int _type, MeshRegistry* registry) {
 		type = _type;
+		meshes = registry;
+		resources = registry->gpuResources();
+		mesh = meshes->acquire(vertices, sizeof_vertices, indices, sizeof_indices, vertexLayout());
+	}
 
-		if (type == 0) {
-			prepareTriangles();
-		}
-		else {
-			prepareVertices();
+	// Instanced objects draw these batches of buffer instead of their positions, e.g. the chunks of a ChunkStreamer.
+	// Both are read at every draw, so the owner may change them between frames
+	void streamInstances(GpuHandle buffer, const std::vector<InstanceBatch>* ranges)
+	{
+		streamedVBO = buffer;
+		streamedBatches = ranges;
+		batchOrder.reserve(ranges->capacity());
+		enableInstanceAttribute(mesh->vertexArray);
+		if (depthMesh != NULL) {
+			enableInstanceAttribute(depthMesh->vertexArray);
 		}
 	}
 
-	void activateShader(glm::mat4 view, glm::mat4 projection)
+	void activateShader(const glm::mat4& view, const glm::mat4& projection)
 	{
 		(*shader).Use();
 
@@ -110,122 +202,338 @@ public:
 		glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
 	}
 
-	void draw(Camera camera, bool _levelOfDetail) {
-		glBindVertexArray(VAO);
+	void draw(const Camera& camera, bool _levelOfDetail) {
+		if (shaderFeatures & SHADER_INSTANCED) {
+			drawInstanced(camera);
+			return;
+		}
+
+		glBindVertexArray(resources->name(mesh->vertexArray));
 		// Calculate model matrix for each object and pass it to shader before drawing
 		for (GLuint i = 0; i < positions.size(); i++) {
 			glm::mat4 model;
 			model = glm::translate(model, positions[i]);
 
-			if (_levelOfDetail == true) {
+			if (_levelOfDetail == true && !(shaderFeatures & SHADER_LOD_TINT)) {
 				levelOfDetail(camera, positions[i]);
 			}
 
 			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 
 			if (color != NULL) {
-				glUniform3fv(glGetUniformLocation((*shader).Program, "inColor"), 1, color);
+				setColorUniform(libraryShader);
 			}
 
 			if (type == 0) {
 				// triangles
-				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, 0);
 			}
 			else {
 				// vertices
-				glDrawArrays(GL_TRIANGLES, 0, 36);
+				glDrawArrays(GL_TRIANGLES, 0, mesh->vertexCount);
 			}
 		}
 		glBindVertexArray(0);
 	}
 
-	void sortAndDraw(Camera camera, bool _levelOfDetail)
+	void sortAndDraw(const Camera& camera, bool _levelOfDetail)
 	{
-		std::map<GLfloat, glm::vec3> sortedObjects = sortObjects(camera);
+		sortBackToFront(camera, drawOrder);
+		drawOrdered(drawOrder, camera, _levelOfDetail);
+	}
 
-		glBindVertexArray(VAO);
+	// Fills order with all positions sorted from far to near. It may run on another thread than the drawing, but only one caller at a
+	// time: it writes the scratch members sortPositions and sortDistances. The sort keys live in the frame arena of the calling thread,
+	// order keeps its memory from the last call
+	void sortBackToFront(const Camera& camera, std::vector<glm::vec3>& order)
+	{
+		PROFILE_ZONE("Sort");
+		// Squared distances sort the same way and are computed for all objects at once
+		sortPositions.assign(positions);
+		BatchMath::distanceSquared(camera.Position, sortPositions, sortDistances);
+
+		size_t count = positions.size();
+		SortKey* keys = FrameArena::thread().allocateArray<SortKey>(count);
+		for (size_t i = 0; i < count; i++) {
+			keys[i].distance = sortDistances[i];
+			keys[i].index = (GLuint)i;
+		}
+		std::sort(keys, keys + count);
+
+		order.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			order[i] = positions[keys[count - 1 - i].index];
+		}
+	}
+
+	// Draws one object at each of the given positions, in that order
+	void drawOrdered(const std::vector<glm::vec3>& order, const Camera& camera, bool _levelOfDetail)
+	{
+		glBindVertexArray(resources->name(mesh->vertexArray));
 		// Calculate model matrix for each object and pass it to shader before drawing
 		glm::mat4 model;
-		for (std::map<float, glm::vec3>::reverse_iterator it = sortedObjects.rbegin(); it != sortedObjects.rend(); ++it)
+		for (size_t i = 0; i < order.size(); i++)
 		{
 			model = glm::mat4();
-			model = glm::translate(model, it->second);
+			model = glm::translate(model, order[i]);
 			
-			if (_levelOfDetail == true) {
-				levelOfDetail(camera, it->second);
+			if (_levelOfDetail == true && !(shaderFeatures & SHADER_LOD_TINT)) {
+				levelOfDetail(camera, order[i]);
 			}
 
 			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
 			
 			if (color != NULL) {
-				glUniform4fv(glGetUniformLocation((*shader).Program, "inColor"), 1, color);
+				setColorUniform(true);
 			}
 
 			if (type == 0) {
 				// triangles
-				glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+				glDrawElements(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, 0);
 			}
 			else {
 				// vertices
-				glDrawArrays(GL_TRIANGLES, 0, 36);
+				glDrawArrays(GL_TRIANGLES, 0, mesh->vertexCount);
 			}
 		}
 		glBindVertexArray(0);
 	}
 
 protected:
-	std::map<GLfloat, glm::vec3> sortObjects(Camera camera)
+	// Draws all positions with a single call, the offsets come from the instance buffer
+	void drawInstanced(const Camera& camera)
 	{
-		std::map<GLfloat, glm::vec3> sortedObjects;
-		for (GLuint i = 0; i < positions.size(); i++) {
-			GLfloat distance = glm::length(camera.Position - positions[i]);
-			sortedObjects[distance] = positions[i];
+		if (!updateInstances()) {
+			return;
+		}
+
+		glBindVertexArray(resources->name(mesh->vertexArray));
+		if (shaderFeatures & SHADER_LOD_TINT) {
+			glUniform3fv(glGetUniformLocation((*shader).Program, "viewPos"), 1, glm::value_ptr(camera.Position));
 		}
-		return sortedObjects;
+		setColorUniform(true);
+
+		drawBatches(camera.Position);
+		glBindVertexArray(0);
 	}
 
-	void prepareTriangles()
+	// Draws the instanced batches front to back into the bound VAO. GL 3.3 has no base instance,
+	// so the instance attribute is pointed at the first offset of each batch instead.
+	// The VAO may be shared with other objects, so the pointer is always set to this object's buffer
+	void drawBatches(const glm::vec3& eye)
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glGenBuffers(1, &EBO);
-		// Bind the Vertex Array Object first, then bind and set vertex buffer(s) and attribute pointer(s).
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof_vertices, vertices, GL_STATIC_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof_indices, indices, GL_STATIC_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0); // call to glVertexAttribPointer registered VBO as the currently bound vertex buffer object so afterwards we can safely unbind
-		glBindVertexArray(0); // Unbind VAO (it's always a good thing to unbind any buffer/array to prevent strange bugs), remember: do NOT unbind the EBO, keep it bound to this VAO
+		if (streamedBatches == NULL && batches.size() <= 1) {
+			glBindBuffer(GL_ARRAY_BUFFER, resources->name(instanceVBO));
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			drawInstances((GLsizei)positions.size());
+			return;
+		}
+
+		const std::vector<InstanceBatch>& drawn = streamedBatches != NULL ? *streamedBatches : batches;
+		batchOrder.clear();
+		for (size_t i = 0; i < drawn.size(); i++) {
+			glm::vec3 d = drawn[i].center - eye;
+			batchOrder.push_back(std::make_pair(glm::dot(d, d), (int)i));
+		}
+		std::sort(batchOrder.begin(), batchOrder.end());
+
+		glBindBuffer(GL_ARRAY_BUFFER, resources->name(instanceBuffer()));
+		for (size_t i = 0; i < batchOrder.size(); i++) {
+			const InstanceBatch& batch = drawn[batchOrder[i].second];
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)(batch.first * sizeof(glm::vec3)));
+			drawInstances(batch.count);
+		}
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	void prepareVertices()
+	void drawInstances(GLsizei count)
 	{
-		glGenVertexArrays(1, &VAO);
-		glGenBuffers(1, &VBO);
-		glBindVertexArray(VAO);
-		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof_vertices, vertices, GL_STATIC_DRAW);
-		// Position attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(0);
-		// TexCoord attribute
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-		glEnableVertexAttribArray(1);
-		glBindVertexArray(0); // Unbind cubeVAO
+		if (type == 0) {
+			// triangles
+			glDrawElementsInstanced(GL_TRIANGLES, mesh->indexCount, GL_UNSIGNED_INT, 0, count);
+		}
+		else {
+			// vertices
+			glDrawArraysInstanced(GL_TRIANGLES, 0, mesh->vertexCount, count);
+		}
+	}
+
+	// (Re-)creates the per-instance vertex buffer from the positions array and hooks it up as attribute 2.
+	// With a batchSize the positions are stored grouped by grid cell, so each cell can be drawn on its own.
+	// The old buffer may still be read by frames in flight, the manager only hands it out again once they are done
+	void uploadInstances()
+	{
+		groupInstances();
+		const std::vector<glm::vec3>& uploaded = instanceData.empty() ? positions : instanceData;
+
+		resources->release(instanceVBO);
+		instanceVBO = resources->createBuffer(uploaded.size() * sizeof(glm::vec3), &uploaded[0], GL_DYNAMIC_DRAW);	// rewritten in parts by flushInstances()
+		enableInstanceAttribute(mesh->vertexArray);
+		if (depthMesh != NULL) {
+			enableInstanceAttribute(depthMesh->vertexArray);
+		}
+		instanceCount = positions.size();
+		dirtyInstances.clear();
+	}
+
+	// Uploads the positions again if their number changed, false if there is nothing to draw
+	bool updateInstances()
+	{
+		if (streamedBatches != NULL) {
+			return !streamedBatches->empty();
+		}
+		if (positions.empty()) {
+			return false;
+		}
+		if (instanceCount != positions.size()) {
+			uploadInstances();
+		}
+		return true;
+	}
+
+	GpuHandle instanceBuffer() const { return streamedBatches != NULL ? streamedVBO : instanceVBO; }
+
+	void enableInstanceAttribute(GpuHandle vao)
+	{
+		glBindVertexArray(resources->name(vao));
+		glBindBuffer(GL_ARRAY_BUFFER, resources->name(instanceBuffer()));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		glEnableVertexAttribArray(2);
+		glVertexAttribDivisor(2, 1);	// advance once per instance instead of once per vertex
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Sorts the positions into batches of one grid cell each, into instanceData. Without a batchSize the positions are uploaded as they are
+	void groupInstances()
+	{
+		batches.clear();
+		instanceData.clear();
+		instanceSlots.clear();
+		if (batchSize <= 0.0f) {
+			return;
+		}
+
+		std::map<std::vector<int>, std::vector<GLuint> > cells;
+		std::vector<int> key(3);
+		for (size_t i = 0; i < positions.size(); i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				key[axis] = (int)std::floor(positions[i][axis] / batchSize);
+			}
+			cells[key].push_back((GLuint)i);
+		}
+
+		instanceData.reserve(positions.size());
+		instanceSlots.resize(positions.size());
+		for (std::map<std::vector<int>, std::vector<GLuint> >::iterator it = cells.begin(); it != cells.end(); ++it) {
+			InstanceBatch batch;
+			batch.first = (GLint)instanceData.size();
+			batch.count = (GLsizei)it->second.size();
+			batch.center = glm::vec3(0.0f);
+			for (size_t i = 0; i < it->second.size(); i++) {
+				GLuint index = it->second[i];
+				batch.center += positions[index];
+				instanceSlots[index] = (GLuint)instanceData.size();
+				instanceData.push_back(positions[index]);
+			}
+			batch.center /= (GLfloat)batch.count;
+			batches.push_back(batch);
+		}
+	}
+
+public:
+	// Sets up depth-only drawing: a tightly packed copy of the positions (less to fetch than the full vertex format)
+	// and a variant of the vertex shader with an empty fragment shader. Needs prepare() first, only for instanced objects
+	void prepareDepthPass(ShaderLibrary* library, const GLchar* vs, const GLchar* frag)
+	{
+		depthShader = library->get(vs, frag, SHADER_INSTANCED);
+
+		GLuint stride = vertexLayout().stride;
+		size_t count = sizeof_vertices / sizeof(GLfloat) / stride;
+		std::vector<GLfloat> packed(count * 3);
+		for (size_t i = 0; i < count; i++) {
+			memcpy(&packed[i * 3], &vertices[i * stride], 3 * sizeof(GLfloat));
+		}
+
+		// Shared with position-only objects of the same shape (e.g. the light for the cubes)
+		depthMesh = meshes->acquire(&packed[0], packed.size() * sizeof(GLfloat), indices, sizeof_indices, VertexLayout::positions(), MESH_PACKED);
+		if (instanceCount != 0 || streamedBatches != NULL) {
+			enableInstanceAttribute(depthMesh->vertexArray);
+		}
+	}
+
+	// Writes only the depth of all instances, front to back. The caller masks the color writes
+	void drawDepth(const glm::mat4& view, const glm::mat4& projection, const Camera& camera)
+	{
+		if (depthMesh == NULL || depthShader == NULL || !updateInstances()) {
+			return;
+		}
+
+		depthShader->Use();
+		glUniformMatrix4fv(glGetUniformLocation(depthShader->Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+		glUniformMatrix4fv(glGetUniformLocation(depthShader->Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+		glBindVertexArray(resources->name(depthMesh->vertexArray));
+		drawBatches(camera.Position);
+		glBindVertexArray(0);
+	}
+
+	bool hasDepthPass() const { return depthMesh != NULL; }
+
+	// Box around the vertices, relative to each position
+	void localBounds(glm::vec3& min, glm::vec3& max) const
+	{
+		GLuint stride = vertexLayout().stride;
+		size_t count = sizeof_vertices / sizeof(GLfloat) / stride;
+		min = max = glm::vec3(vertices[0], vertices[1], vertices[2]);
+		for (size_t i = 1; i < count; i++) {
+			glm::vec3 position(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		}
+	}
+
+protected:
+	// Format of vertices, the position always comes first. Triangles are position only, vertices have texture coordinates
+	virtual VertexLayout vertexLayout() const { return type == 0 ? VertexLayout::positions() : VertexLayout::positionsUV(); }
+
+	// The library variants and plane.vs expect a vec4, the other original shaders a vec3
+	void setColorUniform(bool rgba)
+	{
+		GLint colorLoc = glGetUniformLocation((*shader).Program, "inColor");
+		if (rgba) {
+			glUniform4fv(colorLoc, 1, color);
+		}
+		else {
+			glUniform3fv(colorLoc, 1, color);
+		}
 	}
 
 	void init(GLfloat _vertices[], size_t _sizeof_vertices)
 	{
+		indices = NULL;	// only set by the constructor with indices
+		sizeof_indices = 0;
+		meshes = NULL;
+		resources = NULL;
+		mesh = NULL;
+		depthMesh = NULL;
+		instanceCount = 0;
+		streamedBatches = NULL;
+		depthShader = NULL;
+		batchSize = 0.0f;
+		shaderFeatures = 0;
+		libraryShader = false;
+		GLfloat white[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		setColor(white);
+
 		size_t array_size = _sizeof_vertices / sizeof(GLfloat);
 		vertices = new GLfloat[array_size];
 		memcpy(vertices, _vertices, _sizeof_vertices);
 		sizeof_vertices = _sizeof_vertices;
 	}
 	
-	void levelOfDetail(Camera camera, glm::vec3 pos) {
+	void levelOfDetail(const Camera& camera, const glm::vec3& pos) {
 		GLfloat lod = glm::length(camera.Position - pos);
 		if (lod < 20) {
 			GLfloat _color1[] = { 1.0f, 236./255., 179/255. };
@@ -0,0 +1,309 @@
+#include "SparseVoxels.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "MemoryTracker.h"
+
+const int BRICK_CELLS = VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE;
+
+SparseVoxels::SparseVoxels()
+	: solidBricks(0), solidCells(0)
+{}
+
+bool SparseVoxels::set(int x, int y, int z, bool solid)
+{
+	int ly = y - floorDiv(y, VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE;
+	return setBits(x, y, z, (unsigned char)(1 << ly), solid) != 0;
+}
+
+bool SparseVoxels::cell(int x, int y, int z) const
+{
+	int brick = findBrick(x, y, z);
+	if (brick < 0)
+		return brick == BRICK_SOLID;
+	int bx = floorDiv(x, VOXEL_BRICK_SIZE), by = floorDiv(y, VOXEL_BRICK_SIZE), bz = floorDiv(z, VOXEL_BRICK_SIZE);
+	unsigned char column = bricks[brick].columns[(z - bz * VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE + (x - bx * VOXEL_BRICK_SIZE)];
+	return ((column >> (y - by * VOXEL_BRICK_SIZE)) & 1) != 0;
+}
+
+int SparseVoxels::setColumn(int x, int z, int yMin, int yMax, bool solid)
+{
+	int changed = 0;
+	int y = yMin;
+	while (y < yMax) {
+		// The part of the run within this brick as one mask
+		int brickY = floorDiv(y, VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE;
+		int end = std::min(yMax, brickY + VOXEL_BRICK_SIZE);
+		unsigned char mask = (unsigned char)(((1 << (end - brickY)) - 1) & ~((1 << (y - brickY)) - 1));
+		changed += setBits(x, y, z, mask, solid);
+		y = end;
+	}
+	return changed;
+}
+
+void SparseVoxels::column(int x, int z, int yMin, int yMax, std::vector<VoxelRun>& runs) const
+{
+	runs.clear();
+	int bx = floorDiv(x, VOXEL_BRICK_SIZE), bz = floorDiv(z, VOXEL_BRICK_SIZE);
+	int lx = x - bx * VOXEL_BRICK_SIZE, lz = z - bz * VOXEL_BRICK_SIZE;
+	bool inRun = false;
+	int y = yMin;
+	while (y < yMax) {
+		int brickY = floorDiv(y, VOXEL_BRICK_SIZE) * VOXEL_BRICK_SIZE;
+		int end = std::min(yMax, brickY + VOXEL_BRICK_SIZE);
+		int brick = findBrick(x, y, z);
+		unsigned char bits = brick == BRICK_SOLID ? 0xff : (brick == BRICK_EMPTY ? 0 : bricks[brick].columns[lz * VOXEL_BRICK_SIZE + lx]);
+		// Whole bricks continue or don't start a run without looking at the cells
+		if ((bits == 0xff && inRun) || (bits == 0 && !inRun)) {
+			y = end;
+			continue;
+		}
+		for (; y < end; y++) {
+			bool set = ((bits >> (y - brickY)) & 1) != 0;
+			if (set && !inRun) {
+				VoxelRun run = { y, y };
+				runs.push_back(run);
+			}
+			else if (!set && inRun) {
+				runs.back().end = y;
+			}
+			inRun = set;
+		}
+	}
+	if (inRun)
+		runs.back().end = yMax;
+}
+
+int SparseVoxels::neighbours(int x, int y, int z) const
+{
+	int bx = floorDiv(x, VOXEL_BRICK_SIZE), by = floorDiv(y, VOXEL_BRICK_SIZE), bz = floorDiv(z, VOXEL_BRICK_SIZE);
+	int lx = x - bx * VOXEL_BRICK_SIZE, ly = y - by * VOXEL_BRICK_SIZE, lz = z - bz * VOXEL_BRICK_SIZE;
+	const int last = VOXEL_BRICK_SIZE - 1;
+	if (lx > 0 && lx < last && ly > 0 && ly < last && lz > 0 && lz < last) {
+		int brick = findBrick(x, y, z);
+		if (brick == BRICK_EMPTY)
+			return 0;
+		if (brick == BRICK_SOLID)
+			return 63;
+		const unsigned char* columns = bricks[brick].columns;
+		int center = lz * VOXEL_BRICK_SIZE + lx;
+		int result = 0;
+		if ((columns[center - 1] >> ly) & 1) result |= VOXEL_NEIGHBOUR_NEGATIVE_X;
+		if ((columns[center + 1] >> ly) & 1) result |= VOXEL_NEIGHBOUR_POSITIVE_X;
+		if ((columns[center] >> (ly - 1)) & 1) result |= VOXEL_NEIGHBOUR_NEGATIVE_Y;
+		if ((columns[center] >> (ly + 1)) & 1) result |= VOXEL_NEIGHBOUR_POSITIVE_Y;
+		if ((columns[center - VOXEL_BRICK_SIZE] >> ly) & 1) result |= VOXEL_NEIGHBOUR_NEGATIVE_Z;
+		if ((columns[center + VOXEL_BRICK_SIZE] >> ly) & 1) result |= VOXEL_NEIGHBOUR_POSITIVE_Z;
+		return result;
+	}
+
+	// On the brick border some of them are in the next brick
+	int result = 0;
+	if (cell(x - 1, y, z)) result |= VOXEL_NEIGHBOUR_NEGATIVE_X;
+	if (cell(x + 1, y, z)) result |= VOXEL_NEIGHBOUR_POSITIVE_X;
+	if (cell(x, y - 1, z)) result |= VOXEL_NEIGHBOUR_NEGATIVE_Y;
+	if (cell(x, y + 1, z)) result |= VOXEL_NEIGHBOUR_POSITIVE_Y;
+	if (cell(x, y, z - 1)) result |= VOXEL_NEIGHBOUR_NEGATIVE_Z;
+	if (cell(x, y, z + 1)) result |= VOXEL_NEIGHBOUR_POSITIVE_Z;
+	return result;
+}
+
+void SparseVoxels::copyBox(int minX, int minY, int minZ, int sizeX, int sizeY, int sizeZ, unsigned char* out) const
+{
+	const int B = VOXEL_BRICK_SIZE;
+	int maxX = minX + sizeX, maxY = minY + sizeY, maxZ = minZ + sizeZ;
+	for (int bz = floorDiv(minZ, B); bz * B < maxZ; bz++) {
+		int z0 = std::max(minZ, bz * B), z1 = std::min(maxZ, bz * B + B);
+		for (int by = floorDiv(minY, B); by * B < maxY; by++) {
+			int y0 = std::max(minY, by * B), y1 = std::min(maxY, by * B + B);
+			for (int bx = floorDiv(minX, B); bx * B < maxX; bx++) {
+				int x0 = std::max(minX, bx * B), x1 = std::min(maxX, bx * B + B);
+				int brick = findBrick(x0, y0, z0);
+				if (brick < 0) {
+					unsigned char fill = brick == BRICK_SOLID ? 1 : 0;
+					for (int z = z0; z < z1; z++) {
+						for (int y = y0; y < y1; y++) {
+							memset(&out[((z - minZ) * sizeY + (y - minY)) * sizeX + (x0 - minX)], fill, x1 - x0);
+						}
+					}
+					continue;
+				}
+				const unsigned char* columns = bricks[brick].columns;
+				for (int z = z0; z < z1; z++) {
+					for (int x = x0; x < x1; x++) {
+						unsigned char bits = columns[(z - bz * B) * B + (x - bx * B)];
+						unsigned char* target = &out[((z - minZ) * sizeY + (y0 - minY)) * sizeX + (x - minX)];
+						for (int y = y0; y < y1; y++) {
+							*target = (bits >> (y - by * B)) & 1;
+							target += sizeX;
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+bool SparseVoxels::anySolid(int minX, int minY, int minZ, int maxX, int maxY, int maxZ) const
+{
+	const int B = VOXEL_BRICK_SIZE;
+	for (int bz = floorDiv(minZ, B); bz * B <= maxZ; bz++) {
+		int z0 = std::max(minZ, bz * B), z1 = std::min(maxZ, bz * B + B - 1);
+		for (int by = floorDiv(minY, B); by * B <= maxY; by++) {
+			int y0 = std::max(minY, by * B), y1 = std::min(maxY, by * B + B - 1);
+			// The cells of the box in a column of this brick
+			unsigned char mask = (unsigned char)(((2 << (y1 - by * B)) - 1) & ~((1 << (y0 - by * B)) - 1));
+			for (int bx = floorDiv(minX, B); bx * B <= maxX; bx++) {
+				int x0 = std::max(minX, bx * B), x1 = std::min(maxX, bx * B + B - 1);
+				int brick = findBrick(x0, y0, z0);
+				if (brick == BRICK_SOLID)
+					return true;
+				if (brick == BRICK_EMPTY)
+					continue;
+				const unsigned char* columns = bricks[brick].columns;
+				for (int z = z0; z <= z1; z++) {
+					for (int x = x0; x <= x1; x++) {
+						if (columns[(z - bz * B) * B + (x - bx * B)] & mask)
+							return true;
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void SparseVoxels::clear()
+{
+	regions.clear();
+	bricks.clear();
+	freeBricks.clear();
+	solidBricks = 0;
+	solidCells = 0;
+}
+
+size_t SparseVoxels::memoryBytes() const
+{
+	// A hash map node holds the key, the region and the link to the next one
+	size_t node = sizeof(unsigned long long) + sizeof(Region) + sizeof(void*);
+	return regions.size() * node + regions.bucket_count() * sizeof(void*) + bricks.capacity() * sizeof(Brick)
+		+ freeBricks.capacity() * sizeof(int);
+}
+
+int SparseVoxels::floorDiv(int value, int divisor)
+{
+	return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+unsigned long long SparseVoxels::regionKey(int x, int y, int z)
+{
+	return ((unsigned long long)(x & 0x1fffff) << 42) | ((unsigned long long)(y & 0x1fffff) << 21) | (unsigned long long)(z & 0x1fffff);
+}
+
+// Slot in Region::bricks of the brick containing the cell
+int SparseVoxels::brickSlot(int x, int y, int z)
+{
+	const int R = VOXEL_REGION_BRICKS;
+	int bx = floorDiv(x, VOXEL_BRICK_SIZE), by = floorDiv(y, VOXEL_BRICK_SIZE), bz = floorDiv(z, VOXEL_BRICK_SIZE);
+	return ((bz - floorDiv(bz, R) * R) * R + (by - floorDiv(by, R) * R)) * R + (bx - floorDiv(bx, R) * R);
+}
+
+int SparseVoxels::findBrick(int x, int y, int z) const
+{
+	const int S = VOXEL_REGION_SIZE;
+	std::unordered_map<unsigned long long, Region>::const_iterator it = regions.find(regionKey(floorDiv(x, S), floorDiv(y, S), floorDiv(z, S)));
+	if (it == regions.end())
+		return BRICK_EMPTY;
+	return it->second.bricks[brickSlot(x, y, z)];
+}
+
+int SparseVoxels::setBits(int x, int y, int z, unsigned char mask, bool solid)
+{
+	const int S = VOXEL_REGION_SIZE;
+	unsigned long long key = regionKey(floorDiv(x, S), floorDiv(y, S), floorDiv(z, S));
+	std::unordered_map<unsigned long long, Region>::iterator it = regions.find(key);
+	if (it == regions.end()) {
+		if (!solid)
+			return 0;
+		MEMORY_TAG(MEMORY_TAG_SCENE);
+		Region region;
+		for (int i = 0; i < VOXEL_REGION_BRICKS * VOXEL_REGION_BRICKS * VOXEL_REGION_BRICKS; i++) {
+			region.bricks[i] = BRICK_EMPTY;
+		}
+		region.used = 0;
+		it = regions.insert(std::make_pair(key, region)).first;
+	}
+	Region& region = it->second;
+	int& slot = region.bricks[brickSlot(x, y, z)];
+
+	// Uniform bricks get cells once they stop being uniform
+	if (slot == (solid ? BRICK_SOLID : BRICK_EMPTY))
+		return 0;
+	if (slot == BRICK_EMPTY) {
+		slot = allocateBrick(0);
+		region.used++;
+	}
+	else if (slot == BRICK_SOLID) {
+		slot = allocateBrick(0xff);
+		solidBricks--;
+	}
+
+	Brick& brick = bricks[slot];
+	const int B = VOXEL_BRICK_SIZE;
+	unsigned char& column = brick.columns[(z - floorDiv(z, B) * B) * B + (x - floorDiv(x, B) * B)];
+	unsigned char updated = solid ? (unsigned char)(column | mask) : (unsigned char)(column & ~mask);
+	int changed = countBits(column ^ updated);
+	column = updated;
+	brick.solidCells += solid ? changed : -changed;
+	if (solid)
+		solidCells += changed;
+	else
+		solidCells -= changed;
+
+	// Back to a marker once uniform
+	if (brick.solidCells == BRICK_CELLS) {
+		releaseBrick(slot);
+		slot = BRICK_SOLID;
+		solidBricks++;
+	}
+	else if (brick.solidCells == 0) {
+		releaseBrick(slot);
+		slot = BRICK_EMPTY;
+		if (--region.used == 0)
+			regions.erase(it);
+	}
+	return changed;
+}
+
+int SparseVoxels::allocateBrick(unsigned char fill)
+{
+	int index;
+	if (!freeBricks.empty()) {
+		index = freeBricks.back();
+		freeBricks.pop_back();
+	}
+	else {
+		MEMORY_TAG(MEMORY_TAG_SCENE);
+		index = (int)bricks.size();
+		bricks.push_back(Brick());
+	}
+	memset(bricks[index].columns, fill, sizeof(bricks[index].columns));
+	bricks[index].solidCells = fill != 0 ? BRICK_CELLS : 0;
+	return index;
+}
+
+void SparseVoxels::releaseBrick(int brick)
+{
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	freeBricks.push_back(brick);
+}
+
+int SparseVoxels::countBits(unsigned char bits)
+{
+	int count = 0;
+	for (; bits != 0; bits &= bits - 1) {
+		count++;
+	}
+	return count;
+}
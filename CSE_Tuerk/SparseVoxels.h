@@ -0,0 +1,98 @@
+#pragma once
+
+#ifndef SPARSEVOXELS_H
+#define SPARSEVOXELS_H
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// Cells along each edge of a brick, a column of a brick fits into one byte
+const int VOXEL_BRICK_SIZE = 8;
+// Bricks along each edge of a region
+const int VOXEL_REGION_BRICKS = 4;
+const int VOXEL_REGION_SIZE = VOXEL_BRICK_SIZE * VOXEL_REGION_BRICKS;
+
+// Bits of SparseVoxels::neighbours
+const int VOXEL_NEIGHBOUR_NEGATIVE_X = 1;
+const int VOXEL_NEIGHBOUR_POSITIVE_X = 2;
+const int VOXEL_NEIGHBOUR_NEGATIVE_Y = 4;
+const int VOXEL_NEIGHBOUR_POSITIVE_Y = 8;
+const int VOXEL_NEIGHBOUR_NEGATIVE_Z = 16;
+const int VOXEL_NEIGHBOUR_POSITIVE_Z = 32;
+
+// Solid cells [start, end) of a column
+struct VoxelRun {
+	int start;
+	int end;
+};
+
+// Solid/empty cells of an unbounded grid as a two level brick map. Regions (a hash map entry each) hold the bricks of
+// VOXEL_REGION_SIZE cells cubed, bricks which are all empty or all solid are only a marker there. Mixed bricks, i.e.
+// those on the surface, store a bit per cell, one byte per column along y, so a column run within a brick is a mask.
+// Memory grows with the surface, a cell lookup is one hash lookup and a bit test.
+// No GL and no locking, reading from several threads is fine as long as nothing is changed meanwhile
+class SparseVoxels
+{
+public:
+	SparseVoxels();
+
+	// Returns whether the cell changed
+	bool set(int x, int y, int z, bool solid);
+	bool cell(int x, int y, int z) const;
+	// Sets cells [yMin, yMax) of the column at x, z, one mask per brick the run crosses. Returns the cells which changed
+	int setColumn(int x, int z, int yMin, int yMax, bool solid);
+	// Solid runs of the column at x, z within [yMin, yMax), clipped to it. runs is cleared first
+	void column(int x, int z, int yMin, int yMax, std::vector<VoxelRun>& runs) const;
+
+	// Solid faces around the cell, VOXEL_NEIGHBOUR_* bits. Within a brick without any lookup
+	int neighbours(int x, int y, int z) const;
+	// Copies the cells of the box starting at min into out, 1 solid, 0 empty, x fastest (like VoxelMesher::paddedIndex).
+	// One lookup per brick, uniform bricks are filled without looking at cells
+	void copyBox(int minX, int minY, int minZ, int sizeX, int sizeY, int sizeZ, unsigned char* out) const;
+	// Any solid cell in [min, max] (inclusive) on every axis, e.g. for collision
+	bool anySolid(int minX, int minY, int minZ, int maxX, int maxY, int maxZ) const;
+
+	void clear();
+
+	unsigned long long solidCount() const { return solidCells; }
+	size_t regionCount() const { return regions.size(); }
+	size_t mixedBrickCount() const { return bricks.size() - freeBricks.size(); }
+	size_t solidBrickCount() const { return solidBricks; }
+	// Regions with their hash map entries and the brick pool
+	size_t memoryBytes() const;
+
+private:
+	// Marks in Region::bricks, everything else is an index into bricks
+	static const int BRICK_EMPTY = -1;
+	static const int BRICK_SOLID = -2;
+
+	struct Brick {
+		unsigned char columns[VOXEL_BRICK_SIZE * VOXEL_BRICK_SIZE];	// [z][x], bit y
+		int solidCells;
+	};
+
+	struct Region {
+		int bricks[VOXEL_REGION_BRICKS * VOXEL_REGION_BRICKS * VOXEL_REGION_BRICKS];	// [z][y][x]
+		int used;				// bricks not empty, the region goes away at 0
+	};
+
+	static int floorDiv(int value, int divisor);
+	static unsigned long long regionKey(int x, int y, int z);
+	static int brickSlot(int x, int y, int z);
+	// The brick containing the cell, BRICK_EMPTY without a region
+	int findBrick(int x, int y, int z) const;
+	// Sets the bits of mask in the column of the brick containing x, y, z to solid, returns the cells changed
+	int setBits(int x, int y, int z, unsigned char mask, bool solid);
+	int allocateBrick(unsigned char fill);
+	void releaseBrick(int brick);
+	static int countBits(unsigned char bits);
+
+	std::unordered_map<unsigned long long, Region> regions;
+	std::vector<Brick> bricks;
+	std::vector<int> freeBricks;
+	size_t solidBricks;
+	unsigned long long solidCells;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "ThreadPool.h"
+
+#include <string>
+
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(int threads)
+	: job(NULL), jobCount(0), nextJob(0), activeWorkers(0), generation(0), stopping(false)
+{
+	if (threads <= 0) {
+		threads = (int)std::thread::hardware_concurrency();
+	}
+	for (int i = 1; i < threads; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerMain, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_all();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& _job)
+{
+	if (workers.empty() || count <= 1) {
+		for (int i = 0; i < count; i++) {
+			_job(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &_job;
+		jobCount = count;
+		nextJob = 0;
+		activeWorkers = (int)workers.size();
+		generation++;
+	}
+	wakeUp.notify_all();
+
+	runJobs();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return activeWorkers == 0; });
+	job = NULL;
+}
+
+void ThreadPool::workerMain()
+{
+	static std::atomic<int> workerIndex(0);
+	std::string name = "Worker " + std::to_string(++workerIndex);
+	Profiler::setThreadName(name.c_str());
+
+	unsigned int seen = 0;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wakeUp.wait(lock, [this, seen] { return stopping || generation != seen; });
+		if (stopping)
+			return;
+		seen = generation;
+
+		lock.unlock();
+		runJobs();
+		lock.lock();
+
+		if (--activeWorkers == 0) {
+			finished.notify_one();
+		}
+	}
+}
+
+void ThreadPool::runJobs()
+{
+	for (int i = nextJob++; i < jobCount; i = nextJob++) {
+		(*job)(i);
+	}
+}
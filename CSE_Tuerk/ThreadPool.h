@@ -0,0 +1,45 @@
+#pragma once
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// Fixed set of worker threads for data parallel loops. The calling thread works along, so a pool
+// with n threads starts n - 1 workers. Only one parallelFor may run at a time
+class ThreadPool
+{
+public:
+	// 0 = one thread per hardware thread
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	// Workers + the calling thread
+	int threadCount() const { return (int)workers.size() + 1; }
+
+	// Calls job(i) for every i in [0, count) and returns when all calls are done.
+	// Indices are handed out one by one, so uneven jobs balance themselves
+	void parallelFor(int count, const std::function<void(int)>& job);
+
+private:
+	void workerMain();
+	void runJobs();
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::condition_variable finished;
+	const std::function<void(int)>* job;
+	int jobCount;
+	std::atomic<int> nextJob;
+	int activeWorkers;				// workers still busy with the current loop
+	unsigned int generation;		// incremented for every loop, wakes the workers
+	bool stopping;
+};
+
+#endif
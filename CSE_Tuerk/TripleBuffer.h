@@ -0,0 +1,52 @@
+#pragma once
+
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// Lock-free hand-over of whole values from one producer thread to one consumer thread.
+// The producer fills its back buffer and publishes it, the consumer always picks up the newest published one.
+// Neither side ever waits for the other: a value which is published twice before the consumer looks is simply skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: writeIndex(0), readIndex(1), middle(2)
+	{}
+
+	// Producer: the buffer to fill next. It keeps its old contents, so vectors etc. can reuse their memory
+	T& writeBuffer() { return buffers[writeIndex]; }
+
+	// Producer: hands the filled buffer over and takes the middle one back as new back buffer
+	void publish()
+	{
+		int previous = middle.exchange(writeIndex | NEW_DATA, std::memory_order_acq_rel);
+		writeIndex = previous & INDEX_MASK;
+	}
+
+	// Consumer: swaps in the newest published buffer, false if nothing was published since the last call
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & NEW_DATA))
+			return false;
+		int previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+		readIndex = previous & INDEX_MASK;
+		return true;
+	}
+
+	// Consumer: the buffer picked up by the last update()
+	const T& readBuffer() const { return buffers[readIndex]; }
+
+private:
+	static const int INDEX_MASK = 3;
+	static const int NEW_DATA = 4;	// set in middle while it holds a buffer the consumer hasn't seen yet
+
+	T buffers[3];
+	int writeIndex;				// only touched by the producer
+	int readIndex;				// only touched by the consumer
+	std::atomic<int> middle;	// index of the buffer in between (+ NEW_DATA flag)
+};
+
+#endif
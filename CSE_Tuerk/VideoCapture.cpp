@@ -0,0 +1,205 @@
+#include "VideoCapture.h"
+
+#include <iostream>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+#include "PixelConversion.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+VideoCapture::VideoCapture()
+	: file(NULL), pipe(false), format(VIDEO_Y4M), fps(60), interval(1), width(0), height(0), stopping(false), failed(false),
+	frameIndex(0), written(0), droppedReadback(0), droppedQueue(0), droppedResized(0)
+{}
+
+VideoCapture::~VideoCapture()
+{
+	// close() needs the GL context, the owner calls it while it is still there
+}
+
+VideoFormat VideoCapture::formatFromPath(const std::string& path)
+{
+	size_t dot = path.rfind('.');
+	if (dot != std::string::npos && path.substr(dot) == ".y4m")
+		return VIDEO_Y4M;
+	return path.size() > 1 && path[0] == '|' ? VIDEO_Y4M : VIDEO_RAW_RGB;
+}
+
+bool VideoCapture::open(const std::string& _path, VideoFormat _format, int _fps, int _interval)
+{
+	path = _path;
+	format = _format;
+	fps = _fps > 0 ? _fps : 60;
+	interval = _interval > 0 ? _interval : 1;
+	width = height = 0;
+	failed = false;
+	frameIndex = written = droppedReadback = droppedQueue = droppedResized = 0;
+
+	pipe = !path.empty() && path[0] == '|';
+	if (pipe) {
+#ifdef _WIN32
+		file = popen(path.c_str() + 1, "wb");
+#else
+		file = popen(path.c_str() + 1, "w");
+#endif
+	}
+	else {
+		file = fopen(path.c_str(), "wb");
+	}
+	if (file == NULL) {
+		std::cout << "ERROR::CAPTURE::OPEN_FAILED " << path << std::endl;
+		return false;
+	}
+	// The writer thread does its own batching, the frames are large anyway
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+	readback.init();
+	stopping = false;
+	thread = std::thread(&VideoCapture::run, this);
+	return true;
+}
+
+void VideoCapture::close()
+{
+	if (file == NULL)
+		return;
+
+	readback.finish();
+	readback.destroy();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeUp.notify_one();
+	thread.join();
+
+	if (pipe)
+		pclose(file);
+	else
+		fclose(file);
+	file = NULL;
+	frames.clear();
+	freeBuffers.clear();
+
+	std::cout << "Capture: " << written << " frames written, " << droppedReadback + droppedQueue + droppedResized << " dropped ("
+		<< droppedReadback << " readback, " << droppedQueue << " writer, " << droppedResized << " resized) -> " << path << std::endl;
+}
+
+void VideoCapture::captureFrame(GLuint framebuffer, GLsizei _width, GLsizei _height)
+{
+	if (file == NULL)
+		return;
+
+	// Earlier frames first, that frees up their slots
+	readback.poll();
+
+	if (frameIndex++ % interval != 0)
+		return;
+	if (width == 0) {
+		width = _width;
+		height = _height;
+	}
+	if (_width != width || _height != height) {
+		// A video can't change its size
+		droppedResized++;
+		return;
+	}
+	if (!readback.request(framebuffer, width, height, [this](ReadbackImage& image) { queueFrame(image); })) {
+		droppedReadback++;
+	}
+}
+
+// Runs on the GL thread. Takes the pixels and gives the readback a recycled buffer instead
+void VideoCapture::queueFrame(ReadbackImage& image)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if ((int)frames.size() >= VIDEO_QUEUE_DEPTH) {
+			droppedQueue++;
+			return;
+		}
+		frames.push_back(std::vector<unsigned char>());
+		frames.back().swap(image.pixels);
+		if (!freeBuffers.empty()) {
+			image.pixels.swap(freeBuffers.back());
+			freeBuffers.pop_back();
+		}
+	}
+	wakeUp.notify_one();
+}
+
+void VideoCapture::run()
+{
+	Profiler::setThreadName("Capture");
+	MemoryTracker::setThreadTag(MEMORY_TAG_CAPTURE);
+	bool headerWritten = false;
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wakeUp.wait(lock, [this] { return stopping || !frames.empty(); });
+		if (frames.empty())
+			break;
+
+		std::vector<unsigned char> pixels;
+		pixels.swap(frames.front());
+		frames.pop_front();
+		lock.unlock();
+
+		if (!headerWritten) {
+			writeHeader();
+			headerWritten = true;
+		}
+		bool ok = writeFrame(pixels);
+
+		lock.lock();
+		if (ok)
+			written++;
+		freeBuffers.push_back(std::vector<unsigned char>());
+		freeBuffers.back().swap(pixels);
+	}
+	lock.unlock();
+	fflush(file);
+}
+
+// C420jpeg: full range BT.601 with centered chroma, matches flipRGBAToYUV420
+void VideoCapture::writeHeader()
+{
+	if (format == VIDEO_Y4M) {
+		fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", (int)width, (int)height, fps);
+	}
+}
+
+bool VideoCapture::writeFrame(const std::vector<unsigned char>& pixels)
+{
+	if (failed)
+		return false;
+	size_t size;
+	if (format == VIDEO_Y4M) {
+		PROFILE_ZONE("CaptureConvert");
+		size_t lumaSize = (size_t)width * height;
+		size_t chromaSize = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+		size = lumaSize + 2 * chromaSize;
+		converted.resize(size);
+		flipRGBAToYUV420(&pixels[0], width, height, &converted[0], &converted[lumaSize], &converted[lumaSize + chromaSize]);
+	}
+	else {
+		PROFILE_ZONE("CaptureConvert");
+		size = (size_t)width * height * 3;
+		converted.resize(size);
+		flipRGBAToRGB(&pixels[0], width, height, &converted[0]);
+	}
+
+	PROFILE_ZONE("CaptureWrite");
+	if (format == VIDEO_Y4M) {
+		fputs("FRAME\n", file);
+	}
+	if (fwrite(&converted[0], 1, size, file) != size) {
+		std::cout << "ERROR::CAPTURE::WRITE_FAILED " << path << std::endl;
+		failed = true;
+		return false;
+	}
+	return true;
+}
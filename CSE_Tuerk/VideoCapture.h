@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef VIDEOCAPTURE_H
+#define VIDEOCAPTURE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+#include "AsyncReadback.h"
+
+enum VideoFormat {
+	VIDEO_Y4M,		// YUV4MPEG2 with 4:2:0 frames, readable by ffmpeg, mpv, x264, ...
+	VIDEO_RAW_RGB	// rgb24 frames without any header, the size has to be given to the reader
+};
+
+// Frames converted or written at the same time. If the writer falls further behind, new frames are dropped
+const int VIDEO_QUEUE_DEPTH = 4;
+
+// Records every Nth rendered frame into a video file or pipe. The frames are read back asynchronously,
+// converted and written on a background thread. Rendering never waits for it, frames are dropped instead
+class VideoCapture
+{
+public:
+	VideoCapture();
+	~VideoCapture();
+
+	// path is a file, or "|command" to pipe the frames into a program (e.g. "|ffmpeg -i - out.mp4").
+	// fps only goes into the Y4M header. Needs the GL context
+	bool open(const std::string& path, VideoFormat format, int fps, int interval);
+	// Writes the frames still in flight, needs the GL context
+	void close();
+	bool isOpen() const { return file != NULL; }
+
+	// Call after every rendered frame (before the swap). The size is fixed by the first captured frame
+	void captureFrame(GLuint framebuffer, GLsizei width, GLsizei height);
+
+	static VideoFormat formatFromPath(const std::string& path);
+
+private:
+	void queueFrame(ReadbackImage& image);
+	void run();
+	void writeHeader();
+	bool writeFrame(const std::vector<unsigned char>& pixels);
+
+	AsyncReadback readback;
+	std::string path;
+	FILE* file;
+	bool pipe;
+	VideoFormat format;
+	int fps;
+	int interval;
+	GLsizei width;		// 0 until the first frame
+	GLsizei height;
+
+	// Filled on the GL thread, emptied by the writer thread
+	std::deque<std::vector<unsigned char> > frames;
+	std::vector<std::vector<unsigned char> > freeBuffers;	// handed back to the readback, no allocations once running
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	std::thread thread;
+	bool stopping;
+
+	std::vector<unsigned char> converted;	// writer thread only
+	bool failed;							// writer thread only, stops after the first write error
+
+	// Statistics
+	long long frameIndex;
+	long long written;
+	long long droppedReadback;	// all readback slots busy
+	long long droppedQueue;		// writer too slow
+	long long droppedResized;	// framebuffer no longer the size of the video
+};
+
+#endif
@@ -0,0 +1,312 @@
+#include "VoxelMesher.h"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+#include "Profiler.h"
+#include "MemoryTracker.h"
+
+const int VOXEL_CHUNK_CELLS = VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE;
+const int VOXEL_PADDED_CELLS = VOXEL_PADDED_SIZE * VOXEL_PADDED_SIZE * VOXEL_PADDED_SIZE;
+
+size_t VoxelMesher::meshChunk(const unsigned char* padded, const glm::vec3& origin, GLfloat cellSize, bool greedy,
+	std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	const int N = VOXEL_CHUNK_SIZE;
+	unsigned char mask[VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE];
+	size_t faces = 0;
+	vertices.clear();
+	indices.clear();
+
+	// Every slice of cells along each axis, once for the faces looking down the axis and once for the ones looking up.
+	// u and v span the slice, mask marks the cells with a visible face in the current direction
+	for (int axis = 0; axis < 3; axis++) {
+		int u = (axis + 1) % 3;
+		int v = (axis + 2) % 3;
+		for (int side = 0; side < 2; side++) {
+			bool positive = side == 1;
+			for (int slice = 0; slice < N; slice++) {
+				int cell[3];
+				for (int j = 0; j < N; j++) {
+					for (int i = 0; i < N; i++) {
+						cell[axis] = slice;
+						cell[u] = i;
+						cell[v] = j;
+						bool solid = padded[paddedIndex(cell[0], cell[1], cell[2])] != 0;
+						cell[axis] = positive ? slice + 1 : slice - 1;
+						bool covered = padded[paddedIndex(cell[0], cell[1], cell[2])] != 0;
+						mask[j * N + i] = solid && !covered;
+						faces += mask[j * N + i];
+					}
+				}
+
+				// Grow each face along u as far as the mask goes, then along v while the whole row is set
+				for (int j = 0; j < N; j++) {
+					for (int i = 0; i < N; i++) {
+						if (!mask[j * N + i])
+							continue;
+						int width = 1;
+						int height = 1;
+						if (greedy) {
+							while (i + width < N && mask[j * N + i + width]) {
+								width++;
+							}
+							for (; j + height < N; height++) {
+								bool full = true;
+								for (int k = 0; k < width && full; k++) {
+									full = mask[(j + height) * N + i + k] != 0;
+								}
+								if (!full)
+									break;
+							}
+						}
+						for (int y = 0; y < height; y++) {
+							memset(&mask[(j + y) * N + i], 0, width);
+						}
+						emitQuad(axis, positive, slice, i, j, width, height, origin, cellSize, vertices, indices);
+					}
+				}
+			}
+		}
+	}
+	return faces;
+}
+
+// Corners go counter-clockwise seen from the side the face looks to
+void VoxelMesher::emitQuad(int axis, bool positive, int slice, int u0, int v0, int width, int height, const glm::vec3& origin, GLfloat cellSize,
+	std::vector<GLfloat>& vertices, std::vector<GLuint>& indices)
+{
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
+	const int cornerU[4] = { 0, width, width, 0 };
+	const int cornerV[4] = { 0, 0, height, height };
+
+	GLuint first = (GLuint)(vertices.size() / 5);
+	for (int c = 0; c < 4; c++) {
+		glm::vec3 position;
+		position[axis] = (GLfloat)(positive ? slice + 1 : slice);
+		position[u] = (GLfloat)(u0 + cornerU[c]);
+		position[v] = (GLfloat)(v0 + cornerV[c]);
+		position = origin + position * cellSize;
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
+		vertices.push_back((GLfloat)cornerU[c]);
+		vertices.push_back((GLfloat)cornerV[c]);
+	}
+
+	// u x v points along the axis, faces looking down it are wound the other way round
+	const GLuint front[6] = { 0, 1, 2, 2, 3, 0 };
+	const GLuint back[6] = { 0, 3, 2, 2, 1, 0 };
+	const GLuint* order = positive ? front : back;
+	for (int i = 0; i < 6; i++) {
+		indices.push_back(first + order[i]);
+	}
+}
+
+VoxelWorld::VoxelWorld(GpuResources* _resources, ThreadPool* _threadPool, const glm::vec3& _origin, GLfloat _cellSize)
+	: resources(_resources), threadPool(_threadPool), origin(_origin), cellSize(_cellSize), greedy(true), remeshes(0)
+{}
+
+VoxelWorld::~VoxelWorld()
+{
+	for (std::map<ChunkKey, Chunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+		resources->release(it->second->vertexArray);
+		resources->release(it->second->vertexBuffer);
+		resources->release(it->second->elementBuffer);
+		delete it->second;
+	}
+}
+
+void VoxelWorld::setCell(int x, int y, int z, bool solid)
+{
+	if (!cells.set(x, y, z, solid))
+		return;
+	chunkOf(x, y, z, solid);
+	markChanged(x, y, z);
+}
+
+void VoxelWorld::setColumn(int x, int z, int yMin, int yMax, bool solid)
+{
+	const int N = VOXEL_CHUNK_SIZE;
+	if (cells.setColumn(x, z, yMin, yMax, solid) == 0)
+		return;
+	// The run within each chunk it crosses, its ends decide the faces of the chunks above and below
+	for (int chunkY = floorDiv(yMin, N); chunkY * N < yMax; chunkY++) {
+		int first = std::max(yMin, chunkY * N);
+		int last = std::min(yMax, chunkY * N + N) - 1;
+		chunkOf(x, first, z, solid);
+		markChanged(x, first, z);
+		markChanged(x, last, z);
+	}
+}
+
+bool VoxelWorld::overlaps(const glm::vec3& min, const glm::vec3& max) const
+{
+	glm::vec3 cellMin = glm::floor((min - origin) / cellSize);
+	glm::vec3 cellMax = glm::ceil((max - origin) / cellSize) - 1.0f;
+	if (cellMax.x < cellMin.x || cellMax.y < cellMin.y || cellMax.z < cellMin.z)
+		return false;
+	return cells.anySolid((int)cellMin.x, (int)cellMin.y, (int)cellMin.z, (int)cellMax.x, (int)cellMax.y, (int)cellMax.z);
+}
+
+void VoxelWorld::update()
+{
+	if (dirtyChunks.empty())
+		return;
+	PROFILE_ZONE("Remesh");
+	{
+		PROFILE_ZONE("MeshChunks");
+		// Cells don't change while the jobs run, each job only writes the mesh of its own chunk
+		threadPool->parallelFor((int)dirtyChunks.size(), [this](int i) { meshChunk(dirtyChunks[i]); });
+	}
+	for (size_t i = 0; i < dirtyChunks.size(); i++) {
+		upload(dirtyChunks[i]);
+		dirtyChunks[i]->dirty = false;
+		remeshes++;
+	}
+	dirtyChunks.clear();
+}
+
+void VoxelWorld::draw() const
+{
+	for (std::map<ChunkKey, Chunk*>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+		const Chunk* chunk = it->second;
+		if (chunk->indexCount == 0)
+			continue;
+		glBindVertexArray(resources->name(chunk->vertexArray));
+		glDrawElements(GL_TRIANGLES, chunk->indexCount, GL_UNSIGNED_INT, 0);
+	}
+	glBindVertexArray(0);
+}
+
+void VoxelWorld::setGreedy(bool enable)
+{
+	if (greedy == enable)
+		return;
+	greedy = enable;
+	for (std::map<ChunkKey, Chunk*>::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+		markDirty(it->first.x, it->first.y, it->first.z);
+	}
+}
+
+VoxelMeshStats VoxelWorld::statistics() const
+{
+	VoxelMeshStats stats = {};
+	stats.solidCells = cells.solidCount();
+	for (std::map<ChunkKey, Chunk*>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+		stats.culledTriangles += it->second->faces * 2;
+		stats.drawnTriangles += it->second->indexCount / 3;
+	}
+	stats.naiveTriangles = stats.solidCells * 12;
+	return stats;
+}
+
+void VoxelWorld::printStatistics() const
+{
+	VoxelMeshStats stats = statistics();
+	std::cout << "VoxelWorld: " << chunks.size() << " chunks, " << stats.solidCells << " solid cells, triangles: "
+		<< stats.naiveTriangles << " as cubes, " << stats.culledTriangles << " without hidden faces, " << stats.drawnTriangles
+		<< (greedy ? " merged" : " drawn") << " (" << remeshes << " chunk meshes built)" << std::endl;
+	std::cout << "VoxelWorld: cells in " << cells.memoryBytes() / 1024 << " KB (" << cells.regionCount() << " regions, "
+		<< cells.mixedBrickCount() << " mixed bricks, " << cells.solidBrickCount() << " solid bricks), as positions "
+		<< stats.solidCells * sizeof(glm::vec3) / 1024 << " KB" << std::endl;
+}
+
+int VoxelWorld::floorDiv(int value, int divisor)
+{
+	return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+VoxelWorld::Chunk* VoxelWorld::findChunk(const ChunkKey& key) const
+{
+	std::map<ChunkKey, Chunk*>::const_iterator it = chunks.find(key);
+	return it != chunks.end() ? it->second : NULL;
+}
+
+VoxelWorld::Chunk* VoxelWorld::chunkOf(int x, int y, int z, bool create)
+{
+	const int N = VOXEL_CHUNK_SIZE;
+	ChunkKey key = { floorDiv(x, N), floorDiv(y, N), floorDiv(z, N) };
+	Chunk* chunk = findChunk(key);
+	if (chunk != NULL || !create)
+		return chunk;
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	chunk = new Chunk();
+	chunk->key = key;
+	chunk->dirty = false;
+	chunk->faces = 0;
+	chunk->indexCount = 0;
+	chunks[key] = chunk;
+	return chunk;
+}
+
+// Cells on the border also decide which faces of the neighbour are visible
+void VoxelWorld::markChanged(int x, int y, int z)
+{
+	const int N = VOXEL_CHUNK_SIZE;
+	ChunkKey key = { floorDiv(x, N), floorDiv(y, N), floorDiv(z, N) };
+	int lx = x - key.x * N;
+	int ly = y - key.y * N;
+	int lz = z - key.z * N;
+	markDirty(key.x, key.y, key.z);
+	if (lx == 0) markDirty(key.x - 1, key.y, key.z);
+	if (lx == N - 1) markDirty(key.x + 1, key.y, key.z);
+	if (ly == 0) markDirty(key.x, key.y - 1, key.z);
+	if (ly == N - 1) markDirty(key.x, key.y + 1, key.z);
+	if (lz == 0) markDirty(key.x, key.y, key.z - 1);
+	if (lz == N - 1) markDirty(key.x, key.y, key.z + 1);
+}
+
+void VoxelWorld::markDirty(int chunkX, int chunkY, int chunkZ)
+{
+	ChunkKey key = { chunkX, chunkY, chunkZ };
+	Chunk* chunk = findChunk(key);
+	if (chunk != NULL && !chunk->dirty) {
+		chunk->dirty = true;
+		dirtyChunks.push_back(chunk);
+	}
+}
+
+// Runs on the pool: copies the chunk and the border cells of its neighbours into the padded grid of this thread, then meshes it
+void VoxelWorld::meshChunk(Chunk* chunk) const
+{
+	const int N = VOXEL_CHUNK_SIZE;
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	static thread_local std::vector<unsigned char> padded;
+	padded.resize(VOXEL_PADDED_CELLS);
+	cells.copyBox(chunk->key.x * N - 1, chunk->key.y * N - 1, chunk->key.z * N - 1, VOXEL_PADDED_SIZE, VOXEL_PADDED_SIZE, VOXEL_PADDED_SIZE, &padded[0]);
+
+	glm::vec3 corner = origin + glm::vec3(chunk->key.x, chunk->key.y, chunk->key.z) * (N * cellSize);
+	chunk->faces = VoxelMesher::meshChunk(&padded[0], corner, cellSize, greedy, chunk->vertices, chunk->indices);
+}
+
+// New buffers for the new mesh, the old ones are recycled once the frames using them are done
+void VoxelWorld::upload(Chunk* chunk)
+{
+	resources->release(chunk->vertexBuffer);
+	resources->release(chunk->elementBuffer);
+	chunk->indexCount = (GLsizei)chunk->indices.size();
+	if (chunk->indexCount == 0)
+		return;
+
+	MEMORY_TAG(MEMORY_TAG_RENDERER);
+	chunk->vertexBuffer = resources->createBuffer(chunk->vertices.size() * sizeof(GLfloat), &chunk->vertices[0], GL_STATIC_DRAW);
+	chunk->elementBuffer = resources->createBuffer(chunk->indices.size() * sizeof(GLuint), &chunk->indices[0], GL_STATIC_DRAW);
+	if (chunk->vertexArray.isNull()) {
+		chunk->vertexArray = resources->createVertexArray();
+	}
+
+	// Position + texture coordinates, like VertexLayout::positionsUV
+	GLsizei stride = 5 * sizeof(GLfloat);
+	glBindVertexArray(resources->name(chunk->vertexArray));
+	glBindBuffer(GL_ARRAY_BUFFER, resources->name(chunk->vertexBuffer));
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources->name(chunk->elementBuffer));
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#ifndef VOXELMESHER_H
+#define VOXELMESHER_H
+
+#include <cstddef>
+#include <vector>
+#include <map>
+
+#include <GL/glew.h>
+#include <glm.hpp>
+
+#include "GpuResources.h"
+#include "ThreadPool.h"
+#include "SparseVoxels.h"
+
+// Cells along each edge of a chunk
+const int VOXEL_CHUNK_SIZE = 32;
+// Chunk cells plus one layer of the neighbours on every side, the mesher sees the faces on the chunk border with them
+const int VOXEL_PADDED_SIZE = VOXEL_CHUNK_SIZE + 2;
+
+// Triangle counts of the same cells meshed three ways
+struct VoxelMeshStats {
+	unsigned long long solidCells;
+	unsigned long long naiveTriangles;		// a full cube for every solid cell
+	unsigned long long culledTriangles;		// faces between two solid cells dropped
+	unsigned long long drawnTriangles;		// what the meshes hold, with greedy meshing the faces merged into quads
+};
+
+// Turns the occupancy of a chunk into triangles, no GL involved, so chunks can be meshed on any thread
+class VoxelMesher
+{
+public:
+	// Index of a padded cell, x runs fastest. Coordinates go from -1 to VOXEL_CHUNK_SIZE
+	static int paddedIndex(int x, int y, int z)
+	{
+		return ((z + 1) * VOXEL_PADDED_SIZE + (y + 1)) * VOXEL_PADDED_SIZE + (x + 1);
+	}
+
+	// Emits the faces of the solid cells in padded which have an empty cell in front of them. With greedy, the faces of each
+	// slice are merged into the largest rectangles they form. Vertices are position + texture coordinates (VertexLayout::positionsUV)
+	// in world space, the texture repeats once per cell. vertices and indices are cleared first. Returns the faces before merging
+	static size_t meshChunk(const unsigned char* padded, const glm::vec3& origin, GLfloat cellSize, bool greedy,
+		std::vector<GLfloat>& vertices, std::vector<GLuint>& indices);
+
+private:
+	static void emitQuad(int axis, bool positive, int slice, int u0, int v0, int width, int height, const glm::vec3& origin, GLfloat cellSize,
+		std::vector<GLfloat>& vertices, std::vector<GLuint>& indices);
+};
+
+// Solid/empty cells in a sparse brick map, drawn in chunks created on demand, each from its own mesh. Changing cells
+// only marks the chunks they touch, update() then re-meshes just those, one chunk per job on the thread pool.
+// Cells are changed and meshes drawn on the rendering thread, which needs the GL context
+class VoxelWorld
+{
+public:
+	VoxelWorld(GpuResources* _resources, ThreadPool* _threadPool, const glm::vec3& _origin, GLfloat _cellSize = 1.0f);
+	~VoxelWorld();
+
+	void setCell(int x, int y, int z, bool solid);
+	bool cell(int x, int y, int z) const { return cells.cell(x, y, z); }
+	// Cells [yMin, yMax) of the column at x, z
+	void setColumn(int x, int z, int yMin, int yMax, bool solid);
+	// Any solid cell overlapping the world space box (touching doesn't count), e.g. for collision
+	bool overlaps(const glm::vec3& min, const glm::vec3& max) const;
+	const SparseVoxels& voxels() const { return cells; }
+
+	// Re-meshes and uploads the changed chunks
+	void update();
+	// Draws all chunks with the bound program, which reads the vertices with a model matrix (identity)
+	void draw() const;
+
+	// false: hidden faces are removed, but every face is its own quad (for comparisons)
+	void setGreedy(bool enable);
+
+	size_t chunkCount() const { return chunks.size(); }
+	VoxelMeshStats statistics() const;
+	void printStatistics() const;
+
+private:
+	VoxelWorld(const VoxelWorld&);
+	VoxelWorld& operator=(const VoxelWorld&);
+
+	struct ChunkKey {
+		int x;
+		int y;
+		int z;
+
+		bool operator<(const ChunkKey& other) const
+		{
+			return x < other.x || (x == other.x && (y < other.y || (y == other.y && z < other.z)));
+		}
+	};
+
+	struct Chunk {
+		ChunkKey key;
+		bool dirty;
+		// Mesher output, kept to reuse the memory on the next re-mesh
+		std::vector<GLfloat> vertices;
+		std::vector<GLuint> indices;
+		size_t faces;						// before merging
+		GpuHandle vertexArray;
+		GpuHandle vertexBuffer;
+		GpuHandle elementBuffer;
+		GLsizei indexCount;
+	};
+
+	static int floorDiv(int value, int divisor);
+	Chunk* findChunk(const ChunkKey& key) const;
+	// The chunk of the cell, created if missing and create is set
+	Chunk* chunkOf(int x, int y, int z, bool create);
+	// Marks the chunk of the changed cell and the neighbours whose faces it decides
+	void markChanged(int x, int y, int z);
+	void markDirty(int chunkX, int chunkY, int chunkZ);
+	void meshChunk(Chunk* chunk) const;
+	void upload(Chunk* chunk);
+
+	GpuResources* resources;
+	ThreadPool* threadPool;
+	glm::vec3 origin;			// corner of cell 0, 0, 0
+	GLfloat cellSize;
+	bool greedy;
+	SparseVoxels cells;
+	std::map<ChunkKey, Chunk*> chunks;	// meshes only, the cells live in the brick map
+	std::vector<Chunk*> dirtyChunks;	// update(), kept to avoid allocations
+	unsigned long long remeshes;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+#ifndef WEIGHTEDBLENDEDOIT_H
+#define WEIGHTEDBLENDEDOIT_H
+
+#include <GL/glew.h>
+
+#include "ShaderLibrary.h"
+
+// Formats of the two accumulation targets: weighted color sum + revealage, weight sum
+const GLenum OIT_ACCUM_FORMAT = GL_RGBA16F;
+const GLenum OIT_WEIGHT_FORMAT = GL_R16F;
+
+// Order-independent transparency with weighted blended accumulation (McGuire & Bavoil 2013).
+// Transparent objects are drawn in any order with a SHADER_OIT variant into the accumulation targets,
+// compositeOver() then blends the result over the opaque scene. No sorting needed.
+class WeightedBlendedOIT
+{
+public:
+	WeightedBlendedOIT()
+		: compositeShader(NULL), emptyVAO(0)
+	{}
+
+	~WeightedBlendedOIT()
+	{
+		destroy();
+	}
+
+	bool init(ShaderLibrary* library)
+	{
+		compositeShader = library->get("shaders/oit_composite.vs", "shaders/oit_composite.frag", 0);
+		if (compositeShader == NULL) {
+			return false;
+		}
+		// The full screen triangle comes from gl_VertexID, but the core profile still wants a VAO bound
+		glGenVertexArrays(1, &emptyVAO);
+		return true;
+	}
+
+	void destroy()
+	{
+		if (emptyVAO != 0) {
+			glDeleteVertexArrays(1, &emptyVAO);
+			emptyVAO = 0;
+		}
+		compositeShader = NULL;
+	}
+
+	// Clears the accumulation targets bound as color attachment 0 (accum) and 1 (weight) and sets up the blending.
+	// Both targets share one blend function: rgb is summed up, alpha keeps the product of (1 - alpha) = revealage.
+	// That way no per-target blend state (glBlendFunci, GL 4.0) is needed
+	void beginAccumulation()
+	{
+		const GLfloat clearAccum[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		const GLfloat clearWeight[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		glClearBufferfv(GL_COLOR, 0, clearAccum);
+		glClearBufferfv(GL_COLOR, 1, clearWeight);
+		glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	void endAccumulation()
+	{
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+
+	// Blends the averaged transparent color over the bound (opaque) target
+	void compositeOver(GLuint accumTexture, GLuint weightTexture)
+	{
+		glDisable(GL_DEPTH_TEST);
+		compositeShader->Use();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, accumTexture);
+		glUniform1i(glGetUniformLocation(compositeShader->Program, "accumTexture"), 0);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, weightTexture);
+		glUniform1i(glGetUniformLocation(compositeShader->Program, "weightTexture"), 1);
+
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+private:
+	Shader* compositeShader;	// owned by the library
+	GLuint emptyVAO;
+};
+
+#endif
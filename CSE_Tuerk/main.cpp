@@ -1,6 +1,13 @@
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 // GLEW
 #define GLEW_STATIC
@@ -18,22 +25,162 @@
 
 // Other includes
 #include "Shader.h"
+#include "ShaderLibrary.h"
+#include "Profiler.h"
+#include "Framebuffer.h"
+#include "DynamicResolution.h"
+#include "RenderGraph.h"
+#include "WeightedBlendedOIT.h"
+#include "AsyncReadback.h"
+#include "ScreenshotWriter.h"
+#include "VideoCapture.h"
+#include "ThreadPool.h"
+#include "ClusteredLighting.h"
+#include "BatchMath.h"
+#include "FrameArena.h"
+#include "ObjectPool.h"
+#include "GpuResources.h"
+#include "MeshRegistry.h"
+#include "ChunkStreamer.h"
+#include "VoxelMesher.h"
+#include "InstancePicker.h"
+#include "CollisionWorld.h"
+#include "ParticleSystem.h"
+#include "DirtyRanges.h"
+#include "MemoryTracker.h"
+#include "Benchmark.h"
+#include "InputRecorder.h"
+#include "GameClock.h"
+#include "TripleBuffer.h"
 #include "Camera.h"
 #include "Plane.h"
 #include "Cube.h"
 #include "Light.h"
 
 
+// Everything which is drawn each frame
+struct Scene {
+	ShaderLibrary* shaderLibrary;
+	ObjectPool* objects;				// memory of the cube, plane and light
+	GpuResources* gpuResources;			// their buffers, textures and vertex arrays
+	MeshRegistry* meshes;				// their geometry, each unique mesh is uploaded once
+	Cube* cube;
+	Plane* plane;
+	Light* light;
+	WeightedBlendedOIT* transparency;	// NULL if the planes are sorted and alpha blended
+	bool depthPrepass;					// cubes lay down their depth first, the shaded pass then only draws visible fragments
+	ThreadPool* threadPool;				// data parallel jobs like the light binning
+	ClusteredLighting* lighting;		// point lights for the cubes, NULL if they are unlit
+	ChunkStreamer* world;				// cubes streamed in chunks around the camera (--stream), NULL for the fixed grids
+	VoxelWorld* voxels;					// terrain below the cubes (--voxels), NULL without
+	Shader* voxelShader;				// cube variant with a model matrix, owned by the library
+	ParticleSystem* particles;			// fountain (--particles), NULL without
+	ParticleRenderer* particleRenderer;
+	double particleTime;				// real time the particles were moved to last
+	int editedCubes;					// cubes moved per frame (--edit-cubes), uploaded as dirty ranges
+	std::vector<glm::vec3> cubeHomes;	// where the moved cubes bob around
+	GLfloat editTime;
+	unsigned int editRandom;			// xorshift state, picks the cubes
+};
+
+// Everything the renderer needs from one simulation step. Filled by the simulation, read-only for the renderer
+struct FrameSnapshot {
+	Camera camera;						// state after the last step
+	CameraState previous;				// state before the last step, to interpolate from
+	double stepTime;					// real time the last step belongs to
+	double step;
+	std::vector<glm::vec3> planeOrder;	// transparent planes, back to front (empty with OIT)
+};
+
+// What the render graph passes draw, set right before the graph is executed
+struct RenderView {
+	Scene* scene;
+	Camera camera;
+	const std::vector<glm::vec3>* planeOrder;
+};
+
+// Command line options
+struct Options {
+	bool benchmark;					// --benchmark: render offscreen along a fixed camera path and write a report
+	int benchmarkFrames;			// --frames N
+	std::string benchmarkOutput;	// --out file.json
+	bool osmesa;					// --osmesa: software context without a window system (needs GLFW 3.3+ built with OSMesa)
+	std::string recordPath;			// --record file: write all input into an input log
+	std::string replayPath;			// --replay file: drive the camera from an input log (also as benchmark path)
+	double tickRate;				// --tick-rate N: simulation steps per second
+	int maxCatchUp;					// --max-catch-up N: simulation steps one frame may run at most
+	bool singleThread;				// --single-thread: poll, simulate and render on the main thread one after another
+	double targetFps;				// --target-fps N: GPU frame rate the dynamic resolution aims for
+	GLfloat minScale;				// --min-scale S: lowest resolution scale (fraction of the window size)
+	GLfloat maxScale;				// --max-scale S: highest resolution scale, above 1 renders supersampled
+	bool fixedResolution;			// --fixed-resolution: render straight into the window, no dynamic resolution
+	bool oit;						// --oit: order-independent transparency, planes are instanced and never sorted
+	int extraPlanes;				// --planes N: adds a grid of N transparent planes
+	bool depthPrepass;				// --depth-prepass: depth-only pass for the opaque objects, shaded with GL_EQUAL afterwards
+	std::string capturePath;		// --capture file|"|command": record the output as video (.y4m or raw rgb24)
+	int captureInterval;			// --capture-every N: only every Nth frame
+	std::string captureFormat;		// --capture-format y4m|rgb, otherwise picked from the path
+	int captureFps;					// --capture-fps N: frame rate written into the Y4M header
+	int lightCount;					// --lights N: light the cubes with the light source and N random point lights
+	bool benchCluster;				// --bench-cluster: time the light binning on the CPU (10000 lights or --lights N) and exit
+	bool benchMath;					// --bench-math: time the batch math kernels of every supported instruction set and exit
+	bool benchPick;					// --bench-pick: time ray picks against a million instances and exit
+	bool collide;					// --collide: the camera can't move through the cubes, planes and the light
+	bool benchCollision;			// --bench-collision: time camera sweeps against 200000 boxes and moving boxes, then exit
+	bool memoryReport;				// --memory-report: print the heap usage per tag at exit
+	bool checkAllocations;			// --check-allocations: report every heap allocation made inside a frame, with its call stack
+	bool stream;					// --stream: endless cube world, loaded in chunks around the camera instead of the fixed grids
+	int streamBudget;				// --stream-budget KB: chunk data uploaded per frame at most
+	int voxelSize;					// --voxels N: adds an N x N terrain of unit cells, meshed per chunk
+	bool voxelCubes;				// --voxel-cubes: mesh the terrain without merging faces (only hidden faces removed)
+	int particleCount;				// --particles N: a fountain of up to N particles, drawn in one instanced call
+	bool benchParticles;			// --bench-particles: time updating and packing a million particles (no window) and exit
+	int editCubes;					// --edit-cubes N: move N random cubes per frame, only they are uploaded again
+	int instanceBudget;				// --instance-budget KB: moved instances uploaded per frame at most
+	bool benchInstanceUpdates;		// --bench-instance-updates: time uploading edits to a million instances, whole vs. dirty ranges, and exit
+};
+
+
 // Function prototypes
-GLFWwindow* initializeGame();
+Options parseOptions(int argc, char* argv[]);
+GLFWwindow* initializeGame(const Options& options);
+Scene createScene(const Options& options);
+bool sceneShadersReady(const Scene& scene);
+void renderScene(Scene& scene, Camera& viewCamera, const std::vector<glm::vec3>& planeOrder, GLsizei width, GLsizei height);
+void renderOpaque(Scene& scene, Camera& viewCamera, GLsizei width, GLsizei height);
+void renderTransparent(Scene& scene, Camera& viewCamera, const std::vector<glm::vec3>& planeOrder, GLsizei width, GLsizei height);
+void renderVoxels(Scene& scene, const glm::mat4& view, const glm::mat4& projection, GLsizei width, GLsizei height);
+void prepareFrame(Scene& scene, const Camera& viewCamera, GLfloat dt);
+void moveCubes(Scene& scene, GLfloat dt);
+void destroyScene(Scene& scene);
+void runGameLoop(GLFWwindow* window, Scene& scene);
+void runThreadedGameLoop(GLFWwindow* window, Scene& scene);
+void renderThreadMain(GLFWwindow* window, Scene* scene, TripleBuffer<FrameSnapshot>* frames);
+void simulate(GLFWwindow* window, int steps, CameraState& previous);
+void captureFrame(Scene& scene, const CameraState& previous, FrameSnapshot& frame);
+void renderFrame(Scene& scene, const FrameSnapshot& frame, double now);
+void buildRenderGraph(GLuint framebuffer, GLsizei width, GLsizei height, bool oit);
+void updateProfiler(double now);
+void updateReadback();
+void updateWindowTitle(GLFWwindow* window);
+int runBenchmark(Scene& scene, const Options& options);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double offsetX, double offsetY);
-void move_camera();
-GLuint loadTexture(GLchar * path, GLboolean alpha);
-Cube* createCube();
-Plane* createPlane();
-Light* createLight();
+void mouse_button_callback(GLFWwindow*, int button, int action, int);
+void pickAtCrosshair();
+void handleKey(int key, int action);
+void handleMouse(double xpos, double ypos);
+void handleScroll(double offsetY);
+void move_camera(GLfloat dt);
+void stepReplay(double time, GLfloat dt);
+double nextStepTime();
+GpuHandle loadTexture(GpuResources& resources, GLchar * path, GLboolean alpha);
+void generateCubeChunk(ChunkCoord chunk, std::vector<glm::vec3>& instances);
+void createVoxelTerrain(VoxelWorld& voxels, int size);
+Cube* createCube(ObjectPool& pool);
+Plane* createPlane(ObjectPool& pool);
+Light* createLight(ObjectPool& pool);
 
 // Window dimensions
 const GLuint WIDTH = 1600, HEIGHT = 900;
@@ -42,99 +189,339 @@ const GLuint WIDTH = 1600, HEIGHT = 900;
 Camera camera(glm::vec3(0.0f, 0.0f, 7.0f));
 bool keys[1024];
 
-// Balance velocity of camera
-GLfloat deltaTime = 0.0f;
-GLfloat lastFrame = 0.0f;
+// Simulation clock, the camera is moved in fixed steps (--tick-rate, --max-catch-up)
+FixedTimestep simulationClock;
 
 // Cursor setup
 GLfloat lastX = 400, lastY = 300;
 bool firstMouseInput = true;
 
+// Profiler output: F1 shows the zone averages in the window title, F2 starts/stops a Chrome trace capture.
+// The profiler is only touched by the thread which renders, the key callback just leaves requests for it
+std::atomic<bool> showProfilerSummary(false);
+std::atomic<bool> toggleCapture(false);
+std::mutex titleMutex;
+std::string profilerTitle;		// next window title, set on the main thread (guarded by titleMutex)
+double lastSummary = 0.0;
+const char* TRACE_PATH = "profile.json";
+
+// Input log written with --record and played back with --replay
+InputRecorder inputRecorder;
+InputReplay inputReplay;
+
+// Scene resolution follows the GPU frame time, only used by the interactive loops (the benchmark measures at full size)
+DynamicResolution dynamicResolution;
+bool useDynamicResolution = false;
+
+// Passes of a frame, built once before the loops start
+RenderGraph renderGraph;
+RenderView renderView;
+GLuint outputFramebuffer = 0;	// what the graph presents into
+GLsizei outputWidth = 0;
+GLsizei outputHeight = 0;
+
+// F12 saves a screenshot of the output. The pixels come back a few frames later and are encoded on another thread
+std::atomic<bool> takeScreenshot(false);
+AsyncReadback readback;
+ScreenshotWriter screenshotWriter;
+
+// A left click picks the instance in the middle of the window (the cursor is captured, so that's where the camera looks)
+InstancePicker picker;
+const char* PICK_OBJECT_NAMES[] = { "cube", "plane", "light" };	// in the order they are added to the picker
+
+// With --collide the camera stops at the pickable objects and slides along them (the streamed cubes have no positions, so they don't collide)
+CollisionWorld collisions;
+bool collideCamera = false;
+// Cubes moved by --edit-cubes are dynamic colliders starting at this one, in instance order (-1 if they don't move)
+int cubeColliders = -1;
+// The cubes move on the thread which renders, the camera collides and picks on the main thread
+std::mutex movingCubesMutex;
+// The voxel terrain too, if there is one. Looked up in its brick map, the cells aren't colliders
+const VoxelWorld* collisionVoxels = NULL;
+// Half size of the camera's body: the box around a capsule of radius 0.25 with the eye in the middle.
+// Wider than the near plane, so nothing gets close enough to be clipped
+const glm::vec3 CAMERA_COLLISION_EXTENT(0.25f, 0.5f, 0.25f);
+
+// --capture records the output, e.g. of a benchmark run. Frames are dropped rather than slowing down the rendering
+VideoCapture videoCapture;
+
+// Frames rendered (and not recorded) before the benchmark starts measuring
+const int BENCHMARK_WARMUP_FRAMES = 30;
+
+// Clip planes of the scene projection
+const GLfloat NEAR_PLANE = 0.1f;
+const GLfloat FAR_PLANE = 1000.0f;
+
+// Block size of the render object pool, enough for each of the object types
+const size_t RENDER_OBJECT_SIZE = sizeof(Cube) > sizeof(Plane)
+	? (sizeof(Cube) > sizeof(Light) ? sizeof(Cube) : sizeof(Light))
+	: (sizeof(Plane) > sizeof(Light) ? sizeof(Plane) : sizeof(Light));
+const size_t RENDER_OBJECTS_PER_CHUNK = 16;
+
+// The random point lights are spread over the cube grids
+const glm::vec3 LIGHTS_MIN(-150.0f, -25.0f, -150.0f);
+const glm::vec3 LIGHTS_MAX(150.0f, 25.0f, 150.0f);
+
+// Streamed world: the lattice of the cube grids, continued in every direction
+const GLfloat CUBE_SPACING = 10.0f;
+const GLfloat CUBE_LAYERS[] = { -20.0f, -10.0f, 10.0f, 20.0f };
+
+// Voxel terrain: cell 0, 0, 0 sits below the cube layers, the cells are as big as a cube
+const GLfloat VOXEL_TERRAIN_Y = -60.0f;
+const int VOXEL_TERRAIN_HEIGHT = 20;
+
+// Particle fountain in front of the start position
+const glm::vec3 FOUNTAIN_POSITION(0.0f, -2.0f, -6.0f);
+const GLfloat FOUNTAIN_LIFETIME = 2.0f;
+const GLfloat PARTICLE_SIZE = 0.1f;
+
+// --edit-cubes: how far a moved cube gets from its place in the grid
+const GLfloat CUBE_BOB_HEIGHT = 2.0f;
+
 
 // The MAIN function, from here we start the application and run the game loop
-int main()
+int main(int argc, char* argv[])
 {
+	Options options = parseOptions(argc, argv);
+	if (options.benchCluster) {
+		return runClusterBenchmark(options.lightCount > 0 ? options.lightCount : 10000, LIGHTS_MIN, LIGHTS_MAX, (GLfloat)WIDTH / (GLfloat)HEIGHT, NEAR_PLANE, FAR_PLANE);
+	}
+	if (options.benchMath) {
+		return runMathBenchmark(glm::perspective(45.0f, (GLfloat)WIDTH / (GLfloat)HEIGHT, NEAR_PLANE, FAR_PLANE));
+	}
+	if (options.benchPick) {
+		return runPickBenchmark();
+	}
+	if (options.benchCollision) {
+		return runCollisionBenchmark(CAMERA_COLLISION_EXTENT);
+	}
+	if (options.benchParticles) {
+		return runParticleBenchmark();
+	}
+	MemoryTracker::enableFrameChecks(options.checkAllocations);
+
 	// Set up and initialize GLF, OpenGL, Key and Mouse Callbacks, the window, etc.
-	GLFWwindow* window = initializeGame();
+	GLFWwindow* window = initializeGame(options);
+	if (window == NULL) {
+		glfwTerminate();
+		return 1;
+	}
+	Profiler::init();
+	if (options.benchInstanceUpdates) {
+		int result = runInstanceUpdateBenchmark();
+		glfwTerminate();
+		return result;
+	}
 
-	// Prepare CUBES
-	Cube* cube = createCube();
-	cube->buildAndCompileShader("shaders/shader.vs", "shaders/shader.frag");
-	cube->prepare(1);	// 1 ... vertices
-	cube->positions.push_back(glm::vec3(0.0f, 0.0f, 0.0f));		// positions array holds 1 vec3 for each object which should be created
-	cube->multiplyObject(glm::vec3(-150.0f, 10.0f, -150.0f), 1000, 10.0f);		// creates n objects @ a certain start position (2d)
-	cube->multiplyObject(glm::vec3(-150.0f, 20.0f, -150.0f), 1000, 10.0f);
-	cube->multiplyObject(glm::vec3(-150.0f, -10.0f, -150.0f), 1000, 10.0f);
-	cube->multiplyObject(glm::vec3(-150.0f, -20.0f, -150.0f), 1000, 10.0f);
-	cube->texture = loadTexture("textures/04pietrac4.png", false);
+	// A replay has to run with the step it was recorded with
+	simulationClock = FixedTimestep(1.0 / options.tickRate, options.maxCatchUp);
+	if (!options.replayPath.empty()) {
+		if (!inputReplay.load(options.replayPath)) {
+			glfwTerminate();
+			return 1;
+		}
+		simulationClock.step = inputReplay.timestep();
+	}
+	if (!options.recordPath.empty()) {
+		inputRecorder.open(options.recordPath, simulationClock.step);
+	}
 
-	// Prepare PLANES
-	Plane* plane = createPlane();
-	plane->buildAndCompileShader("shaders/plane.vs", "shaders/plane.frag");
-	plane->prepare(0);	// 0 ... triangles
-	plane->positions.push_back(glm::vec3(2.0f, 0.0f, 0.0f));
-	plane->positions.push_back(glm::vec3(3.0f, 0.0f, -0.5f));
-	GLfloat plane_color[] = { 0.1f, 0.5f, 0.1f, 0.3f };
-	plane->setColor(plane_color);
-	
-	// Prepare Light source
-	Light* light = createLight();
-	light->buildAndCompileShader("shaders/light.vs", "shaders/light.frag");
-	light->prepare(1);
-	light->positions.push_back(glm::vec3(0.0f, 3.0f, 1.0f));
-	GLfloat light_color[] = { 1.0f, 1.0f, 1.0f };
-	light->setColor(light_color);
+	Scene scene = createScene(options);
+	if (!sceneShadersReady(scene)) {
+		destroyScene(scene);
+		glfwTerminate();
+		return 1;
+	}
+	readback.init();
+	screenshotWriter.start();
+	if (!options.capturePath.empty()) {
+		VideoFormat format = VideoCapture::formatFromPath(options.capturePath);
+		if (options.captureFormat == "y4m")
+			format = VIDEO_Y4M;
+		else if (options.captureFormat == "rgb")
+			format = VIDEO_RAW_RGB;
+		videoCapture.open(options.capturePath, format, options.captureFps, options.captureInterval);
+	}
 
-	// Game loop
-	while (!glfwWindowShouldClose(window))
-	{
-		// Calculate deltatime
-		GLfloat currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+	if (!options.benchmark) {
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+		if (!options.fixedResolution) {
+			useDynamicResolution = dynamicResolution.init(framebufferWidth, framebufferHeight, 1000.0 / options.targetFps, options.minScale, options.maxScale);
+		}
+		buildRenderGraph(0, framebufferWidth, framebufferHeight, scene.transparency != NULL);
+	}
 
-		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
-		glfwPollEvents();
-		move_camera();
-		
-		// Render
-		// Clear the colorbuffer
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// CAMERA
-		glm::mat4 view = camera.GetViewMatrix();
-
-		// PROJECTION
-		glm::mat4 projection = glm::perspective(camera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, 0.1f, 1000.0f);
-		
-		// Bind Textures, activate shader & draw object
-		cube->bindTexture("cubeTexture");
-		cube->activateShader(view, projection);
-		cube->draw(camera, true);
-
-		// activate plane shader, sort and draw planes
-		plane->activateShader(view, projection);
-		plane->sortAndDraw(camera, false);
-
-		// draw light source
-		light->activateShader(view, projection);
-		light->draw(camera, false);
+	int result = 0;
+	if (options.benchmark) {
+		result = runBenchmark(scene, options);
+	}
+	else if (options.singleThread) {
+		runGameLoop(window, scene);
+	}
+	else {
+		runThreadedGameLoop(window, scene);
+	}
 
-		// Swap the screen buffers
-		glfwSwapBuffers(window);
+	// Screenshots and video frames still in flight are written before exiting
+	videoCapture.close();
+	readback.finish();
+	readback.destroy();
+	screenshotWriter.stop();
+
+	if (Profiler::isCapturing()) {
+		Profiler::stopCapture();
+		Profiler::writeChromeTrace(TRACE_PATH);
+	}
+	Profiler::shutdown();
+
+	if (options.memoryReport || options.checkAllocations) {
+		MemoryTracker::printStatistics();
+		scene.gpuResources->printStatistics();
+		scene.meshes->printStatistics();
+		if (scene.world != NULL)
+			scene.world->printStatistics();
+		if (scene.voxels != NULL)
+			scene.voxels->printStatistics();
+		if (scene.particles != NULL)
+			std::cout << "Particles: " << scene.particles->aliveCount() << " of " << scene.particles->capacity() << " alive, "
+				<< scene.particles->droppedCount() << " dropped (pool full)" << std::endl;
+		const DirtyRanges& cubeUpdates = scene.cube->instanceUpdates();
+		if (cubeUpdates.uploadCalls() > 0)
+			std::cout << "Cube instances: " << cubeUpdates.uploadedBytes() / 1024 << " KB of moved cubes uploaded in " << cubeUpdates.uploadCalls()
+				<< " calls, " << cubeUpdates.throttledFlushes() << " frames over the budget" << std::endl;
 	}
 
-	delete cube;
-	delete plane;
-	delete light;
+	renderGraph.destroy();
+	dynamicResolution.destroy();
+	destroyScene(scene);
+	inputRecorder.close();
 	
 	// Terminate GLFW, clearing any resources allocated by GLFW.
 	glfwTerminate();
-	return 0;
+	return result;
 }
 
-GLFWwindow* initializeGame() 
+Options parseOptions(int argc, char* argv[])
+{
+	Options options;
+	options.benchmark = false;
+	options.benchmarkFrames = 600;
+	options.benchmarkOutput = "benchmark.json";
+	options.osmesa = false;
+	options.tickRate = DEFAULT_TICK_RATE;
+	options.maxCatchUp = DEFAULT_MAX_CATCH_UP;
+	options.singleThread = false;
+	options.targetFps = DEFAULT_TARGET_FPS;
+	options.minScale = DEFAULT_MIN_RESOLUTION_SCALE;
+	options.maxScale = DEFAULT_MAX_RESOLUTION_SCALE;
+	options.fixedResolution = false;
+	options.oit = false;
+	options.extraPlanes = 0;
+	options.depthPrepass = false;
+	options.captureInterval = 1;
+	options.captureFps = 60;
+	options.lightCount = 0;
+	options.benchCluster = false;
+	options.benchMath = false;
+	options.benchPick = false;
+	options.collide = false;
+	options.benchCollision = false;
+	options.memoryReport = false;
+	options.checkAllocations = false;
+	options.stream = false;
+	options.streamBudget = DEFAULT_CHUNK_UPLOAD_BUDGET / 1024;
+	options.voxelSize = 0;
+	options.voxelCubes = false;
+	options.particleCount = 0;
+	options.benchParticles = false;
+	options.editCubes = 0;
+	options.instanceBudget = DEFAULT_RANGE_UPLOAD_BUDGET / 1024;
+	options.benchInstanceUpdates = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--benchmark")
+			options.benchmark = true;
+		else if (arg == "--frames" && i + 1 < argc)
+			options.benchmarkFrames = std::max(1, atoi(argv[++i]));
+		else if (arg == "--out" && i + 1 < argc)
+			options.benchmarkOutput = argv[++i];
+		else if (arg == "--osmesa")
+			options.osmesa = true;
+		else if (arg == "--record" && i + 1 < argc)
+			options.recordPath = argv[++i];
+		else if (arg == "--replay" && i + 1 < argc)
+			options.replayPath = argv[++i];
+		else if (arg == "--tick-rate" && i + 1 < argc)
+			options.tickRate = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--max-catch-up" && i + 1 < argc)
+			options.maxCatchUp = std::max(1, atoi(argv[++i]));
+		else if (arg == "--single-thread")
+			options.singleThread = true;
+		else if (arg == "--target-fps" && i + 1 < argc)
+			options.targetFps = std::max(1.0, atof(argv[++i]));
+		else if (arg == "--min-scale" && i + 1 < argc)
+			options.minScale = (GLfloat)atof(argv[++i]);
+		else if (arg == "--max-scale" && i + 1 < argc)
+			options.maxScale = (GLfloat)atof(argv[++i]);
+		else if (arg == "--fixed-resolution")
+			options.fixedResolution = true;
+		else if (arg == "--oit")
+			options.oit = true;
+		else if (arg == "--planes" && i + 1 < argc)
+			options.extraPlanes = std::max(0, atoi(argv[++i]));
+		else if (arg == "--depth-prepass")
+			options.depthPrepass = true;
+		else if (arg == "--capture" && i + 1 < argc)
+			options.capturePath = argv[++i];
+		else if (arg == "--capture-every" && i + 1 < argc)
+			options.captureInterval = std::max(1, atoi(argv[++i]));
+		else if (arg == "--capture-format" && i + 1 < argc)
+			options.captureFormat = argv[++i];
+		else if (arg == "--capture-fps" && i + 1 < argc)
+			options.captureFps = std::max(1, atoi(argv[++i]));
+		else if (arg == "--lights" && i + 1 < argc)
+			options.lightCount = std::max(0, atoi(argv[++i]));
+		else if (arg == "--bench-cluster")
+			options.benchCluster = true;
+		else if (arg == "--bench-math")
+			options.benchMath = true;
+		else if (arg == "--bench-pick")
+			options.benchPick = true;
+		else if (arg == "--collide")
+			options.collide = true;
+		else if (arg == "--bench-collision")
+			options.benchCollision = true;
+		else if (arg == "--memory-report")
+			options.memoryReport = true;
+		else if (arg == "--check-allocations")
+			options.checkAllocations = true;
+		else if (arg == "--stream")
+			options.stream = true;
+		else if (arg == "--stream-budget" && i + 1 < argc)
+			options.streamBudget = std::max(1, atoi(argv[++i]));
+		else if (arg == "--voxels" && i + 1 < argc)
+			options.voxelSize = std::max(0, atoi(argv[++i]));
+		else if (arg == "--voxel-cubes")
+			options.voxelCubes = true;
+		else if (arg == "--particles" && i + 1 < argc)
+			options.particleCount = std::max(0, atoi(argv[++i]));
+		else if (arg == "--bench-particles")
+			options.benchParticles = true;
+		else if (arg == "--edit-cubes" && i + 1 < argc)
+			options.editCubes = std::max(0, atoi(argv[++i]));
+		else if (arg == "--instance-budget" && i + 1 < argc)
+			options.instanceBudget = std::max(1, atoi(argv[++i]));
+		else if (arg == "--bench-instance-updates")
+			options.benchInstanceUpdates = true;
+		else
+			std::cout << "Unknown option " << arg << std::endl;
+	}
+	return options;
+}
+
+GLFWwindow* initializeGame(const Options& options) 
 {
 	// Init GLFW
 	glfwInit();
@@ -143,17 +530,36 @@ GLFWwindow* initializeGame()
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 
+	// The benchmark renders into its own framebuffer, so the window is never shown
+	if (options.benchmark) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	}
+	if (options.osmesa) {
+#ifdef GLFW_OSMESA_CONTEXT_API
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#else
+		std::cout << "ERROR::GLFW::OSMESA_NOT_SUPPORTED (needs GLFW 3.3), using a hidden window" << std::endl;
+#endif
+	}
+
 	// Create a GLFWwindow object that we can use for GLFW's functions
 	GLFWwindow* window = glfwCreateWindow(WIDTH, HEIGHT, "CSE_Tuerk", nullptr, nullptr);
+	if (window == NULL) {
+		std::cout << "ERROR::GLFW::WINDOW_NOT_CREATED" << std::endl;
+		return NULL;
+	}
 	glfwMakeContextCurrent(window);
 
 	// Set the required callback functions
 	glfwSetKeyCallback(window, key_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetMouseButtonCallback(window, mouse_button_callback);
 
 	// Hide cursor
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	if (!options.benchmark) {
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	// Set this to true so GLEW knows to use a modern approach to retrieving function pointers and extensions
 	glewExperimental = GL_TRUE;
@@ -171,12 +577,782 @@ GLFWwindow* initializeGame()
 	return window;
 }
 
+Scene createScene(const Options& options)
+{
+	PROFILE_ZONE("LoadScene");
+	MEMORY_TAG(MEMORY_TAG_SCENE);
+	Scene scene;
+
+	// All objects use variants of the same shader files, each variant is compiled once on first use
+	scene.shaderLibrary = new ShaderLibrary();
+	scene.threadPool = new ThreadPool();
+	scene.objects = new ObjectPool(RENDER_OBJECT_SIZE, RENDER_OBJECTS_PER_CHUNK);
+	scene.gpuResources = new GpuResources();
+	scene.meshes = new MeshRegistry(scene.gpuResources);
+
+	// Prepare CUBES
+	Cube* cube = createCube(*scene.objects);
+	GLuint cubeFeatures = SHADER_VERTEX_UV | SHADER_TEXTURED | SHADER_LOD_TINT | SHADER_INSTANCED;
+	if (options.lightCount > 0) {
+		cubeFeatures |= SHADER_CLUSTERED_LIGHTING;
+	}
+	cube->buildAndCompileShader(scene.shaderLibrary, "shaders/object.vs", "shaders/object.frag", cubeFeatures);
+	cube->prepare(1, scene.meshes);	// 1 ... vertices
+	scene.world = NULL;
+	if (options.stream) {
+		// The chunks are the batches, drawn front to back like the grid cells
+		scene.world = new ChunkStreamer(scene.gpuResources, generateCubeChunk, (size_t)options.streamBudget * 1024);
+		scene.world->start();
+		cube->streamInstances(scene.world->instanceBuffer(), &scene.world->batches());
+	}
+	else {
+		cube->positions.push_back(glm::vec3(0.0f, 0.0f, 0.0f));		// positions array holds 1 vec3 for each object which should be created
+		cube->multiplyObject(glm::vec3(-150.0f, 10.0f, -150.0f), 1000, 10.0f);		// creates n objects @ a certain start position (2d)
+		cube->multiplyObject(glm::vec3(-150.0f, 20.0f, -150.0f), 1000, 10.0f);
+		cube->multiplyObject(glm::vec3(-150.0f, -10.0f, -150.0f), 1000, 10.0f);
+		cube->multiplyObject(glm::vec3(-150.0f, -20.0f, -150.0f), 1000, 10.0f);
+	}
+	cube->texture = loadTexture(*scene.gpuResources, "textures/04pietrac4.png", false);
+	cube->batchSize = 80.0f;	// coarse front to back order, a few dozen draw calls
+	cube->setInstanceUploadBudget((size_t)options.instanceBudget * 1024);
+	// Moved cubes bob around where the grids put them. Streamed cubes aren't in positions, so they stay
+	scene.editedCubes = options.stream ? 0 : options.editCubes;
+	scene.editTime = 0.0f;
+	scene.editRandom = 1;
+	if (scene.editedCubes > 0) {
+		scene.cubeHomes = cube->positions;
+	}
+	scene.depthPrepass = options.depthPrepass;
+	if (scene.depthPrepass) {
+		cube->prepareDepthPass(scene.shaderLibrary, "shaders/object.vs", "shaders/depth.frag");
+	}
+	scene.cube = cube;
+
+	// Prepare PLANES
+	// Sorted planes are drawn one by one, with OIT the order doesn't matter and all of them are drawn in one instanced call
+	scene.transparency = NULL;
+	if (options.oit) {
+		scene.transparency = new WeightedBlendedOIT();
+		if (!scene.transparency->init(scene.shaderLibrary)) {
+			delete scene.transparency;
+			scene.transparency = NULL;
+		}
+	}
+	Plane* plane = createPlane(*scene.objects);
+	plane->buildAndCompileShader(scene.shaderLibrary, "shaders/object.vs", "shaders/object.frag", scene.transparency ? SHADER_INSTANCED | SHADER_OIT : 0);
+	plane->prepare(0, scene.meshes);	// 0 ... triangles
+	plane->positions.push_back(glm::vec3(2.0f, 0.0f, 0.0f));
+	plane->positions.push_back(glm::vec3(3.0f, 0.0f, -0.5f));
+	if (options.extraPlanes > 0) {
+		plane->multiplyObject(glm::vec3(-50.0f, 0.0f, -100.0f), options.extraPlanes, 1.0f);
+	}
+	GLfloat plane_color[] = { 0.1f, 0.5f, 0.1f, 0.3f };
+	plane->setColor(plane_color);
+	scene.plane = plane;
+	
+	// Prepare Light source
+	Light* light = createLight(*scene.objects);
+	light->buildAndCompileShader(scene.shaderLibrary, "shaders/object.vs", "shaders/object.frag", SHADER_INSTANCED);
+	light->prepare(1, scene.meshes);
+	light->positions.push_back(glm::vec3(0.0f, 3.0f, 1.0f));
+	GLfloat light_color[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	light->setColor(light_color);
+	scene.light = light;
+
+	// Point lights: the light source and the random ones
+	scene.lighting = NULL;
+	if (options.lightCount > 0) {
+		scene.lighting = new ClusteredLighting(scene.threadPool);
+		scene.lighting->init();
+		PointLight lamp;
+		lamp.position = light->positions[0];
+		lamp.radius = 25.0f;
+		lamp.color = glm::vec3(1.0f);
+		lamp.intensity = 1.5f;
+		scene.lighting->lights.push_back(lamp);
+		scene.lighting->addRandomLights(options.lightCount, LIGHTS_MIN, LIGHTS_MAX, 1);
+	}
+
+	// Pickable instances, in the order of PICK_OBJECT_NAMES. The streamed cubes have no positions and can't be picked.
+	// The same instances are what the camera collides with
+	SimpleObject* pickable[] = { cube, plane, light };
+	picker.clear();
+	collisions.clear();
+	collideCamera = options.collide;
+	cubeColliders = -1;
+	for (int i = 0; i < 3; i++) {
+		glm::vec3 boundsMin, boundsMax;
+		pickable[i]->localBounds(boundsMin, boundsMax);
+		picker.addObject(pickable[i]->positions, boundsMin, boundsMax);
+		if (!collideCamera)
+			continue;
+		if (pickable[i] == cube && scene.editedCubes > 0) {
+			// Moved by moveCubes, so they are hashed again when they cross into other cells
+			glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+			glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+			for (size_t j = 0; j < cube->positions.size(); j++) {
+				int collider = collisions.addDynamic(cube->positions[j] + center, extent, glm::vec3(0.0f, CUBE_BOB_HEIGHT, 0.0f));
+				if (j == 0)
+					cubeColliders = collider;
+			}
+		}
+		else {
+			collisions.addStatic(pickable[i]->positions, boundsMin, boundsMax);
+		}
+	}
+	picker.build();
+	if (collideCamera) {
+		collisions.build();
+	}
+
+	// Voxel terrain, meshed once here and again only where cells change
+	scene.voxels = NULL;
+	scene.voxelShader = NULL;
+	if (options.voxelSize > 0) {
+		GLuint voxelFeatures = SHADER_VERTEX_UV | SHADER_TEXTURED;
+		if (options.lightCount > 0) {
+			voxelFeatures |= SHADER_CLUSTERED_LIGHTING;
+		}
+		scene.voxelShader = scene.shaderLibrary->get("shaders/object.vs", "shaders/object.frag", voxelFeatures);
+		glm::vec3 corner(-options.voxelSize / 2.0f, VOXEL_TERRAIN_Y, -options.voxelSize / 2.0f);
+		scene.voxels = new VoxelWorld(scene.gpuResources, scene.threadPool, corner);
+		scene.voxels->setGreedy(!options.voxelCubes);
+		createVoxelTerrain(*scene.voxels, options.voxelSize);
+		scene.voxels->update();
+		scene.voxels->printStatistics();
+	}
+	collisionVoxels = collideCamera ? scene.voxels : NULL;
+
+	// Particle fountain, the pool refilled a bit faster than the particles die so it stays full
+	scene.particles = NULL;
+	scene.particleRenderer = NULL;
+	scene.particleTime = 0.0;
+	if (options.particleCount > 0) {
+		scene.particles = new ParticleSystem((size_t)options.particleCount, scene.threadPool);
+		ParticleEmitter fountain;
+		fountain.position = FOUNTAIN_POSITION;
+		fountain.velocity = glm::vec3(0.0f, 6.0f, 0.0f);
+		fountain.spread = 1.5f;
+		fountain.lifetime = FOUNTAIN_LIFETIME;
+		fountain.rate = options.particleCount / FOUNTAIN_LIFETIME * 1.5f;
+		fountain.color = glm::vec4(1.0f, 0.55f, 0.15f, 0.6f);
+		scene.particles->addEmitter(fountain);
+		scene.particles->setDamping(0.8f);
+		scene.particleRenderer = new ParticleRenderer(scene.shaderLibrary, scene.gpuResources, (size_t)options.particleCount);
+	}
+
+	return scene;
+}
+
+// Draws the scene from the given camera into the bound framebuffer
+void renderScene(Scene& scene, Camera& viewCamera, const std::vector<glm::vec3>& planeOrder, GLsizei width, GLsizei height)
+{
+	renderOpaque(scene, viewCamera, width, height);
+	renderTransparent(scene, viewCamera, planeOrder, width, height);
+}
+
+// Clears the bound framebuffer and draws everything which doesn't need blending
+void renderOpaque(Scene& scene, Camera& viewCamera, GLsizei width, GLsizei height)
+{
+	PROFILE_GPU_ZONE("Submit");
+
+	// Clear the colorbuffer
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// CAMERA
+	glm::mat4 view = viewCamera.GetViewMatrix();
+
+	// PROJECTION
+	glm::mat4 projection = glm::perspective(viewCamera.Zoom, (GLfloat)width / (GLfloat)height, NEAR_PLANE, FAR_PLANE);
+
+	// Light lists for this view
+	if (scene.lighting != NULL) {
+		scene.lighting->bin(view, projection, NEAR_PLANE, FAR_PLANE);
+		scene.lighting->upload();
+	}
+
+	// Depth only first, so the textured pass below shades every pixel once
+	if (scene.depthPrepass) {
+		PROFILE_GPU_ZONE("DepthPrepass");
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		scene.cube->drawDepth(view, projection, viewCamera);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	// Activate shader, bind Textures & draw object (the sampler uniform needs the program to be in use)
+	scene.cube->activateShader(view, projection);
+	scene.cube->bindTexture("cubeTexture");
+	if (scene.lighting != NULL) {
+		scene.lighting->bind(scene.cube->shader, width, height, 1);
+	}
+	scene.cube->draw(viewCamera, true);
+	if (scene.lighting != NULL) {
+		scene.lighting->unbind(1);
+	}
+
+	if (scene.depthPrepass) {
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+
+	// Not part of the depth pre-pass, so after the depth test is back to normal
+	if (scene.voxels != NULL) {
+		renderVoxels(scene, view, projection, width, height);
+	}
+
+	// draw light source
+	scene.light->activateShader(view, projection);
+	scene.light->draw(viewCamera, false);
+
+	// Blended, but they don't write depth, so the transparent planes still see the opaque scene
+	if (scene.particles != NULL) {
+		scene.particleRenderer->draw(*scene.particles, view, projection, PARTICLE_SIZE);
+	}
+}
+
+// The voxel chunks, textured and lit like the cubes
+void renderVoxels(Scene& scene, const glm::mat4& view, const glm::mat4& projection, GLsizei width, GLsizei height)
+{
+	PROFILE_GPU_ZONE("Voxels");
+	Shader* shader = scene.voxelShader;
+	shader->Use();
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "model"), 1, GL_FALSE, glm::value_ptr(glm::mat4()));
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+	glUniform4f(glGetUniformLocation(shader->Program, "inColor"), 1.0f, 1.0f, 1.0f, 1.0f);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, scene.gpuResources->name(scene.cube->texture));
+	glUniform1i(glGetUniformLocation(shader->Program, "cubeTexture"), 0);
+	if (scene.lighting != NULL) {
+		scene.lighting->bind(shader, width, height, 1);
+	}
+	scene.voxels->draw();
+	if (scene.lighting != NULL) {
+		scene.lighting->unbind(1);
+	}
+}
+
+// Draws the planes: in the order the simulation sorted them, or with OIT in one instanced call into the accumulation targets
+void renderTransparent(Scene& scene, Camera& viewCamera, const std::vector<glm::vec3>& planeOrder, GLsizei width, GLsizei height)
+{
+	PROFILE_GPU_ZONE("SubmitTransparent");
+
+	glm::mat4 view = viewCamera.GetViewMatrix();
+	glm::mat4 projection = glm::perspective(viewCamera.Zoom, (GLfloat)width / (GLfloat)height, NEAR_PLANE, FAR_PLANE);
+
+	scene.plane->activateShader(view, projection);
+	if (scene.transparency != NULL) {
+		scene.plane->draw(viewCamera, false);
+	}
+	else {
+		scene.plane->drawOrdered(planeOrder, viewCamera, false);
+	}
+}
+
+// A shader whose sources failed to load is NULL, the errors printed before tell which file
+bool sceneShadersReady(const Scene& scene)
+{
+	if (scene.cube->shader == NULL || scene.plane->shader == NULL || scene.light->shader == NULL
+		|| (scene.voxels != NULL && scene.voxelShader == NULL)) {
+		std::cout << "ERROR::SCENE::SHADERS_MISSING" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void destroyScene(Scene& scene)
+{
+	scene.objects->destroy(scene.cube);
+	scene.objects->destroy(scene.plane);
+	scene.objects->destroy(scene.light);
+	delete scene.objects;
+	delete scene.world;
+	collisionVoxels = NULL;
+	delete scene.voxels;
+	delete scene.particles;
+	delete scene.particleRenderer;
+	// After the objects, they release their meshes and handles into these
+	delete scene.meshes;
+	delete scene.gpuResources;
+	delete scene.transparency;
+	delete scene.lighting;
+	delete scene.threadPool;
+	delete scene.shaderLibrary;
+}
+
+// Polls, simulates and renders one after another on the main thread
+void runGameLoop(GLFWwindow* window, Scene& scene)
+{
+	CameraState previous = CameraState::capture(camera);
+	FrameSnapshot frame;
+
+	// Game loop
+	while (!glfwWindowShouldClose(window))
+	{
+		// Real time decides how many fixed simulation steps are due
+		double now = glfwGetTime();
+		int steps = simulationClock.advance(now);
+		Profiler::beginFrame();
+		MemoryTracker::beginFrame();
+
+		// Check if any events have been activiated (key pressed, mouse moved etc.) and call corresponding response functions
+		{
+			PROFILE_ZONE("Events");
+			glfwPollEvents();
+		}
+
+		simulate(window, steps, previous);
+		captureFrame(scene, previous, frame);
+		renderFrame(scene, frame, now);
+
+		// Swap the screen buffers
+		{
+			PROFILE_ZONE("Swap");
+			glfwSwapBuffers(window);
+		}
+		scene.gpuResources->endFrame();
+		MemoryTracker::endFrame();
+		Profiler::endFrame();
+		FrameArena::thread().reset();
+
+		updateProfiler(now);
+		updateWindowTitle(window);
+	}
+}
+
+// Input and simulation stay on the main thread (GLFW wants events polled there), a render thread owns the GL context.
+// After every simulation step a snapshot is published through a triple buffer, so neither side ever waits for the other
+void runThreadedGameLoop(GLFWwindow* window, Scene& scene)
+{
+	CameraState previous = CameraState::capture(camera);
+	TripleBuffer<FrameSnapshot> frames;
+	simulationClock.advance(glfwGetTime());
+	captureFrame(scene, previous, frames.writeBuffer());
+	frames.publish();
+
+	glfwMakeContextCurrent(NULL);
+	std::thread renderThread(renderThreadMain, window, &scene, &frames);
+	Profiler::setThreadName("Simulation");
+
+	while (!glfwWindowShouldClose(window))
+	{
+		int steps = simulationClock.advance(glfwGetTime());
+		MemoryTracker::beginFrame();
+		simulate(window, steps, previous);
+		if (steps > 0) {
+			PROFILE_ZONE("Snapshot");
+			captureFrame(scene, previous, frames.writeBuffer());
+			frames.publish();
+			FrameArena::thread().reset();
+		}
+		MemoryTracker::endFrame();
+		updateWindowTitle(window);
+
+		// Sleep until the next step is due, input wakes the thread up early
+		{
+			PROFILE_ZONE("Events");
+			double wait = simulationClock.timeToNextStep();
+			if (wait > 0.0)
+				glfwWaitEventsTimeout(wait);
+			else
+				glfwPollEvents();
+		}
+	}
+
+	renderThread.join();
+	glfwMakeContextCurrent(window);
+}
+
+// Renders the newest snapshot as often as the GPU (or vsync) allows, until the window is closed
+void renderThreadMain(GLFWwindow* window, Scene* scene, TripleBuffer<FrameSnapshot>* frames)
+{
+	glfwMakeContextCurrent(window);
+	Profiler::setThreadName("Render");
+
+	while (!glfwWindowShouldClose(window))
+	{
+		Profiler::beginFrame();
+		MemoryTracker::beginFrame();
+		// Keeps the last snapshot if the simulation hasn't stepped since the last frame
+		frames->update();
+		double now = glfwGetTime();
+		renderFrame(*scene, frames->readBuffer(), now);
+
+		{
+			PROFILE_ZONE("Swap");
+			glfwSwapBuffers(window);
+		}
+		scene->gpuResources->endFrame();
+		MemoryTracker::endFrame();
+		Profiler::endFrame();
+		FrameArena::thread().reset();
+		updateProfiler(now);
+	}
+
+	glfwMakeContextCurrent(NULL);
+}
+
+// The simulation runs at a fixed rate, no matter how fast frames are rendered
+void simulate(GLFWwindow* window, int steps, CameraState& previous)
+{
+	PROFILE_ZONE("Simulate");
+	for (int i = 0; i < steps; i++) {
+		previous = CameraState::capture(camera);
+		simulationClock.stepIndex++;
+		double time = simulationClock.simulationTime();
+
+		if (inputReplay.isLoaded()) {
+			stepReplay(time, (GLfloat)simulationClock.step);
+		}
+		else {
+			move_camera((GLfloat)simulationClock.step);
+			inputRecorder.recordCamera(time, camera);
+		}
+	}
+
+	if (inputReplay.isLoaded() && inputReplay.finished() && !glfwWindowShouldClose(window)) {
+		std::cout << "Replay finished, max camera deviation " << inputReplay.maxDeviation() << std::endl;
+		glfwSetWindowShouldClose(window, GL_TRUE);
+	}
+}
+
+// Copies the simulation state the renderer needs. Sorting the planes only reads their positions, so it's done here as well
+void captureFrame(Scene& scene, const CameraState& previous, FrameSnapshot& frame)
+{
+	frame.camera = camera;
+	frame.previous = previous;
+	frame.stepTime = simulationClock.stepTime();
+	frame.step = simulationClock.step;
+	if (scene.transparency == NULL) {
+		scene.plane->sortBackToFront(camera, frame.planeOrder);
+	}
+}
+
+// Renders in between the last two simulation steps
+// Streaming and re-meshing, done before the passes draw anything
+void prepareFrame(Scene& scene, const Camera& viewCamera, GLfloat dt)
+{
+	if (scene.world != NULL) {
+		scene.world->update(viewCamera.Position, viewCamera.Front);
+	}
+	if (scene.voxels != NULL) {
+		scene.voxels->update();
+	}
+	if (scene.particles != NULL) {
+		scene.particles->update(dt);
+	}
+	if (scene.editedCubes > 0) {
+		moveCubes(scene, dt);
+	}
+	scene.cube->flushInstances();
+}
+
+// Some random cubes a bit up or down, the picker and the colliders follow them
+void moveCubes(Scene& scene, GLfloat dt)
+{
+	PROFILE_ZONE("MoveCubes");
+	scene.editTime += dt;
+	size_t count = scene.cubeHomes.size();
+	glm::vec3 boundsMin, boundsMax;
+	scene.cube->localBounds(boundsMin, boundsMax);
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	std::lock_guard<std::mutex> lock(movingCubesMutex);
+	for (int n = 0; n < scene.editedCubes; n++) {
+		scene.editRandom ^= scene.editRandom << 13;
+		scene.editRandom ^= scene.editRandom >> 17;
+		scene.editRandom ^= scene.editRandom << 5;
+		size_t i = scene.editRandom % count;
+		GLfloat height = CUBE_BOB_HEIGHT * sin(scene.editTime * 3.0f + (GLfloat)i);
+		glm::vec3 position = scene.cubeHomes[i] + glm::vec3(0.0f, height, 0.0f);
+		scene.cube->setPosition(i, position);
+		picker.moveInstance(0, (int)i, position);
+		if (cubeColliders >= 0) {
+			collisions.moveDynamic(cubeColliders + (int)i, position + center);
+		}
+	}
+}
+
+void renderFrame(Scene& scene, const FrameSnapshot& frame, double now)
+{
+	GLfloat alpha = (GLfloat)glm::clamp((now - frame.stepTime) / frame.step, 0.0, 1.0);
+	Camera renderCamera = frame.camera;
+	CameraState::interpolate(frame.previous, CameraState::capture(frame.camera), alpha, renderCamera);
+
+	// The particles follow the real time of the frames, not the simulation steps
+	GLfloat dt = scene.particleTime > 0.0 ? (GLfloat)std::min(now - scene.particleTime, 0.1) : 0.0f;
+	scene.particleTime = now;
+	prepareFrame(scene, renderCamera, dt);
+	renderView.scene = &scene;
+	renderView.camera = renderCamera;
+	renderView.planeOrder = &frame.planeOrder;
+	renderGraph.execute();
+	updateReadback();
+}
+
+// Size of the scene inside its targets: the current dynamic resolution, or all of the target
+GLsizei sceneWidth(const RenderPassContext& pass)
+{
+	return useDynamicResolution ? dynamicResolution.renderWidth() : pass.width;
+}
+
+GLsizei sceneHeight(const RenderPassContext& pass)
+{
+	return useDynamicResolution ? dynamicResolution.renderHeight() : pass.height;
+}
+
+// The scene goes straight into the output framebuffer, unless the dynamic resolution (target sized for the max scale,
+// upscaled into the output) or OIT (opaque depth shared with the transparent pass) need offscreen targets
+void buildRenderGraph(GLuint framebuffer, GLsizei width, GLsizei height, bool oit)
+{
+	renderGraph.reset();
+	RenderResource output = renderGraph.importFramebuffer("Output", framebuffer, width, height);
+	outputFramebuffer = framebuffer;
+	outputWidth = width;
+	outputHeight = height;
+
+	if (!useDynamicResolution && !oit) {
+		renderGraph.addPass("Scene", [](const RenderPassContext& pass) {
+			renderScene(*renderView.scene, renderView.camera, *renderView.planeOrder, pass.width, pass.height);
+		}).write(output);
+		return;
+	}
+
+	GLsizei targetWidth = useDynamicResolution ? dynamicResolution.maxWidth() : width;
+	GLsizei targetHeight = useDynamicResolution ? dynamicResolution.maxHeight() : height;
+	RenderResource sceneColor = renderGraph.createTarget("SceneColor", RenderTargetDesc(targetWidth, targetHeight, GL_RGBA8));
+	RenderResource sceneDepth = renderGraph.createTarget("SceneDepth", RenderTargetDesc(targetWidth, targetHeight, GL_DEPTH24_STENCIL8));
+
+	// The dynamic resolution times everything from the first to the last scene pass.
+	// Only the part of the targets the current scale covers is used
+	if (!oit) {
+		renderGraph.addPass("Scene", [](const RenderPassContext& pass) {
+			if (useDynamicResolution)
+				dynamicResolution.begin();
+			glViewport(0, 0, sceneWidth(pass), sceneHeight(pass));
+			renderScene(*renderView.scene, renderView.camera, *renderView.planeOrder, sceneWidth(pass), sceneHeight(pass));
+			if (useDynamicResolution)
+				dynamicResolution.end();
+		}).write(sceneColor).depth(sceneDepth);
+	}
+	else {
+		RenderResource accum = renderGraph.createTarget("OitAccum", RenderTargetDesc(targetWidth, targetHeight, OIT_ACCUM_FORMAT));
+		RenderResource weight = renderGraph.createTarget("OitWeight", RenderTargetDesc(targetWidth, targetHeight, OIT_WEIGHT_FORMAT));
+
+		renderGraph.addPass("Opaque", [](const RenderPassContext& pass) {
+			if (useDynamicResolution)
+				dynamicResolution.begin();
+			glViewport(0, 0, sceneWidth(pass), sceneHeight(pass));
+			renderOpaque(*renderView.scene, renderView.camera, sceneWidth(pass), sceneHeight(pass));
+		}).write(sceneColor).depth(sceneDepth);
+
+		// Depth tested against the opaque scene, but not written
+		renderGraph.addPass("Transparent", [](const RenderPassContext& pass) {
+			glViewport(0, 0, sceneWidth(pass), sceneHeight(pass));
+			renderView.scene->transparency->beginAccumulation();
+			renderTransparent(*renderView.scene, renderView.camera, *renderView.planeOrder, sceneWidth(pass), sceneHeight(pass));
+			renderView.scene->transparency->endAccumulation();
+		}).write(accum).write(weight).depth(sceneDepth, true);
+
+		renderGraph.addPass("Composite", [accum, weight](const RenderPassContext& pass) {
+			glViewport(0, 0, sceneWidth(pass), sceneHeight(pass));
+			renderView.scene->transparency->compositeOver(pass.texture(accum), pass.texture(weight));
+			if (useDynamicResolution)
+				dynamicResolution.end();
+		}).read(accum).read(weight).write(sceneColor);
+	}
+
+	renderGraph.addPass("Upscale", [sceneColor](const RenderPassContext& pass) {
+		pass.blit(sceneColor, sceneWidth(pass), sceneHeight(pass));
+	}).read(sceneColor).write(output);
+}
+
+// Handles the profiler requests from the key callback, runs on the thread which renders
+void updateProfiler(double now)
+{
+	if (toggleCapture.exchange(false)) {
+		if (Profiler::isCapturing()) {
+			Profiler::stopCapture();
+			Profiler::writeChromeTrace(TRACE_PATH);
+		}
+		else {
+			Profiler::startCapture();
+		}
+	}
+
+	if (showProfilerSummary && now - lastSummary > 0.5) {
+		std::string summary = Profiler::summary();
+		if (useDynamicResolution) {
+			std::ostringstream scale;
+			scale << "  Scale " << (int)(dynamicResolution.scale() * 100.0f + 0.5f) << "% (" << dynamicResolution.renderWidth() << "x" << dynamicResolution.renderHeight() << ")";
+			summary += scale.str();
+		}
+		std::lock_guard<std::mutex> lock(titleMutex);
+		profilerTitle = summary;
+		lastSummary = now;
+	}
+}
+
+// Starts a requested screenshot and passes finished readbacks on, runs on the thread which renders (before the swap)
+void updateReadback()
+{
+	// A screenshot allocates its pixels and path, these are reported by --check-allocations but counted as capture memory
+	MEMORY_TAG(MEMORY_TAG_CAPTURE);
+	if (takeScreenshot.exchange(false)) {
+		std::string path = screenshotWriter.nextPath();
+		bool started = readback.request(outputFramebuffer, outputWidth, outputHeight, [path](ReadbackImage& image) {
+			screenshotWriter.save(path, image);
+		});
+		if (!started) {
+			std::cout << "ERROR::SCREENSHOT::TOO_MANY_IN_FLIGHT" << std::endl;
+		}
+	}
+	readback.poll();
+	videoCapture.captureFrame(outputFramebuffer, outputWidth, outputHeight);
+}
+
+// Window titles can only be set on the main thread
+void updateWindowTitle(GLFWwindow* window)
+{
+	std::lock_guard<std::mutex> lock(titleMutex);
+	if (!profilerTitle.empty()) {
+		glfwSetWindowTitle(window, profilerTitle.c_str());
+		profilerTitle.clear();
+	}
+}
+
+// Renders a fixed number of frames into an offscreen framebuffer along a scripted camera path.
+// Every frame ends with glFinish, so the frame times include the GPU work
+int runBenchmark(Scene& scene, const Options& options)
+{
+	Framebuffer target;
+	if (!target.create(WIDTH, HEIGHT)) {
+		return 1;
+	}
+
+	buildRenderGraph(target.FBO, target.width, target.height, scene.transparency != NULL);
+
+	// A replay brings its own camera path and length, the warmup frames then stand still at the start
+	bool replay = inputReplay.isLoaded();
+	std::vector<glm::vec3> planeOrder;
+	Benchmark benchmark(replay ? inputReplay.stepCount() : options.benchmarkFrames, BENCHMARK_WARMUP_FRAMES);
+	for (int frame = 0; frame < benchmark.totalFrames(); frame++) {
+		long long frameStart = Profiler::now();
+		Profiler::beginFrame();
+		MemoryTracker::beginFrame();
+
+		// One simulation step per frame, so a replay always shows the same frames
+		if (replay) {
+			if (frame >= BENCHMARK_WARMUP_FRAMES)
+				stepReplay((frame - BENCHMARK_WARMUP_FRAMES + 1) * simulationClock.step, (GLfloat)simulationClock.step);
+		}
+		else {
+			benchmark.moveCamera(frame, camera);
+		}
+		if (scene.transparency == NULL) {
+			scene.plane->sortBackToFront(camera, planeOrder);
+		}
+		prepareFrame(scene, camera, (GLfloat)simulationClock.step);
+		renderView.scene = &scene;
+		renderView.camera = camera;
+		renderView.planeOrder = &planeOrder;
+		renderGraph.execute();
+		updateReadback();
+		{
+			PROFILE_ZONE("Finish");
+			glFinish();
+		}
+
+		scene.gpuResources->endFrame();
+		MemoryTracker::endFrame();
+		Profiler::endFrame();
+		FrameArena::thread().reset();
+		benchmark.recordFrame(frame, (Profiler::now() - frameStart) / 1000000.0, Profiler::lastFrameTimes());
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	renderGraph.destroy();
+	if (replay) {
+		std::cout << "Replay finished, max camera deviation " << inputReplay.maxDeviation() << std::endl;
+	}
+
+	return benchmark.writeReport(options.benchmarkOutput, WIDTH, HEIGHT) ? 0 : 1;
+}
+
 // Is called whenever a key is pressed/released via GLFW
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GL_TRUE);
 
+	if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
+		showProfilerSummary = !showProfilerSummary;
+		if (!showProfilerSummary) {
+			std::lock_guard<std::mutex> lock(titleMutex);
+			profilerTitle = "CSE_Tuerk";
+		}
+	}
+
+	if (key == GLFW_KEY_F2 && action == GLFW_PRESS) {
+		toggleCapture = true;
+	}
+
+	if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+		takeScreenshot = true;
+	}
+
+	// While replaying only the recorded input moves the camera
+	if (inputReplay.isLoaded())
+		return;
+	inputRecorder.recordKey(nextStepTime(), key, action);
+	handleKey(key, action);
+}
+
+void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+	if (inputReplay.isLoaded())
+		return;
+	inputRecorder.recordMouse(nextStepTime(), xpos, ypos);
+	handleMouse(xpos, ypos);
+}
+
+void scroll_callback(GLFWwindow* window, double offsetX, double offsetY) {
+	if (inputReplay.isLoaded())
+		return;
+	inputRecorder.recordScroll(nextStepTime(), offsetY);
+	handleScroll(offsetY);
+}
+
+// Picking doesn't change the simulation, so it isn't recorded
+void mouse_button_callback(GLFWwindow*, int button, int action, int) {
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+		pickAtCrosshair();
+}
+
+// Runs on the main thread, which owns the camera
+void pickAtCrosshair()
+{
+	glm::mat4 projection = glm::perspective(camera.Zoom, (GLfloat)WIDTH / (GLfloat)HEIGHT, NEAR_PLANE, FAR_PLANE);
+	PickRay ray = PickRay::fromCamera(camera, projection, WIDTH / 2.0, HEIGHT / 2.0, WIDTH, HEIGHT);
+	long long start = Profiler::now();
+	PickHit hit;
+	bool found;
+	{
+		std::lock_guard<std::mutex> lock(movingCubesMutex);
+		picker.refit();
+		found = picker.pick(ray, hit, FAR_PLANE);
+	}
+	double microseconds = (Profiler::now() - start) / 1000.0;
+	if (found) {
+		std::cout << "Picked " << PICK_OBJECT_NAMES[hit.object] << " " << hit.instance << " at " << hit.point.x << ", " << hit.point.y << ", "
+			<< hit.point.z << ", distance " << hit.distance << " (" << microseconds << " us)" << std::endl;
+	}
+	else {
+		std::cout << "Nothing picked (" << microseconds << " us)" << std::endl;
+	}
+}
+
+void handleKey(int key, int action) {
 	if (key >= 0 && key < 1024) {
 		if (action == GLFW_PRESS)
 			keys[key] = true;
@@ -185,7 +1361,7 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	}
 }
 
-void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
+void handleMouse(double xpos, double ypos) {
 	
 	if (firstMouseInput) {
 		lastX = xpos;
@@ -203,31 +1379,73 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
 
 }
 
-void scroll_callback(GLFWwindow* window, double offsetX, double offsetY) {
+void handleScroll(double offsetY) {
 	camera.ProcessMouseScroll(offsetY);
 }
 
-void move_camera() {
+void move_camera(GLfloat dt) {
+	glm::vec3 start = camera.Position;
 	if (keys[GLFW_KEY_W])
-		camera.ProcessKeyboard(FORWARD, deltaTime);
+		camera.ProcessKeyboard(FORWARD, dt);
 	if (keys[GLFW_KEY_S])
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
+		camera.ProcessKeyboard(BACKWARD, dt);
 	if (keys[GLFW_KEY_A])
-		camera.ProcessKeyboard(LEFT, deltaTime);
+		camera.ProcessKeyboard(LEFT, dt);
 	if (keys[GLFW_KEY_D])
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		camera.ProcessKeyboard(RIGHT, dt);
+	// The keys only say where the camera wants to go, the colliders decide how far it gets
+	if (collideCamera && camera.Position != start) {
+		std::lock_guard<std::mutex> lock(movingCubesMutex);
+		camera.Position = collisions.move(start, CAMERA_COLLISION_EXTENT, camera.Position - start);
+	}
+	// One axis after the other, whichever would end up in a solid cell keeps its old value, so the camera slides along the terrain
+	if (collisionVoxels != NULL && camera.Position != start) {
+		glm::vec3 target = camera.Position;
+		glm::vec3 position = start;
+		for (int axis = 0; axis < 3; axis++) {
+			glm::vec3 moved = position;
+			moved[axis] = target[axis];
+			if (!collisionVoxels->overlaps(moved - CAMERA_COLLISION_EXTENT, moved + CAMERA_COLLISION_EXTENT))
+				position = moved;
+		}
+		camera.Position = position;
+	}
+}
+
+// Live input takes effect in the next simulation step, so that's the time it is recorded with
+double nextStepTime() {
+	return (simulationClock.stepIndex + 1) * simulationClock.step;
 }
 
-GLuint loadTexture(GLchar * path, GLboolean alpha) {
-	//Generate texture ID and load texture data
-	GLuint textureID;
-	glGenTextures(1, &textureID);
+// Applies all recorded input up to the given simulation time and advances the camera by one fixed step
+void stepReplay(double time, GLfloat dt) {
+	InputEvent event;
+	while (inputReplay.next(time, event)) {
+		if (event.type == INPUT_KEY)
+			handleKey(event.key, event.action);
+		else if (event.type == INPUT_MOUSE)
+			handleMouse(event.x, event.y);
+		else if (event.type == INPUT_SCROLL)
+			handleScroll(event.y);
+	}
+	move_camera(dt);
+	inputReplay.checkCamera(time, camera);
+}
+
+GpuHandle loadTexture(GpuResources& resources, GLchar * path, GLboolean alpha) {
+	PROFILE_ZONE("LoadTexture");
+
+	//Load texture data
 	int width, height;
 	unsigned char* image = SOIL_load_image(path, &width, &height, 0, alpha ? SOIL_LOAD_RGBA : SOIL_LOAD_RGB);
+	if (image == NULL) {
+		std::cout << "ERROR::TEXTURE::LOAD_FAILED " << path << std::endl;
+		return GpuHandle();
+	}
 
-	//Assign texture to ID
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, alpha ? GL_RGBA : GL_RGB, width, height, 0, alpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, image);
+	//Storage (with mipmaps) comes from the resource manager, which leaves it bound
+	GpuHandle texture = resources.createTexture(alpha ? GL_RGBA8 : GL_RGB8, width, height, true);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, alpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, image);
 	glGenerateMipmap(GL_TEXTURE_2D);
 
 	// Parameters
@@ -237,11 +1455,39 @@ GLuint loadTexture(GLchar * path, GLboolean alpha) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	SOIL_free_image_data(image);
-	return textureID;
+	return texture;
+
+}
 
+// ChunkSource of --stream, runs on the loader threads. Same spacing and layers as the fixed grids, so the
+// streamed world looks like them with no end to it
+void generateCubeChunk(ChunkCoord chunk, std::vector<glm::vec3>& instances)
+{
+	int cells = (int)(CHUNK_SIZE / CUBE_SPACING);
+	glm::vec3 origin(chunk.x * CHUNK_SIZE, 0.0f, chunk.z * CHUNK_SIZE);
+	for (int layer = 0; layer < 4; layer++) {
+		for (int i = 0; i < cells; i++) {
+			for (int j = 0; j < cells; j++) {
+				instances.push_back(origin + glm::vec3(i * CUBE_SPACING, CUBE_LAYERS[layer], j * CUBE_SPACING));
+			}
+		}
+	}
+}
+
+// Rolling hills, solid from the bottom up to the height of each column
+void createVoxelTerrain(VoxelWorld& voxels, int size)
+{
+	PROFILE_ZONE("CreateVoxels");
+	for (int z = 0; z < size; z++) {
+		for (int x = 0; x < size; x++) {
+			GLfloat hills = 0.5f + 0.3f * sin(x * 0.07f) * cos(z * 0.05f) + 0.2f * sin((x + z) * 0.02f);
+			int height = std::max(1, (int)(hills * VOXEL_TERRAIN_HEIGHT));
+			voxels.setColumn(x, z, 0, height, true);
+		}
+	}
 }
 
-Cube* createCube()
+Cube* createCube(ObjectPool& pool)
 {
 	// 6 faces * 2 triangles * 3 vertices each
 	GLfloat cubeVertices[] = {
@@ -289,12 +1535,12 @@ Cube* createCube()
 		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
 	};
 
-	Cube* cube = new Cube(cubeVertices, sizeof(cubeVertices));
+	Cube* cube = pool.create<Cube>(cubeVertices, sizeof(cubeVertices));
 
 	return cube;
 }
 
-Plane* createPlane()
+Plane* createPlane(ObjectPool& pool)
 {
 	// Set up vertex data (and buffer(s)) and attribute pointers
 	GLfloat planeVertices[] = {
@@ -309,7 +1555,7 @@ Plane* createPlane()
 		1, 2, 3  // Second Triangle
 	};
 
-	Plane* plane = new Plane(planeVertices,
+	Plane* plane = pool.create<Plane>(planeVertices,
 										  sizeof(planeVertices),
 										  planeIndices,
 										  sizeof(planeIndices));
@@ -317,7 +1563,7 @@ Plane* createPlane()
 	return plane;
 }
 
-Light* createLight()
+Light* createLight(ObjectPool& pool)
 {
 	// 6 faces * 2 triangles * 3 vertices each
 	GLfloat lightVertices[] = {
@@ -365,7 +1611,7 @@ Light* createLight()
 		-0.5f,  0.5f, -0.5f
 	};
 
-	Light* light = new Light(lightVertices, sizeof(lightVertices));
+	Light* light = pool.create<Light>(lightVertices, sizeof(lightVertices));
 
 	return light;
 }
\ No newline at end of file
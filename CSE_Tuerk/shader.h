@@ -17,7 +17,13 @@ public:
 	Shader();
 	Shader(const GLchar * vertexPath, const GLchar * fragmentPath);
 
+	// Builds the program from source code which is already in memory (e.g. preprocessed by the ShaderLibrary)
+	static Shader* FromSource(const std::string& vertexCode, const std::string& fragmentCode);
+
 	void Use();
+
+private:
+	void compile(const GLchar* vShaderCode, const GLchar* fShaderCode);
 };
 
 #endif
\ No newline at end of file